@@ -29,6 +29,8 @@
 #include "misc.h"
 #include "msg.h"
 #include "filedatadest.h"
+#include "texmgr.h"
+#include "offscreen.h"
 
 /*NOT SURE WHAT THIS IS FOR?
 "The Export Animation Window allows you to save an animation as a series of jpeg or png files."
@@ -127,6 +129,7 @@ void AnimExportWin::submit(int id)
 		"GIF", //2020
 		"anim_0001.png","anim_1.png",
 		"anim_0001.jpg","anim_1.jpg",
+		"anim_0001.tga","anim_1.tga", //NEW
 	};
 	enum{ formatsN = sizeof(formats)/sizeof(*formats) };
 
@@ -284,52 +287,120 @@ void AnimExportWin::submit(int id)
 		int i = (int)(dur/interval+0.5);
 		int il = glutext::glutCreateImageList(nullptr,i-1);
 		int*pb =*glutext::glutLoadImageList(il,w,h,false);
+		bool alpha = pb&&pb[2]==GL_RGBA; //Assuming GL_UNSIGNED_BYTE.
+		size_t frameBytes = (size_t)w*h*(alpha?4:3);
+
+		//NEW: Frames are saved on TextureManager's writer threads while
+		//the next frames render. Formats it can write are encoded there
+		//too. writeAsync blocks if the writers fall too far behind.
+		auto *texmgr = TextureManager::getInstance();
+		bool encode = !gif&&texmgr->canWrite(saveFormat);
+		std::list<std::pair<std::string,TextureManager::WriteFuture>> writes;
+		auto written = [&](bool wait)->bool
+		{
+			while(!writes.empty())
+			{
+				auto &f = writes.front().second;
+				if(!wait&&f.wait_for(std::chrono::seconds(0))!=std::future_status::ready)
+				break;
+				if(f.get())
+				{
+					msg_error("%s\n%s",::tr("Could not write file: "),writes.front().first.c_str());
+					writes.clear(); return false; //The rest still get written.
+				}
+				writes.pop_front();
+			}
+			return true;
+		};
 
 		//Select main window's OpenGL context.
 		glutSetWindow(vp->model.glut_window_id);
-		glPixelStorei(GL_PACK_ALIGNMENT,1); //glReadPixels
 
-		int frameNum = 0; for(tm=0;i-->0;tm+=interval)
+		//NEW: FrameReader reads each frame back while the next renders
+		//(with pixel buffer objects) so save gets the previous frame.
+		FrameReader reader(x,y,w,h,alpha);
+		int frameNum = 0;
+		auto save = [&](const void *pixels)->bool
 		{
+			if(!pixels) return true; if(!pb) return false;
+
 			frameNum++;
-			
-			model->setCurrentAnimationTime(tm);			
 
-			if(!gif)
+			if(gif) //TODO? Render sheet of images to single PNG image.
 			{
-				//TODO: Try animated GIF (single file) path.
-				file.erase(saveFile);
-				file.append("/anim_");
-				char num[33];
-				sprintf(num,saveFormat[-3]=='0'?"%04d":"%d",frameNum);
-				file.append(num);
-				file.push_back('.');
-				file.append(saveFormat);
-				file.push_back('\0');
+				memcpy((void*&)pb[4],pixels,frameBytes);
+				pb = *glutext::glutLoadImageList(il+frameNum,w,h,false);
+				return true;
 			}
-			
-			mvp.render();
-			if(!pb) assert(pb);
-			else glReadPixels(x,y,pb[0],pb[1],pb[2],pb[3],(void*&)pb[4]);
 
-			if(gif) //TODO? Render sheet of images to single PNG image.
+			//TODO: Try animated GIF (single file) path.
+			file.erase(saveFile);
+			file.append("/anim_");
+			char num[33];
+			sprintf(num,saveFormat[-3]=='0'?"%04d":"%d",frameNum);
+			file.append(num);
+			file.push_back('.');
+			file.append(saveFormat);
+			file.push_back('\0');
+
+			if(!written(false)) return false;
+
+			if(encode)
 			{
-				pb = *glutext::glutLoadImageList(il+frameNum,w,h,false);
-				continue; single_sheet:;
+				writes.emplace_back(file.c_str(),
+				texmgr->writeAsync(pixels,w,h,alpha,file.c_str()));
+				return true;
+			}
+
+			size_t buf = file.size();
+			memcpy((void*&)pb[4],pixels,frameBytes);
+			if(file.render(il,saveFormat,gif))
+			{
+				std::string fn = file.c_str();
+				auto bytes = std::make_shared<std::string>(&file[buf],file.size()-buf);
+				writes.emplace_back(fn,texmgr->writeAsync([=]()->Texture::ErrorE
+				{
+					return FileDataDest(fn.c_str()).writeBytes(bytes->data(),bytes->size())
+					?Texture::ERROR_NONE:Texture::ERROR_FILE_WRITE;
+				}));
+				return true;
 			}
+			msg_error("%s\n%s",::tr("Could not write file: "),file.c_str());
+			return false;
+		};
+
+		auto t0 = std::chrono::steady_clock::now();
+
+		for(tm=0;i-->0;tm+=interval)
+		{
+			model->setCurrentAnimationTime(tm);			
+			
+			mvp.render();
+
+			if(!save(reader.read())) break; //Previous frame.
+		}
+		if(i<0&&!save(reader.finish())) i = 0; //Stay open.
+
+		if(!written(true)) i = std::max(i,0); //Stay open.
+
+		if(gif&&i<0) //Animated GIF.
+		{
+			gif = file.render_gif|(int)outfps;
 
 			size_t buf = file.size();
 			if(!file.render(il,saveFormat,gif)
 			||!FileDataDest(file.c_str()).writeBytes(&file[buf],file.size()-buf))
 			{
 				msg_error("%s\n%s",::tr("Could not write file: "),file.c_str());
-				if(gif) i = 0; //HACK
-				break;
+				i = 0; //HACK
 			}
-		}		
-		if(gif==1)
+		}
+
+		if(i<0) //NEW: Report throughput.
 		{
-			gif = file.render_gif|(int)outfps; goto single_sheet; 
+			double sec = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+			model_status(model,StatusNormal,STATUSTIME_LONG,"Exported %d frames in %.2f seconds (%.1f fps)",
+			frameNum,sec,frameNum/std::max(sec,0.001));
 		}
 
 		glutext::glutDestroyImageList(il);
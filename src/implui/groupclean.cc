@@ -26,6 +26,7 @@
 #include "model.h"
 #include "log.h"
 #include "modelstatus.h"
+#include "misc.h"
 
 
 //Note: Renaming to match help file URL.
@@ -40,6 +41,7 @@ struct GroupCleanWin : Win
 	b(main,"Remove unused materials"),
 	c(main,"Merge identical groups"),
 	d(main,"Remove unused groups"),
+	e(main,"Bake texture atlas (TGA)"),
 	ok_cancel(main)
 	{
 		for(auto*ea=&a;ea<=&d;ea++) ea->set();
@@ -49,9 +51,40 @@ struct GroupCleanWin : Win
 
 	Model *model;
 
-	boolean a,b,c,d; 
+	boolean a,b,c,d,e; 
 	ok_cancel_panel ok_cancel; 
+
+	void bake();
 };
+void GroupCleanWin::bake()
+{
+	int_list mats;
+	for(int pass=0;pass<2&&mats.empty();pass++)
+	for(int g=model->getGroupCount();g-->0;)
+	if(pass||model->isGroupSelected(g))
+	{
+		int m = model->getGroupTextureId(g);
+		if(m>=0) mats.push_back(m);
+	}
+
+	const char *modelFile = model->getFilename();
+	FileBox file = config.get("ui_model_dir");
+	if(*modelFile) //???
+	{
+		std::string fullname,fullpath,basename; //REMOVE US
+		normalizePath(modelFile,fullname,fullpath,basename);
+		file = fullpath.c_str();
+	}
+	file.locate("Save TGA",::tr("File name for texture atlas?"),true);
+	if(file.empty()) return;
+
+	int baked = model->bakeTextureAtlas(mats,file.c_str());
+	if(baked<0)
+	{
+		model_status(model,StatusError,STATUSTIME_LONG,::tr("Could not write %s"),file.c_str());
+	}
+	else model_status(model,StatusNormal,STATUSTIME_LONG,::tr("Baked %d materials into a texture atlas."),baked);
+}
 void GroupCleanWin::submit(int id)
 {
 	if(id==id_ok)
@@ -64,6 +97,10 @@ void GroupCleanWin::submit(int id)
 		int mig = c?model->mergeIdenticalGroups():0;
 		int rug = d?model->removeUnusedGroups():0;
 
+		//NEW: Packs the selected groups' materials (or all of them) into
+		//one texture so exporters get one material for them.
+		if(e) bake();
+
 		//::tr("Merged %1 groups,%2 materials; Removed %3 of %4 groups,%5 of %6 materials");
 		utf8 fmt = ::tr("Merged %d groups, %d materials; Removed %d of %d groups, %d of %d materials.");
 		model_status(model,StatusNormal,STATUSTIME_LONG,fmt,mig,mim,rug,n,rum,m); 
@@ -148,6 +148,7 @@ struct ViewBar::StatusBar : StatusObject
 	_keys_snap(flags,"Scr",id_animate_snap),
 	_sanim_mode(flags,"Sam",id_animate_mode_1),
 	_fanim_mode(flags,"Fam",id_animate_mode_2),
+	times(nav,""),m_times(),m_timesShown(),
 	stats(nav,"")
 	{
 		nav.expand();
@@ -158,6 +159,7 @@ struct ViewBar::StatusBar : StatusObject
 		nav.space(20);
 		text.expand();
 		text.title(true); //EXPERIMENTAL
+		times.ralign(); times.set_hidden(); //NEW
 		stats.ralign(); _curstats[0][0] = -1;
 		flags.ralign().space(0,/*underscoring*/0,0);
 	}
@@ -199,12 +201,17 @@ struct ViewBar::StatusBar : StatusObject
 	_keys_snap, //Scr (inverted)
 	_sanim_mode, //Sam
 	_fanim_mode; //Fam
+	titlebar times; bool m_times; double m_timesShown; //NEW
 	titlebar stats;
 
 	// StatusObject methods
 	virtual void setText(utf8 str);
 	virtual void addText(StatusTypeE type, int ms, utf8 str);
 	virtual void setStats();
+
+	//NEW: Shows ModelViewport::Timing's averages.
+	void showTimes(bool);
+	void setTimes(ModelViewport::Timing&);
 	
 	void setModel(Model*);
 	
@@ -31,6 +31,7 @@
 #include "msg.h"
 
 #include "filedatadest.h"
+#include "texmgr.h"
 
 struct PaintTextureWin : Win
 {
@@ -81,6 +82,16 @@ struct PaintTextureWin : Win
 	canvas scene;
 
 	Widget texture;
+
+	//NEW: The last save is written on TextureManager's writer thread.
+	std::string saving;
+	TextureManager::WriteFuture saved;
+	void finish_saving()
+	{
+		if(saved.valid()&&saved.get())
+		msg_error("%s\n%s",::tr("Could not write file: "),saving.c_str());
+	}
+	~PaintTextureWin(){ finish_saving(); }
 };
 void PaintTextureWin::submit(int id)
 {
@@ -216,11 +227,27 @@ void PaintTextureWin::submit(int id)
 	if(!pb) assert(pb);
 	else glReadPixels(x,y,pb[0],pb[1],pb[2],pb[3],(void*&)pb[4]);
 
-	if(!file.render(il,"PNG")
-	||!FileDataDest(file.c_str()).writeBytes(&file[buf],file.size()-buf))
+	finish_saving();
+
+	//If TextureManager can write the extension the user chose it's encoded
+	//on the writer too. Otherwise it's PNG and the writer just saves it.
+	auto *tm = TextureManager::getInstance();
+	if(tm->canWrite(file.c_str())) //Assuming GL_UNSIGNED_BYTE.
 	{
-		msg_error("%s\n%s",::tr("Could not write file: "),file.c_str());
+		saving = file.c_str(); 
+		saved = tm->writeAsync((void*&)pb[4],pb[0],pb[1],pb[2]==GL_RGBA,file.c_str());
+	}
+	else if(file.render(il,"PNG"))
+	{
+		std::string fn = saving = file.c_str();
+		auto bytes = std::make_shared<std::string>(&file[buf],file.size()-buf);
+		saved = tm->writeAsync([=]()->Texture::ErrorE
+		{
+			return FileDataDest(fn.c_str()).writeBytes(bytes->data(),bytes->size())
+			?Texture::ERROR_NONE:Texture::ERROR_FILE_WRITE;
+		});
 	}
+	else msg_error("%s\n%s",::tr("Could not write file: "),file.c_str());
 
 	glutext::glutDestroyImageList(il);
 }
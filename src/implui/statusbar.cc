@@ -194,3 +194,26 @@ void ViewBar::StatusBar::setStats()
 	}
 	st.pop_back(); stats.repack();
 }
+void ViewBar::StatusBar::showTimes(bool show)
+{
+	if(!show) times.name().clear();
+
+	times.set_hidden(!show); times.repack();
+
+	m_times = show; m_timesShown = 0;
+}
+void ViewBar::StatusBar::setTimes(ModelViewport::Timing &t)
+{
+	if(!m_times) return;
+
+	//Updating the text 4 times a second is enough to be readable
+	//and doesn't keep the status bar redrawing.
+	double now = std::chrono::duration<double>
+	(std::chrono::steady_clock::now().time_since_epoch()).count();
+	if(now-m_timesShown<0.25) return;
+	m_timesShown = now;
+
+	std::string &st = times.name();
+	std::string cmp; t.format(cmp);
+	if(cmp!=st){ st.swap(cmp); times.repack(); }
+}
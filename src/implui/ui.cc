@@ -146,6 +146,9 @@ const char *ui_translate(const char *ctxt, const char *msg) //transimp.h
 int pics[pic_N] = {}; //extern
 int ui_prep(int &argc, char *argv[]) //extern
 {	
+	//NEW: glutInit would fail without a display (e.g. CI servers.)
+	if(cmdline_runheadless) return 0;
+
 	Widgets95::glut::set_wxWidgets_enabled();
 	glutInit(&argc,argv);
 	glutext::glutDropFilesFunc(ui_drop);
@@ -262,6 +265,11 @@ struct StdTexFilter : TextureFilter
 
 		if(!isalpha(*format)) return e; //Must protect XPM mode.
 
+		//NEW: ui_prep doesn't initialize the UI for --render-frames so
+		//glutCreateImageList can't be used. TGA and PCX are decoded by
+		//libmm3d's filters.
+		if(cmdline_runheadless) return e;
+
 		//TODO: Avoid copy if MemDataSource? 
 		//TODO: Unbounded/unrewindable stream?
 		size_t sz = src.getFileSize(); 
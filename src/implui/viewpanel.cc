@@ -329,6 +329,8 @@ void ViewPanel::draw()
 		glutSetWindow(gw);
 	}
 
+	timing.beginFrame(); //NEW
+
 	//REMINDER: I spent like a day fussing with this
 	//to layout the outlines between the views, only
 	//to learn that the views need to be exactly the
@@ -394,6 +396,10 @@ void ViewPanel::draw()
 		glEnd();
 	}
 
+	//NEW: glutSwapBuffers can block on vsync, so it's left
+	//out of the frame's time.
+	timing.endFrame(); status.setTimes(timing);
+
 	glutSwapBuffers();
 }
 
@@ -410,6 +416,10 @@ status(bar2)
 	extern int viewwin_tick(Win::si*,int,double&,int);
 	timeline.set_tick_callback(viewwin_tick);
 
+	//NEW: Synchronizing is more accurate but slows drawing.
+	timing.sync = config.get("ui_frame_timing_sync",false);
+	status.showTimes(config.get("ui_frame_timing",false));
+
 	//TODO: Maybe make glut::set_ obsolete?
 	assert(glutGetWindow()==model.glut_window_id);
 	auto display_func = [](){ viewwin()->views.draw(); };
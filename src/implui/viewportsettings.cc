@@ -31,7 +31,7 @@ struct ViewportSettings : Win
 	ViewportSettings(Model *model)
 		:
 	Win("Viewport Settings"),model(model),
-	ortho(main),persp(main),f1_ok_cancel(main)
+	ortho(main),persp(main),drag(main),f1_ok_cancel(main)
 	{
 		active_callback = &ViewportSettings::submit;
 
@@ -78,8 +78,20 @@ struct ViewportSettings : Win
 		textbox unit,lines,points;
 		boolean xy,xz,yz;
 	};
+	struct drag_group //NEW
+	{
+		drag_group(node *main)
+			:
+		nav(main,"Dragging"),
+		proxy(nav,"Proxy Over (Triangles)\t")
+		{}
+
+		panel nav;
+		textbox proxy;
+	};
 	ortho_group ortho;
 	persp_group persp;
+	drag_group drag;
 	f1_ok_cancel_panel f1_ok_cancel;	
 };
 void ViewportSettings::submit(int i)
@@ -112,6 +124,7 @@ void ViewportSettings::submit(int i)
 		persp.xy.set(vu.xyz3d&4);
 		persp.xz.set(vu.xyz3d&2);
 		persp.yz.set(vu.xyz3d&1);
+		drag.proxy.edit(0,vu.proxy3d,INT_MAX); //0 is off.
 		break;
 
 	case id_ok:
@@ -124,6 +137,7 @@ void ViewportSettings::submit(int i)
 		config.set("ui_3dgrid_xy",(bool)persp.xy);
 		config.set("ui_3dgrid_xz",(bool)persp.xz);
 		config.set("ui_3dgrid_yz",(bool)persp.yz);
+		config.set("ui_proxy_triangles",(int)drag.proxy);
 		vu.inc = ortho.unit;
 		vu.grid = ortho.mult;
 		vu.inc3d = persp.unit;
@@ -133,6 +147,7 @@ void ViewportSettings::submit(int i)
 		if(persp.xy) vu.xyz3d|=4;
 		if(persp.xz) vu.xyz3d|=2;
 		if(persp.yz) vu.xyz3d|=1;
+		vu.proxy3d = drag.proxy;
 		break;
 	}
 
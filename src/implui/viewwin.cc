@@ -530,6 +530,12 @@ void MainWin::_init_menu_toolbar() //2019
 			s = !r;	
 			glutAddMenuEntry(O(s,rops_hide_backs,"Hide Back-facing Triangles","View|Hide Back-facing Triangles","Shift+F")); 
 			glutAddMenuEntry(O(r,rops_show_backs,"Draw Back-facing Triangles","View|Draw Back-facing Triangles"));
+
+		glutAddMenuEntry(); //NEW
+
+			r = config.get("ui_frame_timing",false);
+			glutAddMenuEntry(X(r,rops_frame_timing,"Show Frame Timing","View|Show Frame Timing"));
+			glutAddMenuEntry(E(rops_frame_dump,"Dump Frame Timing","View|Dump Frame Timing"));
 		}
 
 		_view_menu = glutCreateMenu(viewwin_menubarfunc);	
@@ -1095,6 +1101,38 @@ MainWin::~MainWin()
 	//delete _texturecoord_win;
 }
 
+static void viewwin_textures_timer(int id) //loadPendingTextures
+{
+	for(auto*ea:viewwin_list) if(ea->glut_window_id==id)
+	{
+		if(!ea->model) return;
+
+		glutSetWindow(id);
+		if(ea->model->loadPendingTextures())
+		ea->views.modelUpdatedEvent();
+
+		if(ea->model->hasPendingTextures())
+		glutTimerFunc(50,viewwin_textures_timer,id);
+		return;
+	}
+}
+void viewwin_reload_textures()
+{
+	if(TextureManager::getInstance()->reloadTextures())		
+	for(auto ea:viewwin_list)
+	{
+		ea->model->invalidateTextures(); //OVERKILL
+		ea->views.modelUpdatedEvent();
+	}
+}
+static void viewwin_reload_timer(int) //watchTextures
+{
+	if(viewwin_list.empty()) return;
+	
+	viewwin_reload_textures();
+
+	glutTimerFunc(500,viewwin_reload_timer,0);
+}
 Model *MainWin::_swap_models(Model *swap)
 {
 	selection.clear(); //best?
@@ -1132,6 +1170,10 @@ Model *MainWin::_swap_models(Model *swap)
 		model->setDrawOption(Model::DO_BADTEX,true);
 		if(!config.get("ui_render_backfaces",false))
 		model->setDrawOption(Model::DO_BACKFACECULL,true);
+		if(config.get("ui_render_sorted_alpha",false)) //NEW
+		model->setDrawOption(Model::DO_ALPHA_SORT,true);
+		if(config.get("ui_render_frustum_cull",true)) //NEW
+		model->setDrawOption(Model::DO_FRUSTUM,true);
 		if(config.get("ui_render_3d_selections",false))
 		model->setDrawSelection(true);	
 		//
@@ -1145,6 +1187,7 @@ Model *MainWin::_swap_models(Model *swap)
 		if(config.get("ui_3dgrid_xy",false)) vu.xyz3d|=4;
 		if(config.get("ui_3dgrid_xz",true)) vu.xyz3d|=2;
 		if(config.get("ui_3dgrid_yz",false)) vu.xyz3d|=1;
+		vu.proxy3d = config.get("ui_proxy_triangles",250000); //NEW
 		if(config.get("ui_snap_grid",false)) vu.snap|=vu.UnitSnap;
 		if(config.get("ui_snap_vertex",false)) vu.snap|=vu.VertexSnap;
 	}
@@ -1171,6 +1214,18 @@ Model *MainWin::_swap_models(Model *swap)
 	//REMINDER: _projection_win/_texturecoord_win needs
 	//loadTextures for setModel.
 	model->loadTextures();
+	//NEW: Textures may still be decoding. Model::draw would pick them
+	//up but there mightn't be a reason to redraw.
+	if(model->hasPendingTextures())
+	glutTimerFunc(50,viewwin_textures_timer,glut_window_id);
+
+	//NEW: Reload textures as they're saved by other programs?
+	auto *tm = TextureManager::getInstance();
+	if(!tm->isWatchingTextures()&&config.get("ui_watch_textures",true))
+	{
+		tm->watchTextures(true);
+		glutTimerFunc(500,viewwin_reload_timer,0);
+	}
 
 	sidebar.setModel();
 	//sidebar updates animation.
@@ -1931,6 +1986,28 @@ void MainWin::perform_menu_action(int id)
 		m->setDrawOption(Model::DO_BACKFACECULL,!id);
 		break;
 
+	case id_rops_frame_timing: //NEW
+	{
+		bool x = 0!=glutGet(glutext::GLUT_MENU_CHECKED);
+		config.set("ui_frame_timing",x);
+		w->views.status.showTimes(x);
+		return;
+	}
+	case id_rops_frame_dump: //NEW
+	{
+		//Appends so runs can be compared.
+		std::string path = config.get("ui_frame_timing_file");
+		if(path.empty())
+		path = getMm3dHomeDirectory()+"/frame_timing.txt";
+		const char *title = m->getFilename();
+		if(!*title) title = "Untitled";
+		if(w->views.timing.dump(path.c_str(),title))
+		model_status(m,StatusNormal,STATUSTIME_SHORT,::tr("Frame timing saved to %s"),path.c_str());
+		else
+		model_status(m,StatusError,STATUSTIME_LONG,::tr("Could not write %s"),path.c_str());
+		return;
+	}
+
 	/*View menu*/
 	case id_frame_all:
 	case id_frame_selection:
@@ -2099,13 +2176,8 @@ void MainWin::perform_menu_action(int id)
 	
 		//NOTE: It does timestamp comparison, but I think
 		//it should be limited to the current main window.
-		if(TextureManager::getInstance()->reloadTextures())		
-		for(auto ea:viewwin_list)
-		{
-			ea->model->invalidateTextures(); //OVERKILL
-			ea->views.modelUpdatedEvent();
-		}
-		return;
+		extern void viewwin_reload_textures();
+		viewwin_reload_textures(); return;
 
 	case id_projection_settings: 
 		
@@ -85,6 +85,8 @@ enum
 	id_rops_show_lines,
 	id_rops_hide_backs,
 	id_rops_show_backs,
+	id_rops_frame_timing,
+	id_rops_frame_dump,
 
 	/*View menu*/
 	id_frame_all,
@@ -29,18 +29,18 @@
 #include "log.h"
 #include "model.h" // Yes,it's hackish
 
-std::vector<BspTree::Poly*> BspTree::Poly::s_recycle;
-std::vector<BspTree::Node*> BspTree::Node::s_recycle;
-
-int BspTree::Poly::s_allocated = 0;
-int BspTree::Node::s_allocated = 0;
-
 bool float_equiv(double rhs, double lhs)
 {
 	return fabs(rhs-lhs)<0.0001f;
 }
 
-static void bsptree_setMaterial(DrawingContext *context, int texture,Model::Material *material)
+template<class T>
+static double bsptree_dot(const float *a, const T *b)
+{
+	return (double)a[0]*b[0]+(double)a[1]*b[1]+(double)a[2]*b[2];
+}
+
+static void bsptree_setMaterial(DrawingContext *context, int texture, const Model::Material *material)
 {
 	glMaterialfv(GL_FRONT,GL_AMBIENT,
 			material->m_ambient);
@@ -53,12 +53,11 @@ static void bsptree_setMaterial(DrawingContext *context, int texture,Model::Mate
 	glMaterialf(GL_FRONT,GL_SHININESS,
 			material->m_shininess);
 
-	context->m_currentTexture = texture;
-
 	if(material->m_type==Model::Material::MATTYPE_TEXTURE)
 	{
-		glBindTexture(GL_TEXTURE_2D,
-				context->m_matTextures[context->m_currentTexture]);
+		//NEW: Model::draw doesn't always have a context.
+		glBindTexture(GL_TEXTURE_2D,context?
+				context->m_matTextures[texture]:material->m_texture);
 
 		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,
 				material->m_sClamp ? GL_CLAMP : GL_REPEAT);
@@ -67,716 +66,432 @@ static void bsptree_setMaterial(DrawingContext *context, int texture,Model::Mate
 	}
 }
 
-int BspTree::Poly::s_nextId = 0;
-
 void BspTree::Poly::calculateNormal()
 {
-	double A = coord[0][1] *(coord[1][2]-coord[2][2])+coord[1][1] *(coord[2][2]-coord[0][2])+coord[2][1] *(coord[0][2]-coord[1][2]);
-	double B = coord[0][2] *(coord[1][0]-coord[2][0])+coord[1][2] *(coord[2][0]-coord[0][0])+coord[2][2] *(coord[0][0]-coord[1][0]);
-	double C = coord[0][0] *(coord[1][1]-coord[2][1])+coord[1][0] *(coord[2][1]-coord[0][1])+coord[2][0] *(coord[0][1]-coord[1][1]);
+	double A = (double)coord[0][1] *(coord[1][2]-coord[2][2])+(double)coord[1][1] *(coord[2][2]-coord[0][2])+(double)coord[2][1] *(coord[0][2]-coord[1][2]);
+	double B = (double)coord[0][2] *(coord[1][0]-coord[2][0])+(double)coord[1][2] *(coord[2][0]-coord[0][0])+(double)coord[2][2] *(coord[0][0]-coord[1][0]);
+	double C = (double)coord[0][0] *(coord[1][1]-coord[2][1])+(double)coord[1][0] *(coord[2][1]-coord[0][1])+(double)coord[2][0] *(coord[0][1]-coord[1][1]);
 
 	double len = sqrt((A *A)+(B *B)+(C *C));
 
-	norm[0] = A/len;
-	norm[1] = B/len;
-	norm[2] = C/len;
+	norm[0] = (float)(A/len);
+	norm[1] = (float)(B/len);
+	norm[2] = (float)(C/len);
 
 	calculateD();
-
-	//printf("normal: %f %f %f\n",norm[0],norm[1],norm[2]);
-	//printf("d:		%f\n",d);
 }
 
 void BspTree::Poly::calculateD()
 {
-	d = dot_product(coord[0],norm);
+	d = (float)bsptree_dot(norm,coord[0]);
 }
 
-void BspTree::Poly::intersection(double *p1, double *p2, double *po, float &place)
+void BspTree::Poly::intersection(const float *p1, const float *p2, float *po, float &place)
 {
-	double dtemp	 = 0.0f;
-
-	place	 = 0.5f;
-
-	bool greater = false;
-
-	if(dot_product(p2,norm)>d)
-	{
-		greater = true;
-	}
-
-	if(dot_product(p1,norm)>d)
-	{
-		if(greater)
-		{
-			//printf("no intersection!\n");
-			return;
-		}
-	}
-	else
-	{
-		if(!greater)
-		{
-			//printf("no intersection!\n");
-			return;
-		}
-	}
-
-	double diff[3];
-	float oldPlace = place;
-	float interval = 0.25f;
-
-	diff[0] = p2[0]-p1[0];
-	diff[1] = p2[1]-p1[1];
-	diff[2] = p2[2]-p1[2];
+	//NOTE: This was a bisection search. The plane is crossed where
+	//the dot product is equal to d, so it's solved directly instead.
+	double d1 = bsptree_dot(norm,p1);
+	double d2 = bsptree_dot(norm,p2);
 
-	do 
-	{
-		po[0] = diff[0] *place+p1[0];
-		po[1] = diff[1] *place+p1[1];
-		po[2] = diff[2] *place+p1[2];
-
-		dtemp = dot_product(po,norm);
-
-		oldPlace = place;
+	place = d1==d2?0.5f:(float)std::min(1.0,std::max(0.0,(d-d1)/(d2-d1)));
 
-		if(greater)
-		{
-			place += (dtemp>d)? -interval : interval;
-		}
-		else
-		{
-			place += (dtemp>d)? interval : -interval;
-		}
-
-		interval = interval *0.5f;
-	} while(!float_equiv(d,dtemp));
-
-	place = oldPlace;
+	for(int i=0;i<3;i++) po[i] = (p2[i]-p1[i])*place+p1[i];
 }
 
-void BspTree::Poly::render(DrawingContext *context)
+void BspTree::_render(Poly &p, Model *model, DrawingContext *context, int &material)
 {
-	//printf("render triangle %d\n",id);
-
-	if(context->m_currentTexture!=texture)
+	if(material!=p.material)
 	{
 		glEnd();
 
-		bsptree_setMaterial(context,texture,static_cast<Model::Material*>(material));
+		material = p.material;
+		bsptree_setMaterial(context,material,model->getMaterialList()[material]);
 
 		glBegin(GL_TRIANGLES);
 	}
 
-	Model::Triangle *tri = static_cast<Model::Triangle*>(triangle);
-	if(tri->m_visible)
+	if(model->getTriangleList()[p.triangle]->m_visible)
 	{
 		for(int i = 0; i<3; i++)
 		{
-			glTexCoord2f(s[i],t[i]);
-			glNormal3dv(drawNormals[i]);
-			glVertex3dv(coord[i]);
+			glTexCoord2f(p.s[i],p.t[i]);
+			glNormal3fv(p.drawNormals[i]);
+			glVertex3fv(p.coord[i]);
 		}
 	}
 }
 
-void BspTree::Poly::print()
+int BspTree::_node(const Poly &p)
 {
-	//printf("Poly %d\n",id);
-	//printf("  coord[0] = %f %f %f\n",coord[0][0],coord[0][1],coord[0][2]);
-	//printf("  coord[1] = %f %f %f\n",coord[1][0],coord[1][1],coord[1][2]);
-	//printf("  coord[2] = %f %f %f\n",coord[2][0],coord[2][1],coord[2][2]);
-	//printf("  n  = %f %f %f\n",norm[0],norm[1],norm[2]);
+	Node n; n.self = p; n.left = n.right = -1;
+
+	m_nodes.push_back(n); return (int)m_nodes.size()-1;
 }
 
-void BspTree::addPoly(BspTree::Poly *p)
+void BspTree::addPoly(const Poly &p)
 {
-	Node *n = Node::get();
-	n->self = p;
-	if(!m_root) m_root = n;
-	else m_root->addChild(n);
+	int n = _node(p);
+	if(m_root==-1) m_root = n;
+	else _addChild(m_root,n);
 }
 
-void BspTree::render(double *point, DrawingContext *context)
+void BspTree::render(double *point, DrawingContext *context, Model *model)
 {
-	if(m_root)
+	if(m_root==-1) return;
+
+	int material = m_nodes[m_root].self.material;
+	bsptree_setMaterial(context,material,model->getMaterialList()[material]);
+	glEnable(GL_TEXTURE_2D); //???
+	glBegin(GL_TRIANGLES);
+
+	//Each node draws the side of its plane that is away from point,
+	//then itself, then the side facing point. The stack holds nodes
+	//waiting on their far side to finish, ~ if their far side is on
+	//the right.
+	auto &stack = m_stack; stack.clear();
+	for(int i=m_root;;)
 	{
-		bsptree_setMaterial(context,m_root->self->texture,static_cast<Model::Material*>(m_root->self->material));
-		glEnable(GL_TEXTURE_2D); //???
+		while(i!=-1)
 		{
-			glBegin(GL_TRIANGLES);
-			m_root->render(point,context);
-			glEnd();
+			Node &n = m_nodes[i];
+			if(bsptree_dot(n.self.norm,point)<n.self.d)
+			{
+				stack.push_back(~i); i = n.right;
+			}
+			else
+			{
+				stack.push_back(i); i = n.left;
+			}
 		}
-		glDisable(GL_TEXTURE_2D); //NEW
-	}
-}
+		if(stack.empty()) break;
 
-void BspTree::clear()
-{
-	if(m_root)
-	{
-		m_root->release();
-		m_root = nullptr;
-	}
-}
+		i = stack.back(); stack.pop_back();
 
-BspTree::Poly *BspTree::Poly::get()
-{
-	if(!s_recycle.empty())
-	{
-		Poly *n = s_recycle.back();
-		s_recycle.pop_back();
-		return n;
-	}
-	else
-	{
-		return new Poly;
-	}
-}
+		bool right = i<0; if(right) i = ~i;
 
-void BspTree::Poly::release()
-{
-	s_recycle.push_back(this);
-}
-
-BspTree::Node *BspTree::Node::get()
-{
-	if(!s_recycle.empty())
-	{
-		Node *n = s_recycle.back();
-		s_recycle.pop_back();
-		n->self = nullptr;
-		n->left = nullptr;
-		n->right = nullptr;
-		return n;
-	}
-	else
-	{
-		return new Node;
+		Node &n = m_nodes[i];
+		_render(n.self,model,context,material);
+		i = right?n.left:n.right;
 	}
-}
 
-void BspTree::Node::release()
-{
-	if(left)
-	{
-		left->release();
-	}
-	if(self)
-	{
-		self->release();
-	}
-	if(right)
-	{
-		right->release();
-	}
-	s_recycle.push_back(this);
+	glEnd();
+	glDisable(GL_TEXTURE_2D); //NEW
 }
 
-void BspTree::Node::splitNodes(int idx1, int idx2, int idx3,
-		double *p1, double *p2,
-		BspTree::Node *n1,BspTree::Node *n2,
-		float place1,
-		float place2)
+void BspTree::_splitNodes(int n, int idx1, int idx2, int idx3,
+		float *p1, float *p2, int n1, int n2,
+		float place1, float place2)
 {
-	n1->self = Poly::get();
-	//printf("split node poly: %d\n",n1->self->id);
+	Poly &self = m_nodes[n].self;
+	Poly &poly1 = m_nodes[n1].self;
+	Poly &poly2 = m_nodes[n2].self;
+
 	for(int i = 0; i<3; i++)
 	{
-		n1->self->coord[0][i] = p1[i];
-		n1->self->coord[1][i] = self->coord[idx2][i];
-		n1->self->coord[2][i] = self->coord[idx3][i];
+		poly1.coord[0][i] = p1[i];
+		poly1.coord[1][i] = self.coord[idx2][i];
+		poly1.coord[2][i] = self.coord[idx3][i];
 
-		n1->self->drawNormals[0][i] = self->norm[i];
-		n1->self->drawNormals[1][i] = self->drawNormals[idx2][i];
-		n1->self->drawNormals[2][i] = self->drawNormals[idx3][i];
+		poly1.drawNormals[0][i] = self.norm[i];
+		poly1.drawNormals[1][i] = self.drawNormals[idx2][i];
+		poly1.drawNormals[2][i] = self.drawNormals[idx3][i];
 	}
-	n1->self->s[0] = (self->s[idx2]-self->s[idx1])*place1+self->s[idx1];
-	n1->self->s[1] = self->s[idx2];
-	n1->self->s[2] = self->s[idx3];
+	poly1.s[0] = (self.s[idx2]-self.s[idx1])*place1+self.s[idx1];
+	poly1.s[1] = self.s[idx2];
+	poly1.s[2] = self.s[idx3];
 
-	n1->self->t[0] = (self->t[idx2]-self->t[idx1])*place1+self->t[idx1];
-	n1->self->t[1] = self->t[idx2];
-	n1->self->t[2] = self->t[idx3];
+	poly1.t[0] = (self.t[idx2]-self.t[idx1])*place1+self.t[idx1];
+	poly1.t[1] = self.t[idx2];
+	poly1.t[2] = self.t[idx3];
 
-	n1->self->calculateNormal();
-	n1->self->texture = self->texture;
-	n1->self->triangle = self->triangle;
-	n1->self->material = self->material;
+	poly1.calculateNormal();
+	poly1.material = self.material;
+	poly1.triangle = self.triangle;
 
-	n2->self = Poly::get();
-	//printf("split node poly: %d\n",n2->self->id);
 	for(int i = 0; i<3; i++)
 	{
-		n2->self->coord[0][i] = p1[i];
-		n2->self->coord[1][i] = self->coord[idx3][i];
-		n2->self->coord[2][i] = p2[i];
+		poly2.coord[0][i] = p1[i];
+		poly2.coord[1][i] = self.coord[idx3][i];
+		poly2.coord[2][i] = p2[i];
 
-		n2->self->drawNormals[0][i] = self->norm[i];
-		n2->self->drawNormals[1][i] = self->drawNormals[idx3][i];
-		n2->self->drawNormals[2][i] = self->norm[i];
+		poly2.drawNormals[0][i] = self.norm[i];
+		poly2.drawNormals[1][i] = self.drawNormals[idx3][i];
+		poly2.drawNormals[2][i] = self.norm[i];
 	}
-	n2->self->s[0] = (self->s[idx2]-self->s[idx1])*place1+self->s[idx1];
-	n2->self->s[1] = self->s[idx3];
-	n2->self->s[2] = (self->s[idx3]-self->s[idx1])*place2+self->s[idx1];
+	poly2.s[0] = (self.s[idx2]-self.s[idx1])*place1+self.s[idx1];
+	poly2.s[1] = self.s[idx3];
+	poly2.s[2] = (self.s[idx3]-self.s[idx1])*place2+self.s[idx1];
 
-	n2->self->t[0] = (self->t[idx2]-self->t[idx1])*place1+self->t[idx1];
-	n2->self->t[1] = self->t[idx3];
-	n2->self->t[2] = (self->t[idx3]-self->t[idx1])*place2+self->t[idx1];
+	poly2.t[0] = (self.t[idx2]-self.t[idx1])*place1+self.t[idx1];
+	poly2.t[1] = self.t[idx3];
+	poly2.t[2] = (self.t[idx3]-self.t[idx1])*place2+self.t[idx1];
 
-	n2->self->calculateNormal();
-	n2->self->texture = self->texture;
-	n2->self->triangle = self->triangle;
-	n2->self->material = self->material;
+	poly2.calculateNormal();
+	poly2.material = self.material;
+	poly2.triangle = self.triangle;
 
 	for(int i = 0; i<3; i++)
 	{
-		self->coord[idx2][i] = p1[i];
-		self->coord[idx3][i] = p2[i];
+		self.coord[idx2][i] = p1[i];
+		self.coord[idx3][i] = p2[i];
 
-		self->drawNormals[idx2][i] = self->norm[i];
-		self->drawNormals[idx3][i] = self->norm[i];
+		self.drawNormals[idx2][i] = self.norm[i];
+		self.drawNormals[idx3][i] = self.norm[i];
 	}
-	self->s[idx2] = (self->s[idx2]-self->s[idx1])*place1+self->s[idx1];
-	self->s[idx3] = (self->s[idx3]-self->s[idx1])*place2+self->s[idx1];
+	self.s[idx2] = (self.s[idx2]-self.s[idx1])*place1+self.s[idx1];
+	self.s[idx3] = (self.s[idx3]-self.s[idx1])*place2+self.s[idx1];
 
-	self->t[idx2] = (self->t[idx2]-self->t[idx1])*place1+self->t[idx1];
-	self->t[idx3] = (self->t[idx3]-self->t[idx1])*place2+self->t[idx1];
+	self.t[idx2] = (self.t[idx2]-self.t[idx1])*place1+self.t[idx1];
+	self.t[idx3] = (self.t[idx3]-self.t[idx1])*place2+self.t[idx1];
 
-	self->calculateD();
+	self.calculateD();
 }
 
-void BspTree::Node::splitNode(int idx1, int idx2, int idx3,
-		double *p1, BspTree::Node *n1, float place)
+void BspTree::_splitNode(int n, int idx1, int idx2, int idx3,
+		float *p1, int n1, float place)
 {
-	n1->self = Poly::get();
-	//printf("split node poly: %d\n",n1->self->id);
+	Poly &self = m_nodes[n].self;
+	Poly &poly1 = m_nodes[n1].self;
+
 	for(int i = 0; i<3; i++)
 	{
-		n1->self->coord[0][i] = self->coord[idx1][i];
-		n1->self->coord[1][i] = self->coord[idx2][i];
-		n1->self->coord[2][i] = p1[i];
+		poly1.coord[0][i] = self.coord[idx1][i];
+		poly1.coord[1][i] = self.coord[idx2][i];
+		poly1.coord[2][i] = p1[i];
 
-		n1->self->drawNormals[0][i] = self->drawNormals[idx1][i];
-		n1->self->drawNormals[1][i] = self->drawNormals[idx2][i];
-		n1->self->drawNormals[2][i] = self->norm[i];
+		poly1.drawNormals[0][i] = self.drawNormals[idx1][i];
+		poly1.drawNormals[1][i] = self.drawNormals[idx2][i];
+		poly1.drawNormals[2][i] = self.norm[i];
 	}
 
-	n1->self->s[0] = self->s[idx1];
-	n1->self->s[1] = self->s[idx2];
-	n1->self->s[2] = (self->s[idx3]-self->s[idx2])*place+self->s[idx2];
+	poly1.s[0] = self.s[idx1];
+	poly1.s[1] = self.s[idx2];
+	poly1.s[2] = (self.s[idx3]-self.s[idx2])*place+self.s[idx2];
 
-	n1->self->t[0] = self->t[idx1];
-	n1->self->t[1] = self->t[idx2];
-	n1->self->t[2] = (self->t[idx3]-self->t[idx2])*place+self->t[idx2];
+	poly1.t[0] = self.t[idx1];
+	poly1.t[1] = self.t[idx2];
+	poly1.t[2] = (self.t[idx3]-self.t[idx2])*place+self.t[idx2];
 
-	n1->self->calculateNormal();
-	n1->self->texture = self->texture;
-	n1->self->triangle = self->triangle;
-	n1->self->material = self->material;
+	poly1.calculateNormal();
+	poly1.material = self.material;
+	poly1.triangle = self.triangle;
 
 	for(int i = 0; i<3; i++)
 	{
-		self->coord[idx2][i] = p1[i];
+		self.coord[idx2][i] = p1[i];
 
-		self->drawNormals[idx2][i] = self->norm[i];
+		self.drawNormals[idx2][i] = self.norm[i];
 	}
-	self->s[idx2] = (self->s[idx3]-self->s[idx2])*place+self->s[idx2];
-	self->t[idx2] = (self->t[idx3]-self->t[idx2])*place+self->t[idx2];
+	self.s[idx2] = (self.s[idx3]-self.s[idx2])*place+self.s[idx2];
+	self.t[idx2] = (self.t[idx3]-self.t[idx2])*place+self.t[idx2];
 
-	self->calculateD();
+	self.calculateD();
 }
 
-void BspTree::Node::addChild(Node *n)
+void BspTree::_addChild(int node, int n)
 {
-	double d1 = dot_product(self->norm,n->self->coord[0]);
-	double d2 = dot_product(self->norm,n->self->coord[1]);
-	double d3 = dot_product(self->norm,n->self->coord[2]);
-
-	int i1 = 0;
-	int i2 = 0;
-	int i3 = 0;
-
-	if(!float_equiv(d1,self->d))
-		i1 = (d1<self->d)? -1 : 1;
-	if(!float_equiv(d2,self->d))
-		i2 = (d2<self->d)? -1 : 1;
-	if(!float_equiv(d3,self->d))
-		i3 = (d3<self->d)? -1 : 1;
-
-	//printf("self d = %f\n",self->d);
-	//printf("addChild d = %f %f %f\n",d1,d2,d3);
-	//printf("addChild i = %d %d %d\n",i1,i2,i3);
-
-	// This will catch co-plane also... which should be fine
-	if(i1<=0&&i2<=0&&i3<=0)
+	//NOTE: This used to recurse. The pieces of a split polygon
+	//go down different sides, so the order they're added in
+	//doesn't matter.
+	std::vector<std::pair<int,int>> pending;
+
+	//Adds x as a child, or else to the child's subtree, or if
+	//"again" it's readded to this node's.
+	auto put = [&](int Node::*child, int x, bool again)
 	{
-		//printf("add right\n");
-		if(left)
-		{
-			left->addChild(n);
-		}
-		else
+		int &c = m_nodes[node].*child;
+		if(c==-1) c = x;
+		else pending.push_back(std::make_pair(again?node:c,x));
+	};
+
+	for(;;)
+	{
+		int i1 = 0;
+		int i2 = 0;
+		int i3 = 0;
 		{
-			left = n;
+			Poly &self = m_nodes[node].self, &poly = m_nodes[n].self;
+
+			double d1 = bsptree_dot(self.norm,poly.coord[0]);
+			double d2 = bsptree_dot(self.norm,poly.coord[1]);
+			double d3 = bsptree_dot(self.norm,poly.coord[2]);
+
+			if(!float_equiv(d1,self.d))
+				i1 = (d1<self.d)? -1 : 1;
+			if(!float_equiv(d2,self.d))
+				i2 = (d2<self.d)? -1 : 1;
+			if(!float_equiv(d3,self.d))
+				i3 = (d3<self.d)? -1 : 1;
 		}
-		return;
-	}
 
-	if(i1>=0&&i2>=0&&i3>=0)
-	{
-		//printf("add left\n");
-		if(right)
+		// This will catch co-plane also... which should be fine
+		if(i1<=0&&i2<=0&&i3<=0)
 		{
-			right->addChild(n);
+			put(&Node::left,n,false);
 		}
-		else
+		else if(i1>=0&&i2>=0&&i3>=0)
 		{
-			right = n;
+			put(&Node::right,n,false);
 		}
-		return;
-	}
+		else if(i1==0||i2==0||i3==0)
+		{
+			// one of the vertices is on the plane
 
-	//printf("split\n");
+			float p1[3]; float place1 = 0.0f;
 
-	double p1[3];
-	double p2[3];
-	float place1 = 0.0f;
-	float place2 = 0.0f;
+			int n1 = _node(m_nodes[n].self); //May reallocate.
 
-	if(i1==0||i2==0||i3==0)
-	{
-		// one of the vertices is on the plane
-		//printf("split on vertex\n");
+			Poly &self = m_nodes[node].self;
+			auto &coord = m_nodes[n].self.coord;
 
-		Node *n1 = Node::get();
-		if(i1==0)
-		{
-			self->intersection(n->self->coord[1],n->self->coord[2],p1,place1);
+			if(i1==0)
+			{
+				self.intersection(coord[1],coord[2],p1,place1);
 
-			n->splitNode(0,1,2,p1,n1,place1);
+				_splitNode(n,0,1,2,p1,n1,place1);
 
-			if(i2<0)
-			{
-				if(right)
-					addChild(n);
-				else
-					right = n;
-
-				if(left)
-					left->addChild(n1);
-				else
-					left = n1;
+				if(i2<0) std::swap(n,n1);
 			}
-			else
+			else if(i2==0)
 			{
-				if(right)
-					addChild(n1);
-				else
-					right = n1;
-
-				if(left)
-					left->addChild(n);
-				else
-					left = n;
-			}
-		}
-		else if(i2==0)
-		{
-			self->intersection(n->self->coord[2],n->self->coord[0],p1,place1);
+				self.intersection(coord[2],coord[0],p1,place1);
 
-			n->splitNode(1,2,0,p1,n1,place1);
+				_splitNode(n,1,2,0,p1,n1,place1);
 
-			if(i1<0)
-			{
-				if(right)
-					addChild(n1);
-				else
-					right = n1;
-
-				if(left)
-					left->addChild(n);
-				else
-					left = n;
+				if(i1>=0) std::swap(n,n1);
 			}
-			else
+			else //i3==0
 			{
-				if(right)
-					addChild(n);
-				else
-					right = n;
-
-				if(left)
-					left->addChild(n1);
-				else
-					left = n1;
-			}
-		}
-		else if(i3==0)
-		{
-			self->intersection(n->self->coord[0],n->self->coord[1],p1,place1);
+				self.intersection(coord[0],coord[1],p1,place1);
 
-			n->splitNode(2,0,1,p1,n1,place1);
+				_splitNode(n,2,0,1,p1,n1,place1);
 
-			if(i1<0)
-			{
-				if(right)
-					addChild(n);
-				else
-					right = n;
-
-				if(left)
-					left->addChild(n1);
-				else
-					left = n1;
-			}
-			else
-			{
-				if(right)
-					addChild(n1);
-				else
-					right = n1;
-
-				if(left)
-					left->addChild(n);
-				else
-					left = n;
+				if(i1<0) std::swap(n,n1);
 			}
+			put(&Node::right,n1,true); put(&Node::left,n,false);
 		}
-	}
-	else
-	{
-		Node *n1 = Node::get();
-		Node *n2 = Node::get();
-		if(i1==i2)
+		else
 		{
-			//printf("split 1/2\n");
-			self->intersection(n->self->coord[2],n->self->coord[0],p1,place1);
-			self->intersection(n->self->coord[2],n->self->coord[1],p2,place2);
-			//printf("split at %f %f %f\n",p1[0],p1[1],p1[2]);
-			//printf("split at %f %f %f\n",p2[0],p2[1],p2[2] );
-
-			n->splitNodes(2,0,1,p1,p2,n1,n2,place1,place2);
+			float p1[3],p2[3]; float place1 = 0.0f, place2 = 0.0f;
 
-			if(i3<0)
-			{
-				n1->left = n2;
+			int n1 = _node(m_nodes[n].self); //May reallocate.
+			int n2 = _node(m_nodes[n].self);
 
-				if(right)
-					right->addChild(n1);
-				else
-					right = n1;
+			Poly &self = m_nodes[node].self;
+			auto &coord = m_nodes[n].self.coord;
 
-				if(left)
-					left->addChild(n);
-				else
-					left = n;
-			}
-			else
+			int side;
+			if(i1==i2)
 			{
-				n1->right = n2;
+				self.intersection(coord[2],coord[0],p1,place1);
+				self.intersection(coord[2],coord[1],p2,place2);
 
-				if(left)
-					left->addChild(n1);
-				else
-					left = n1;
+				_splitNodes(n,2,0,1,p1,p2,n1,n2,place1,place2);
 
-				if(right)
-					right->addChild(n);
-				else
-					right = n;
+				side = i3;
 			}
-		}
-		else if(i1==i3)
-		{
-			//printf("split 1/3\n");
-			self->intersection(n->self->coord[1],n->self->coord[2],p1,place1);
-			self->intersection(n->self->coord[1],n->self->coord[0],p2,place2);
-			//printf("split at %f %f %f\n",p1[0],p1[1],p1[2] );
-			//printf("split at %f %f %f\n",p2[0],p2[1],p2[2] );
-
-			n->splitNodes(1,2,0,p1,p2,n1,n2,place1,place2);
-
-			if(i2<0)
+			else if(i1==i3)
 			{
-				n1->left = n2;
+				self.intersection(coord[1],coord[2],p1,place1);
+				self.intersection(coord[1],coord[0],p2,place2);
 
-				if(right)
-					right->addChild(n1);
-				else
-					right = n1;
+				_splitNodes(n,1,2,0,p1,p2,n1,n2,place1,place2);
 
-				if(left)
-					left->addChild(n);
-				else
-					left = n;
+				side = i2;
 			}
-			else
+			else //i2==i3
 			{
-				n1->right = n2;
+				self.intersection(coord[0],coord[1],p1,place1);
+				self.intersection(coord[0],coord[2],p2,place2);
 
-				if(left)
-					left->addChild(n1);
-				else
-					left = n1;
+				_splitNodes(n,0,1,2,p1,p2,n1,n2,place1,place2);
 
-				if(right)
-					right->addChild(n);
-				else
-					right = n;
+				side = i1;
 			}
-		}
-		else if(i2==i3)
-		{
-			self->intersection(n->self->coord[0],n->self->coord[1],p1,place1);
-			self->intersection(n->self->coord[0],n->self->coord[2],p2,place2);
-
-			n->splitNodes(0,1,2,p1,p2,n1,n2,place1,place2);
-
-			if(i1<0)
+			if(side<0)
 			{
-				n1->left = n2;
+				m_nodes[n1].left = n2;
 
-				if(right)
-					right->addChild(n1);
-				else
-					right = n1;
-
-				if(left)
-					left->addChild(n);
-				else
-					left = n;
+				put(&Node::right,n1,false); put(&Node::left,n,false);
 			}
 			else
 			{
-				n1->right = n2;
-
-				if(left)
-					left->addChild(n1);
-				else
-					left = n1;
+				m_nodes[n1].right = n2;
 
-				if(right)
-					right->addChild(n);
-				else
-					right = n;
+				put(&Node::left,n1,false); put(&Node::right,n,false);
 			}
 		}
-	}
-}
 
-void BspTree::Node::render(double *point,DrawingContext *context)
-{
-	double d = dot_product(self->norm,point);
+		if(pending.empty()) break;
 
-	if(d<self->d)
-	{
-		if(right)
-		{
-			right->render(point,context);
-		}
-		self->render(context);
-		if(left)
-		{
-			left->render(point,context);
-		}
-	}
-	else
-	{
-		if(left)
-		{
-			left->render(point,context);
-		}
-		self->render(context);
-		if(right)
-		{
-			right->render(point,context);
-		}
+		node = pending.back().first;
+		n = pending.back().second; pending.pop_back();
 	}
 }
 
-void BspTree::Poly::stats()
+void DepthSort::addTriangle(int triangle, int material, const double *p0, const double *p1, const double *p2)
 {
-	log_debug("BspTree::Poly: %d/%d\n",s_recycle.size(),s_allocated);
-}
+	Entry e; e.triangle = triangle; e.material = material;
 
-void BspTree::Node::stats()
-{
-	log_debug("BspTree::Node: %d/%d\n",s_recycle.size(),s_allocated);
-}
+	for(int i=0;i<3;i++) e.centroid[i] = (float)((p0[i]+p1[i]+p2[i])/3);
 
-int BspTree::Poly::flush()
-{
-	int c = 0;
-	std::vector<Poly*>::iterator it = s_recycle.begin();
-	while(it!=s_recycle.end())
-	{
-		delete *it;
-		it++;
-		c++;
-	}
-	s_recycle.clear();
-	return c;
+	m_entries.push_back(e);
 }
 
-int BspTree::Node::flush()
+const std::vector<DepthSort::Entry> &DepthSort::sort(const double *point)
 {
-	int c = 0;
-	std::vector<Node*>::iterator it = s_recycle.begin();
-	while(it!=s_recycle.end())
+	size_t n = m_entries.size();
+	
+	//The keys are the squared distances from point. Positive floats
+	//compare as integers, so they're inverted to put far ones first.
+	//The descents count how far the last order is from being sorted.
+	m_keys.resize(n);
+	float p[3] = { (float)point[0],(float)point[1],(float)point[2] };
+	size_t descents = 0;
+	for(size_t i=0;i<n;i++)
 	{
-		delete *it;
-		it++;
-		c++;
-	}
-	s_recycle.clear();
-	return c;
-}
+		float *c = m_entries[i].centroid, d = 0;
+		for(int j=0;j<3;j++) d+=(c[j]-p[j])*(c[j]-p[j]);
 
-#if 0
+		uint32_t k; memcpy(&k,&d,sizeof(k)); m_keys[i] = ~k;
 
-int main(int argc,char *argv[])
-{
-	char input[128];
-
-	BspTree tree;
+		if(i&&m_keys[i]<m_keys[i-1]) descents++;
+	}
+	if(!descents) return m_entries;
 
-	while(fgets(input,sizeof(input),stdin))
+	if(descents<=n/32+8) //Insertion sort?
 	{
-		float coord[0][3];
-		float coord[1][3];
-		float coord[2][3];
-
-		if(input[0]=='c')
+		for(size_t i=1;i<n;i++) if(m_keys[i]<m_keys[i-1])
 		{
-			printf("camera\n");
-			if(sscanf(&input[1],"%f %f %f",
-						&coord[0][0],&coord[0][1],&coord[0][2])==3)
+			uint32_t k = m_keys[i]; Entry e = m_entries[i];
+			size_t j = i;
+			for(;j&&k<m_keys[j-1];j--)
 			{
-				printf("got camera point\n");
-				tree.render(coord[0]);
+				m_keys[j] = m_keys[j-1]; m_entries[j] = m_entries[j-1];
 			}
+			m_keys[j] = k; m_entries[j] = e;
 		}
-		else if(sscanf(input,"%f %f %f	%f %f %f	%f %f %f",
-					&coord[0][0],&coord[0][1],&coord[0][2],
-					&coord[1][0],&coord[1][1],&coord[1][2],
-					&coord[2][0],&coord[2][1],&coord[2][2])==9)
-		{
-			Poly *p = Poly::get();
-			printf("read poly: %d\n",p->id);
-			for(int i = 0; i<3; i++)
-			{
-				p->coord[0][i] = coord[0][i];
-				p->coord[1][i] = coord[1][i];
-				p->coord[2][i] = coord[2][i];
-			}
-			p->calculateNormal();
+		return m_entries;
+	}
 
-			tree.addPoly(p);
+	//LSD radix sort on 11 bits at a time. It's stable, so it favors
+	//the last order too.
+	m_swapKeys.resize(n); m_swap.resize(n);
+	for(int shift=0;shift<32;shift+=11)
+	{
+		unsigned count[2048] = {};
+		for(size_t i=0;i<n;i++) count[m_keys[i]>>shift&2047]++;
+
+		if(count[m_keys[0]>>shift&2047]==n) continue; //One bucket?
+
+		unsigned sum = 0;
+		for(auto&ea:count){ unsigned c = ea; ea = sum; sum+=c; }
+		for(size_t i=0;i<n;i++)
+		{
+			unsigned j = count[m_keys[i]>>shift&2047]++;
+			m_swapKeys[j] = m_keys[i]; m_swap[j] = m_entries[i];
 		}
+		m_keys.swap(m_swapKeys); m_entries.swap(m_swap);
 	}
-	return 0;
+	return m_entries;
 }
-
-#endif // 0
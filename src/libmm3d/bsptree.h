@@ -25,102 +25,98 @@
 
 #include "drawcontext.h"
 
+class Model;
+
+//NEW: The tree is kept in one array per tree (its nodes refer to each
+//other by index) so that it's built and drawn without chasing pointers
+//and clear only has to reset the array. Each node holds one polygon.
 class BspTree
 {
 public:
 
-	class Poly
+	struct Poly
 	{
-	public:
-
-		static Poly *get();
-		void release();
-
-		static int flush();
-		static void stats();
-
-		int	id;
+		float coord[3][3];
+		float drawNormals[3][3];
 
-		double coord[3][3];
-		double drawNormals[3][3];
-
-		int	texture;
-		void *material; // Yeah,yeah,I know... it's hackish
-		void *triangle; // Yeah,yeah,I know... it's hackish
-
-		float s[3];	 // texture coordinates
+		float s[3]; // texture coordinates
 		float t[3];
 
-		double norm[3];
-		double d;		 // dot product
+		float norm[3];
+		float d; // dot product
+
+		int material; // Model::getMaterialList index
+		int triangle; // Model::getTriangleList index
 
 		void calculateNormal();
 		void calculateD();
-		void intersection(double *p1, double *p2, double *po, float &place);
-
-		void render(DrawingContext *context);
-
-		void print();
-
-	protected:
-
-		Poly(): id(++s_nextId){ s_allocated++; }; 
-		~Poly(){ s_allocated--; };
-
-		static int s_nextId;
-		static std::vector<Poly*> s_recycle;
-
-		static int s_allocated;
-
+		void intersection(const float *p1, const float *p2, float *po, float &place);
 	};
 
-	class Node
-	{
-	public:
-
-		static Node *get();
-		void release();
+	BspTree(): m_root(-1){};
 
-		static int flush();
-		static void stats();
+	void addPoly(const Poly &p);
+	void render(double *point, DrawingContext *context, Model *model);
 
-		void addChild(Node *n);
-		void render(double *point, DrawingContext *context);
+	void clear(){ m_root = -1; m_nodes.clear(); }
 
-		void splitNodes(int idx1, int idx2, int idx3,
-				double *p1, double *p2,Node *n1, Node *n2,
-				float place1, float place2);
+	size_t size(){ return m_nodes.size(); } //Including split polygons.
 
-		void splitNode(int idx1, int idx2, int idx3,
-				double *p1, Node *n1, float place);
-
-		Poly *self;
+protected:
 
-		Node *left;
-		Node *right;
+	struct Node
+	{
+		Poly self; int left,right; //-1 if none.
+	};
 
-	protected:
+	int m_root;
+	std::vector<Node> m_nodes;
+	std::vector<int> m_stack; //render
+
+	int _node(const Poly&);
+	void _addChild(int node, int n);
+	void _splitNodes(int n, int idx1, int idx2, int idx3,
+			float *p1, float *p2, int n1, int n2,
+			float place1, float place2);
+	void _splitNode(int n, int idx1, int idx2, int idx3,
+			float *p1, int n1, float place);
+	void _render(Poly&, Model*, DrawingContext*, int &material);
+};
 
-		Node(): self(nullptr),left(nullptr),right(nullptr){ s_allocated++; }
-		~Node(){ s_allocated--; }
+//NEW: DepthSort is the alternative to BspTree (Model::DO_ALPHA_SORT)
+//that just sorts the alpha triangles back to front. It doesn't split
+//intersecting triangles, but building it is a linear copy, so it can
+//be rebuilt every animation frame. sort keeps the order it returns
+//for the next call, so that it's usually sorted or nearly sorted.
+class DepthSort
+{
+public:
 
-		static std::vector<Node*> s_recycle;
+	struct Entry
+	{
+		float centroid[3]; int triangle,material;
+	};
 
-		static int s_allocated;
+	DepthSort(): m_built(){}
 
-	};
+	void clear(){ m_built = false; m_entries.clear(); }
 
-	BspTree(): m_root(nullptr){};
-	~BspTree(){ clear(); };
+	void addTriangle(int triangle, int material, const double *p0, const double *p1, const double *p2);
 
-	void addPoly(Poly *p);
-	void render(double *point,DrawingContext *context);
+	// The entries farthest from point come first.
+	const std::vector<Entry> &sort(const double *point);
 
-	void clear();
+	// clear empties it, but an empty DepthSort is still built.
+	void build(){ m_built = true; }
+	bool isBuilt(){ return m_built; }
+	bool empty(){ return m_entries.empty(); }
 
 protected:
 
-	Node *m_root;
+	bool m_built;
+
+	std::vector<Entry> m_entries,m_swap;
+	std::vector<uint32_t> m_keys,m_swapKeys;
 };
 
 #endif // __BSPTREE_H
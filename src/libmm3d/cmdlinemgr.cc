@@ -119,6 +119,7 @@ bool CommandLineManager::parse(int argc, const char ** argv)
 		Option *opt = nullptr;
 		const char *arg = nullptr;
 		int nextOpt = a;
+		bool attached = false; //NEW
 
 		// It is an option
 		if(str[1]=='-')
@@ -128,7 +129,7 @@ bool CommandLineManager::parse(int argc, const char ** argv)
 			const char *end = strchr(str,'=');
 			if(end)
 			{
-				arg = end+1;
+				arg = end+1; attached = true;
 				longOpt.resize(end-&str[2]);
 			}
 			else
@@ -144,7 +145,7 @@ bool CommandLineManager::parse(int argc, const char ** argv)
 			const char *end = strchr(str,'=');
 			if(end)
 			{
-				arg = end+1;
+				arg = end+1; attached = true;
 			}
 			else
 			{
@@ -171,7 +172,7 @@ bool CommandLineManager::parse(int argc, const char ** argv)
 				return false;
 			}
 		}
-		else
+		else if(!attached) //NEW: --option=value is optional.
 		{
 			arg = "";
 		}
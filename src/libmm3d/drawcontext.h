@@ -27,24 +27,140 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 typedef void *ContextT;
 
-typedef std::map<std::string,int> FileTextureMap;
 typedef std::vector<int> MaterialTextureList;
 
+class Texture;
+
 	//NOTE: How this works is it duplicates video 
 	//memory and OpenGL lists. It's best to avoid.
 	//In the original MM3D every viewport used it
 	//so they all had their own hardware textures.
 	//It would include glGenBuffers also if added.
 
+	//NEW: Contexts that share lists belong to a
+	//DrawingShareGroup so that textures are only
+	//uploaded once. The contexts just bind them.
+
+class DrawingShareGroup
+{
+	public:
+
+		// The group of contexts that were made to share lists with
+		// "share". The null group is used by the nullptr ContextT.
+		static DrawingShareGroup *get(ContextT share=nullptr);
+
+		// Returns a texture object holding tex. The pixels are only
+		// uploaded if it's new to the group or has been reloaded.
+		// The caller must make a context in the group current.
+		int acquire(Texture *tex);
+		void release(int texture);
+
+		// Releases "texture" and acquires tex in its place. Does
+		// nothing if tex is already in "texture".
+		int replace(int texture, Texture *tex);
+
+	protected:
+
+		struct Object{ int texture,refs; unsigned revision; };
+
+		std::unordered_map<const Texture*,Object> m_objects;
+		std::unordered_map<int,const Texture*> m_textures;
+
+		int m_anisotropy = -1;
+};
+
+	//NEW: Model::draw keeps its faces in buffer objects if
+	//they're available (OpenGL 1.5) and only updates them by
+	//the Model::ChangeBits it sees. Contexts that share lists
+	//could share these, but a model usually has one context.
+
+struct DrawingBuffers
+{
+	unsigned vbo,ibo; //GLuint
+	
+	int changes; //Model::ChangeBits since last draw.
+	int options; //Model::DO_SMOOTHING etc. when built.
+
+	// Shadows vbo. Each triangle corner (in m_triangles order)
+	// has 8 floats: position, normal, and texture coordinates.
+	std::vector<float> vertices;
+
+	// Ranges of ibo, one per material, sorted so its state is
+	// set once per pass. Selected faces follow unselected ones
+	// so they're drawn in a second pass with the other light.
+	struct Batch
+	{
+		int material; //-1 if none, -2 if ungrouped.
+
+		bool alpha; //BspTree draws alpha materials.
+
+		unsigned first,count,selected; //Faces.
+
+		std::vector<unsigned> faces; //Visible, in group order.
+	};
+	std::vector<Batch> batches; size_t triangles;
+	std::vector<unsigned> indices; //Shadows ibo.
+
+	// Bounding boxes of runs of ibo or lines so that DO_FRUSTUM
+	// can skip the runs that are out of view. A run is at most
+	// 1024 faces, edges, or vertices and doesn't cross a batch
+	// or pass. They're remade when the positions or indices are
+	// changed and there's a DO_FRUSTUM draw.
+	struct Chunk{ unsigned first,count; float box[6]; };
+	std::vector<Chunk> chunks,lineChunks;
+	bool chunked,lineChunked;
+
+	// drawLines and drawVertices draw each edge and vertex once
+	// from these, not once per face. They're kept apart since a
+	// view may draw them without calling draw.
+	unsigned points,lines; //GLuint
+	int lineChanges; //Model::ChangeBits since last drawn.
+	std::vector<float> positions; //Shadows points (m_vertices).
+	std::vector<unsigned> edges; //Vertex pairs.
+	std::vector<unsigned> edgeFaces,edgeFacesEnd; //Adjacent faces.
+	unsigned lineCount[2],pointCount[2]; //Unselected, selected.
+	std::vector<unsigned> lineIndices; //Shadows lines.
+	size_t edgeTriangles;
+};
+
+	//NEW: Model::draw(DO_PROXY) draws this stand-in when the
+	//model has more triangles than ViewportUnits::proxy3d. It
+	//is clustered on a worker thread and is only remade when
+	//the topology or the vertex selection changes, since it
+	//refers to m_vertices and keeps selected vertices apart.
+
+struct DrawingProxy
+{
+	// Each face is 4 indices, the triangle it stands in for
+	// (for its material, selection, and texture coordinates)
+	// followed by the vertices that it's collapsed onto. The
+	// faces are sorted by material.
+	std::vector<unsigned> faces;
+
+	struct Batch{ int material; unsigned first,count; };
+	std::vector<Batch> batches; //-1 if none, -2 if ungrouped.
+
+	size_t triangles,vertices; //Counts when built.
+
+	unsigned serial; //Model::m_drawProxySerial when built.
+
+	// Scratch space for the positions, normals, and texture
+	// coordinates drawn from. It's remade every frame.
+	std::vector<float> arrays; std::vector<unsigned> counts;
+};
+
 class DrawingContext //Qt throwback (UNUSED)
 {
 	public:
 		ContextT	 m_context;
-		FileTextureMap m_fileTextures;
-		MaterialTextureList m_matTextures;
+		ContextT	 m_share; //DrawingShareGroup
+		MaterialTextureList m_matTextures; //References
+		MaterialTextureList m_pendingTextures; //loadPendingTextures
+		DrawingBuffers *m_buffers; //Model::draw
 		bool		  m_valid;
 
 		int			m_currentTexture;
@@ -24,6 +24,10 @@
 
 #include "filtermgr.h"
 #include "modelfilter.h"
+#include "mapdatasource.h"
+#include "filedatadest.h"
+#include "misc.h"
+#include "mm3dconfig.h"
 #include "log.h"
 
 FilterManager *FilterManager::s_instance = nullptr;
@@ -117,7 +121,28 @@ Model::ModelErrorE FilterManager::readFile(Model *model, const char *filename)
 			{
 				model->setUndoEnabled(false);
 
-				rval = ea->readFile(model,filename);
+				//NEW: Snapshot cache? MM3D is the snapshot format.
+				ModelFilter *mm3d = nullptr; std::string key;
+				if(!m_cacheDir.empty()&&!ea->canRead("mm3d"))
+				for(auto*ea2:m_filters) if(ea2->canRead("mm3d")&&ea2->canWrite("mm3d"))
+				{
+					mm3d = ea2; key = normalizePath(filename); break;
+				}
+
+				if(mm3d&&_readCache(mm3d,model,key))
+				{
+					rval = Model::ERROR_NONE;
+				}
+				else
+				{
+					rval = ea->readFile(model,filename);
+
+					//NOTE: This must precede closeAll since the
+					//sources opened by the filter are recorded as
+					//dependencies of the snapshot.
+					if(mm3d&&rval==Model::ERROR_NONE)
+					_writeCache(mm3d,model,key);
+				}
 
 				model->setUndoEnabled(true);
 				model->clearUndo();
@@ -159,7 +184,7 @@ Model::ModelErrorE FilterManager::writeFile(Model *model, const char *filename,
 		{
 			ModelFilter::PromptF *f = ea->getOptionsPrompt();
 			ModelFilter::Options *o = ea->getDefaultOptions();		
-			if(wo==WO_ModelNoPrompt) o->setOptionsFromModel(model);
+			if(wo==WO_ModelNoPrompt||!f) o->setOptionsFromModel(model);
 			
 			bool doWrite = true;
 			if(f!=nullptr&&wo!=WO_ModelNoPrompt)
@@ -221,4 +246,217 @@ Model::ModelErrorE FilterManager::writeFile(Model *model, const char *filename,
 	{
 		return Model::ERROR_UNSUPPORTED_OPERATION;
 	}
-}
\ No newline at end of file
+}
+
+void FilterManager::setCacheDirectory(const char *dir, size_t maxBytes)
+{
+	m_cacheDir = dir?dir:""; m_cacheMax = maxBytes;
+
+	if(!m_cacheDir.empty()&&!is_directory(dir))
+	if(mkpath(dir),!is_directory(dir))
+	{
+		log_warning("model cache disabled: cannot create %s\n",dir);
+
+		m_cacheDir.clear();
+	}
+}
+
+// The cache directory holds pairs of files named by a hash of the model's
+// path. The .mm3d file is the snapshot. The .dep file is written after the
+// snapshot and lists the files the original filter read (including ones
+// it looked for that didn't exist) along with their sizes and modified
+// times. The .dep file's modified time is the entry's last use.
+static const char filtermgr_dep_magic[] = "MM3D snapshot 1\n";
+
+static std::string filtermgr_cache_name(const std::string &dir, const std::string &path)
+{
+	uint64_t h = 14695981039346656037ULL; //FNV-1a
+	for(char c:path){ h^=(uint8_t)c; h*=1099511628211ULL; }
+	
+	char buf[32]; snprintf(buf,sizeof(buf),"%c%016llx",DIR_SLASH,(unsigned long long)h);
+	return dir+buf;
+}
+static std::string filtermgr_stamp(const char *path)
+{
+	size_t size; time_t mtime;
+	if(!file_size(path,&size)||!file_modifiedtime(path,&mtime))
+	return "-";
+	char buf[64]; snprintf(buf,sizeof(buf),"%llu %lld",(unsigned long long)size,(long long)mtime);
+	return buf;
+}
+static bool filtermgr_write_text(const std::string &path, const std::string &text)
+{
+	FileDataDest dst(path.c_str());
+	bool ok = dst.writeBytes(text.data(),text.size())&&!dst.errorOccurred();
+	dst.close(); return ok;
+}
+
+// Reads a snapshot into model if one exists and all of its dependencies
+// are unchanged. Returns false to have the caller parse the file instead.
+bool FilterManager::_readCache(ModelFilter *mm3d, Model *model, const std::string &key)
+{
+	std::string base = filtermgr_cache_name(m_cacheDir,key);
+	std::string dep = base+".dep", snap = base+".mm3d";
+
+	std::string text;
+	{
+		MapDataSource src(dep.c_str());
+		if(src.errorOccurred()) return false; //Miss.
+
+		text.resize(src.getFileSize());
+		if(!src.readBytes(&text[0],text.size())) return false;
+	}
+
+	//Header, snapshot size, then "stamp\tpath" lines, the model first.
+	const char *p = text.c_str();
+	size_t magic = sizeof(filtermgr_dep_magic)-1;
+	if(text.compare(0,magic,filtermgr_dep_magic)) return false;
+	p+=magic;
+	char *e; unsigned long long bytes = strtoull(p,&e,10);
+	if(*e!='\n') return false;
+	size_t snapSize;
+	if(!file_size(snap.c_str(),&snapSize)||snapSize!=bytes) return false;
+
+	bool first = true;
+	for(p=e+1;*p;first=false)
+	{
+		const char *tab = strchr(p,'\t'), *nl = tab?strchr(tab,'\n'):nullptr;
+		if(!nl) return false;
+
+		std::string path(tab+1,nl);
+		if(first&&path!=key) return false; //Hash collision?
+		if(filtermgr_stamp(path.c_str()).compare(0,std::string::npos,p,tab-p))
+		return false; //Stale.
+
+		p = nl+1;
+	}
+	if(first) return false;
+
+	struct MapFactory : FileFactory
+	{
+		virtual DataSource *createSource(const char *filename)
+		{
+			return new MapDataSource(filename);
+		}
+	}map;
+	mm3d->setFactory(&map);
+	Model::ModelErrorE err = mm3d->readFile(model,snap.c_str());
+	mm3d->setFactory(&m_factory);
+	map.closeAll();
+
+	//MM3D sets this to the snapshot's name.
+	model->setFilename(key.c_str());
+
+	if(err!=Model::ERROR_NONE)
+	{
+		//FIX ME: The model may be partially loaded at this point. Since
+		//the dependencies checked out it's probably damaged. Remove it so
+		//the next attempt falls back to the original file.
+		log_error("model cache: failed to read %s\n",snap.c_str());
+		file_remove(dep.c_str()); file_remove(snap.c_str());
+		
+		return false;
+	}
+
+	//Touch the .dep file so trimming evicts the least recently used.
+	filtermgr_write_text(dep,text);
+
+	log_debug("model cache: read %s from %s\n",key.c_str(),snap.c_str());
+
+	return true;
+}
+
+void FilterManager::_writeCache(ModelFilter *mm3d, Model *model, const std::string &key)
+{
+	std::string base = filtermgr_cache_name(m_cacheDir,key);
+	std::string dep = base+".dep", snap = base+".mm3d";
+
+	//The sources must be captured before writing the snapshot.
+	std::string lines;
+	lines+=filtermgr_stamp(key.c_str());
+	lines+='\t'; lines+=key; lines+='\n';
+	for(auto&ea:m_factory.getSourceMap())
+	{
+		std::string path = normalizePath(ea.first.c_str());
+		if(path==key) continue;
+
+		lines+=filtermgr_stamp(path.c_str());
+		lines+='\t'; lines+=path; lines+='\n';
+	}
+
+	//If an old entry is being replaced its .dep must go first.
+	file_remove(dep.c_str());
+
+	//NOTE: This is what writeFile does, except the model is freshly loaded.
+	auto swap = model->makeRestorePoint();
+	if(swap.mode) model->setNoAnimation();
+
+	ModelFilter::Options *o = mm3d->getDefaultOptions();
+	Model::ModelErrorE err = mm3d->writeFile(model,snap.c_str(),*o);
+	o->release();
+
+	if(swap.mode) model->setCurrentAnimation(swap);
+
+	size_t snapSize;
+	if(err!=Model::ERROR_NONE||!file_size(snap.c_str(),&snapSize))
+	{
+		log_warning("model cache: failed to write %s\n",snap.c_str());
+		file_remove(snap.c_str()); return;
+	}
+
+	char buf[32]; snprintf(buf,sizeof(buf),"%llu\n",(unsigned long long)snapSize);
+	if(!filtermgr_write_text(dep,filtermgr_dep_magic+(buf+lines)))
+	{
+		file_remove(dep.c_str()); file_remove(snap.c_str()); return;
+	}
+
+	_trimCache();
+}
+
+void FilterManager::_trimCache()
+{
+	struct entry
+	{
+		time_t time; size_t bytes;
+	};
+	std::map<std::string,entry> entries; size_t total = 0;
+
+	std::list<std::string> files;
+	getFileList(files,m_cacheDir.c_str(),"");
+	for(auto&ea:files)
+	{
+		size_t dot = ea.rfind('.');
+		if(dot==ea.npos) continue;
+		bool isDep = !ea.compare(dot,ea.npos,".dep");
+		if(!isDep&&ea.compare(dot,ea.npos,".mm3d")) continue;
+
+		std::string path = m_cacheDir+DIR_SLASH+ea;
+		auto &e = entries.emplace(path.substr(0,path.size()-ea.size()+dot),entry{0,0}).first->second;
+
+		size_t size = 0;
+		if(file_size(path.c_str(),&size))
+		{
+			e.bytes+=size; total+=size;
+		}
+		if(isDep) file_modifiedtime(path.c_str(),&e.time);
+	}
+	if(total<=m_cacheMax) return;
+
+	//Oldest first. Orphaned snapshots (no .dep) have a time of 0.
+	std::vector<std::pair<time_t,const std::string*>> order;
+	for(auto&ea:entries) order.push_back({ea.second.time,&ea.first});
+	std::sort(order.begin(),order.end());
+
+	for(auto&ea:order)
+	{
+		if(total<=m_cacheMax) break;
+
+		const std::string &base = *ea.second;
+		file_remove((base+".dep").c_str());
+		file_remove((base+".mm3d").c_str());
+
+		log_debug("model cache: evicted %s\n",base.c_str());
+
+		total-=entries[base].bytes;
+	}
+}
@@ -70,8 +70,18 @@ public:
 	const char *getAllReadTypes();
 	const char *getAllWriteTypes(bool exportModel = false);
 
+	// The snapshot cache is opt-in. When enabled, readFile saves models
+	// loaded by any filter other than MM3D's into dir as MM3D files, and
+	// loads them from there (memory mapped) for as long as the files the
+	// filter read are unchanged in size and modified time. The least
+	// recently used snapshots are deleted to keep dir under maxBytes.
+	// An empty or null dir disables the cache.
+	void setCacheDirectory(const char *dir, size_t maxBytes);
+	const char *getCacheDirectory(){ return m_cacheDir.c_str(); }
+
 protected:
 	
+	FilterManager():m_cacheMax(){}
 	~FilterManager();
 
 	static FilterManager *s_instance;
@@ -81,6 +91,12 @@ protected:
 	std::vector<ModelFilter*> m_filters;
 
 	std::string _read,_write,_export; //NEW
+
+	std::string m_cacheDir; size_t m_cacheMax; //NEW
+
+	bool _readCache(ModelFilter*,Model*,const std::string&);
+	void _writeCache(ModelFilter*,Model*,const std::string&);
+	void _trimCache();
 };
 
 #endif // __FILTERMGR_H
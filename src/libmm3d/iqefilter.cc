@@ -23,6 +23,7 @@
 #include "mm3dtypes.h" //PCH
 
 #include "modelfilter.h"
+#include "textdest.h"
 
 //#include "iqefilter.h"
 class IqeFilter : public ModelFilter
@@ -40,7 +41,7 @@ protected:
 
 	IqeOptions *m_options;
 
-	bool writeLine(DataDest *dst, const char *line,...);
+	bool writeLine(TextDest *dst, const char *line,...);
 };
 
 #include "texture.h"
@@ -102,12 +103,14 @@ Model::ModelErrorE IqeFilter::writeFile(Model *model, const char *const filename
 	}
 
 	Model::ModelErrorE err = Model::ERROR_NONE;
-	DataDest *dst = openOutput(filename,err);
-	DestCloser fc(dst);
+	DataDest *out = openOutput(filename,err);
+	DestCloser fc(out);
 
 	if(err!=Model::ERROR_NONE)
 		return err;
 
+	TextDest text(out), *dst = &text;
+
 	// Use the load matrix and then invert it
 	Matrix saveMatrix;
 	saveMatrix.setRotationInDegrees(-90,-90,0);
@@ -323,7 +326,7 @@ Model::ModelErrorE IqeFilter::writeFile(Model *model, const char *const filename
 
 							dst->writePrintf(" %d %.8f",it->m_boneId,(float)weight);
 						}
-						dst->writePrintf("\r\n");
+						dst->writeBytes("\r\n",2);
 					}
 				}
 
@@ -485,13 +488,13 @@ Model::ModelErrorE IqeFilter::writeFile(Model *model, const char *const filename
 	
 }
 
-bool IqeFilter::writeLine(DataDest *dst, const char *line,...)
+bool IqeFilter::writeLine(TextDest *dst, const char *line,...)
 {
 	va_list ap;
 	va_start(ap,line);
 	dst->writeVPrintf(line,ap);
 	va_end(ap);
-	dst->writePrintf("\r\n");
+	dst->writeBytes("\r\n",2);
 	return true;
 }
 
@@ -0,0 +1,188 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2008 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+#include "mm3dtypes.h" //PCH
+
+#include "mapdatasource.h"
+#include "misc.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef WIN32
+MapDataSource::MapDataSource(const char *filename)
+	: m_handle(nullptr),m_mapping(nullptr),m_buf(nullptr),m_bufSize(0)
+{
+	if(filename==nullptr||filename[0]=='\0')
+	{
+		setErrno(EINVAL);
+		return;
+	}
+
+	std::wstring wideString = utf8PathToWide(filename);
+	if(wideString.empty())
+	{
+		setErrno(EINVAL);
+		return;
+	}
+
+	m_handle = CreateFileW(&wideString[0],GENERIC_READ,FILE_SHARE_READ,nullptr,
+								 OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+	if(m_handle==INVALID_HANDLE_VALUE||m_handle==nullptr)
+	{
+		m_handle = nullptr;
+
+		if(GetLastError()==ERROR_ACCESS_DENIED)
+		{
+			setErrno(EACCES);
+		}
+		else
+		{
+			setErrno(ENOENT);
+		}
+		return;
+	}
+
+	LARGE_INTEGER length;
+	if(!GetFileSizeEx(m_handle,&length))
+	{
+		setErrno(EPERM);
+		return;
+	}
+	m_bufSize = (size_t)length.QuadPart;
+
+	//NOTE: CreateFileMapping fails on empty files.
+	if(m_bufSize)
+	{
+		m_mapping = CreateFileMappingW(m_handle,nullptr,PAGE_READONLY,0,0,nullptr);
+		if(m_mapping)
+		m_buf = (const uint8_t*)MapViewOfFile(m_mapping,FILE_MAP_READ,0,0,0);
+		if(!m_buf)
+		{
+			setErrno(ENOMEM);
+			return;
+		}
+	}
+
+	setFileSize(m_bufSize);
+}
+
+void MapDataSource::internalClose()
+{
+	if(m_buf)
+	{
+		UnmapViewOfFile(m_buf);
+		m_buf = nullptr;
+	}
+	if(m_mapping)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = nullptr;
+	}
+	if(m_handle)
+	{
+		CloseHandle(m_handle);
+		m_handle = nullptr;
+	}
+}
+#else
+MapDataSource::MapDataSource(const char *filename)
+	: m_buf(nullptr),m_bufSize(0)
+{
+	if(filename==nullptr||filename[0]=='\0')
+	{
+		setErrno(EINVAL);
+		return;
+	}
+
+	int fd = open(filename,O_RDONLY);
+	if(fd==-1)
+	{
+		setErrno(errno);
+		return;
+	}
+
+	struct stat statbuf;
+	if(fstat(fd,&statbuf)!=0)
+	{
+		setErrno(errno);
+		::close(fd);
+		return;
+	}
+	m_bufSize = (size_t)statbuf.st_size;
+
+	//NOTE: mmap fails on empty files.
+	if(m_bufSize)
+	{
+		void *p = mmap(nullptr,m_bufSize,PROT_READ,MAP_PRIVATE,fd,0);
+		if(p==MAP_FAILED)
+		{
+			setErrno(errno);
+			::close(fd);
+			return;
+		}
+		m_buf = (const uint8_t*)p;
+
+		//The snapshot is read front to back in one pass.
+		madvise(p,m_bufSize,MADV_SEQUENTIAL);
+	}
+
+	//The mapping holds its own reference to the file.
+	::close(fd);
+
+	setFileSize(m_bufSize);
+}
+
+void MapDataSource::internalClose()
+{
+	if(m_buf)
+	{
+		munmap((void*)m_buf,m_bufSize);
+		m_buf = nullptr;
+	}
+}
+#endif // WIN32
+
+MapDataSource::~MapDataSource()
+{
+	close();
+}
+
+bool MapDataSource::internalReadAt(off_t offset, const uint8_t ** buf, size_t *bufLen)
+{
+	// If we had an error,just keep returning an error
+	if(errorOccurred())
+		return false;
+
+	if((size_t)offset>m_bufSize)
+	{
+		setUnexpectedEof(true);
+		return false;
+	}
+
+	*buf = m_buf+offset;
+	*bufLen = m_bufSize-offset;
+	return true;
+}
@@ -0,0 +1,64 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2008 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+
+#ifndef MAPDATASOURCE_INC_H__
+#define MAPDATASOURCE_INC_H__
+
+#include "datasource.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif // WIN32
+
+// This class is a DataSource that memory maps a file and serves reads 
+// straight out of the mapping. See the documentation in datasource.h for
+// the DataSource API. It's used by FilterManager to load model snapshots
+// from its cache (see FilterManager::setCacheDirectory) without copying
+// the file through a read buffer.
+
+class MapDataSource : public DataSource
+{
+	public:
+		MapDataSource(const char *filename);
+		virtual ~MapDataSource();
+
+		void internalClose();
+
+	protected:
+		virtual bool internalReadAt(off_t offset, const uint8_t ** buf, size_t *bufLen);
+
+	private:
+
+#ifdef WIN32
+		HANDLE m_handle, m_mapping;
+#endif // WIN32
+		const uint8_t *m_buf;
+		size_t m_bufSize;
+};
+
+#endif // MAPDATASOURCE_INC_H__
@@ -328,13 +328,15 @@ static void md2filter_invertModelNormals(Model *model)
 	}
 }
 
-static unsigned bestNormal(float *norm)
+static unsigned md2filter_bestNormal(const float *norm, const uint8_t *list, unsigned count)
 {
 	float bestDistance = 10000; //3 should do it?
 	unsigned bestIndex = 0;
 
-	for(unsigned t = 0; t<MAX_QUAKE_NORMALS; t++)
+	for(unsigned i=0;i<count;i++)
 	{
+		unsigned t = list?list[i]:i;
+
 		float x = norm[0]-s_quakeNormals[t][0];
 		float y = norm[1]-s_quakeNormals[t][1];
 		float z = norm[2]-s_quakeNormals[t][2];
@@ -352,6 +354,118 @@ static unsigned bestNormal(float *norm)
 	return bestIndex;
 }
 
+// bestNormal is called for every vertex of every frame. Rather than test
+// all 162 normals every time, directions are binned into the cells of a
+// cube map, and each cell lists (in ascending order) just the normals that
+// can be nearest to some direction in that cell. Each cell's list holds
+// the normals within d+2r of its center, where d is the angle from the
+// center to its nearest normal and r is the cell's radius, plus a margin
+// for float error. The result is the same as testing every normal.
+enum{ md2filter_cube_res=8 };
+struct md2filter_NormalCube
+{
+	uint16_t cells[6*md2filter_cube_res*md2filter_cube_res+1];
+
+	std::vector<uint8_t> list;
+
+	md2filter_NormalCube();
+
+	static int cell(const float n[3])
+	{
+		float ax = fabsf(n[0]), ay = fabsf(n[1]), az = fabsf(n[2]);
+		int face; float m,u,v;
+		if(ax>=ay&&ax>=az)
+		{
+			face = n[0]<0; m = ax; u = n[1]; v = n[2];
+		}
+		else if(ay>=az)
+		{
+			face = 2+(n[1]<0); m = ay; u = n[0]; v = n[2];
+		}
+		else
+		{
+			face = 4+(n[2]<0); m = az; u = n[0]; v = n[1];
+		}
+		const int res = md2filter_cube_res;
+		int iu = (int)((u/m+1)*0.5f*res);
+		int iv = (int)((v/m+1)*0.5f*res);
+		iu = std::max(0,std::min(res-1,iu));
+		iv = std::max(0,std::min(res-1,iv));
+		return (face*res+iu)*res+iv;
+	}
+	static void direction(int face, double u, double v, double out[3])
+	{
+		double m = face&1?-1:1;
+		switch(face>>1)
+		{
+		case 0: out[0] = m; out[1] = u; out[2] = v; break;
+		case 1: out[0] = u; out[1] = m; out[2] = v; break;
+		case 2: out[0] = u; out[1] = v; out[2] = m; break;
+		}
+		normalize3(out);
+	}
+};
+md2filter_NormalCube::md2filter_NormalCube()
+{
+	const int res = md2filter_cube_res;
+
+	double q[MAX_QUAKE_NORMALS][3];
+	for(unsigned t=0;t<MAX_QUAKE_NORMALS;t++)
+	{
+		for(int i=3;i-->0;) q[t][i] = s_quakeNormals[t][i];
+		normalize3(q[t]);
+	}
+	auto angle = [](const double a[3], const double b[3])
+	{
+		return acos(std::max(-1.0,std::min(1.0,dot3(a,b))));
+	};
+
+	int c = 0;
+	for(int face=0;face<6;face++)	
+	for(int iu=0;iu<res;iu++)
+	for(int iv=0;iv<res;iv++,c++)
+	{
+		cells[c] = (uint16_t)list.size();
+
+		double center[3], corner[3], r = 0;
+		direction(face,(iu+0.5)*2/res-1,(iv+0.5)*2/res-1,center);
+		for(int i=0;i<4;i++)
+		{
+			direction(face,(iu+(i&1))*2.0/res-1,(iv+(i>>1))*2.0/res-1,corner);
+			r = std::max(r,angle(center,corner));
+		}
+
+		double d = 10;
+		for(unsigned t=0;t<MAX_QUAKE_NORMALS;t++)
+		{
+			d = std::min(d,angle(center,q[t]));
+		}
+		for(unsigned t=0;t<MAX_QUAKE_NORMALS;t++)
+		{
+			if(angle(center,q[t])<=d+2*r+0.001)
+			list.push_back((uint8_t)t);
+		}
+	}
+	cells[c] = (uint16_t)list.size();
+}
+
+static unsigned bestNormal(float *norm)
+{
+	// Anything not unit length (including NaN) tests every normal.
+	float len = dot3(norm,norm);
+	if(!(fabsf(len-1)<0.001f))
+	{
+		return md2filter_bestNormal(norm,nullptr,MAX_QUAKE_NORMALS);
+	}
+
+	static const md2filter_NormalCube cube; //C++11 makes this thread-safe.
+
+	int c = cube.cell(norm);
+	unsigned first = cube.cells[c];
+
+	return md2filter_bestNormal(norm,&cube.list[first],cube.cells[c+1]-first);
+}
+
 struct md2filter_TexCoordT{ float s,t; };
 
 Md2Filter::Md2Filter()
@@ -932,10 +1046,11 @@ Model::ModelErrorE Md2Filter::writeFile(Model *model, const char *const filename
 	//	animCount = 1;
 	}
 
-	if(!modelMaterials.empty()&&modelMaterials[0]->m_textureData)
+	//NOTE: getTextureData waits on loadTextures's worker thread.
+	if(Texture *tex=modelMaterials.empty()?nullptr:model->getTextureData(0))
 	{
-		skinWidth  = modelMaterials[0]->m_textureData->m_width;
-		skinHeight = modelMaterials[0]->m_textureData->m_height;
+		skinWidth  = tex->m_width;
+		skinHeight = tex->m_height;
 	}
 
 	// Write header
@@ -1038,6 +1153,11 @@ Model::ModelErrorE Md2Filter::writeFile(Model *model, const char *const filename
 	std::vector<float> vecNormals(3*numVertices);
 	float *avgNormals = vecNormals.data();
 
+	// Each frame is transformed in these arrays and then written at once.
+	std::vector<double> vecCoords(3*numVertices);
+	double *coords = vecCoords.data();
+	std::vector<uint8_t> frameData(4*numVertices);
+
 	unsigned anim = noAnim?animCount:0;
 	if(noAnim) goto noAnim; //2021
 	for(;anim<animCount;anim++)
@@ -1095,7 +1215,7 @@ Model::ModelErrorE Md2Filter::writeFile(Model *model, const char *const filename
 			
 			for(int32_t v=0;v<numVertices;v++)
 			{
-				double coord[3]; //double x,y,z;
+				double *coord = coords+v*3; //double x,y,z;
 				//model->getFrameAnimVertexCoords(anim,i,v,x,y,z);
 				model->getVertexCoords(v,coord);
 
@@ -1131,36 +1251,38 @@ Model::ModelErrorE Md2Filter::writeFile(Model *model, const char *const filename
 			namestr[15] = '\0';
 			dst->writeBytes(namestr,sizeof(namestr));
 
-			//double vertNormal[3] = {0,0,0};
 			for(int32_t v=0;v<numVertices;v++)
 			{
-				double vec[3] = {0,0,0};
-				//model->getFrameAnimVertexCoords(anim,i,v,vec[0],vec[1],vec[2]);
-				model->getVertexCoords(v,vec);
-				saveMatrix.apply3(vec);
-				uint8_t xi = (uint8_t)((vec[0]-translate[0])/scale[0]+0.5);
-				uint8_t yi = (uint8_t)((vec[1]-translate[1])/scale[1]+0.5);
-				uint8_t zi = (uint8_t)((vec[2]-translate[2])/scale[2]+0.5);
-				uint8_t normal = 0;
+				saveMatrix.apply3(coords+v*3);
 
 				//https://github.com/zturtleman/mm3d/issues/109
 				//model->getFrameAnimVertexNormal(anim,i,v,vertNormal[0],vertNormal[1],vertNormal[2]);
 				float *vertNormal = avgNormals+v*3; normalize3(vertNormal);
 
 				saveMatrix.apply3(vertNormal);
+			}
 
+			// These loops have no calls so they can be vectorized.
+			for(int32_t v=0;v<numVertices;v++)
+			{
+				double *vec = coords+v*3;
+				uint8_t *p = frameData.data()+v*4;
+				p[0] = (uint8_t)((vec[0]-translate[0])/scale[0]+0.5);
+				p[1] = (uint8_t)((vec[1]-translate[1])/scale[1]+0.5);
+				p[2] = (uint8_t)((vec[2]-translate[2])/scale[2]+0.5);
+			}
+			for(int32_t v=0;v<numVertices*3;v++)
+			{
 				// Have to invert normal
-				vertNormal[0] = -vertNormal[0];
-				vertNormal[1] = -vertNormal[1];
-				vertNormal[2] = -vertNormal[2];
-
-				normal = bestNormal(vertNormal);
+				avgNormals[v] = -avgNormals[v];
+			}
 
-				dst->write(xi);
-				dst->write(yi);
-				dst->write(zi);
-				dst->write(normal);
+			for(int32_t v=0;v<numVertices;v++)
+			{
+				frameData[v*4+3] = (uint8_t)bestNormal(avgNormals+v*3);
 			}
+
+			dst->writeBytes(frameData.data(),frameData.size());
 		}
 	}
 
@@ -165,10 +165,30 @@ protected:
 	Md3PathList		m_pathList;
 
 	//writes
-	int_list _writeSF_anims2021;
+	struct SectionT
+	{
+		MeshSectionE section;
+		bool noAnim;
+		int_list anims; //2021: All the anims are written as one anim.
+		std::vector<std::pair<int,unsigned>> frames; // anim/frame pairs
+		int32_t numFrames;
+		int rootTag;
+		DataDest *dst;
+		uint32_t endPos;
+		std::vector<std::string> shaders; // Per mesh
+
+		// Per mesh vertices of each frame. Meshes not in the section are
+		// left empty.
+		struct VertexT{ double coord[3]; float norm[3]; };
+		std::vector<std::vector<VertexT>> vertices;
+	};
 	Model::ModelErrorE writeSectionFile(const char *filename,MeshSectionE section,MeshList &meshes);
+	// _open does everything that mutates the model, including posing it,
+	// and writes the header. _data only reads the model, so that sections
+	// can be written side by side.
+	Model::ModelErrorE writeSectionFile_open(SectionT&,const char *filename,MeshSectionE section,MeshList &meshes);
+	void writeSectionFile_data(SectionT&,MeshList &meshes);
 	bool	  writeAnimations();
-	DataDest *m_dst;
 
 	//writes util
 	bool	  animSyncWarning(std::string name);
@@ -1937,14 +1957,26 @@ Model::ModelErrorE Md3Filter::writeFile(Model *model, const char *const filename
 
 		std::string playerFile;
 		std::string path = modelPath+"/";
-		playerFile = path+fixFileCase(m_modelPath.c_str(),"lower.md3");
-		writeSectionFile(playerFile.c_str(),MS_Lower,meshes);
-
-		playerFile = path+fixFileCase(m_modelPath.c_str(),"upper.md3");
-		writeSectionFile(playerFile.c_str(),MS_Upper,meshes);
+		const char *files[3] = {"lower.md3","upper.md3","head.md3"};
+		MeshSectionE sections[3] = {MS_Lower,MS_Upper,MS_Head};
+		SectionT s[3];
+		for(int i=0;i<3;i++)
+		{
+			playerFile = path+fixFileCase(m_modelPath.c_str(),files[i]);
+			writeSectionFile_open(s[i],playerFile.c_str(),sections[i],meshes);
+		}
 
-		playerFile = path+fixFileCase(m_modelPath.c_str(),"head.md3");
-		writeSectionFile(playerFile.c_str(),MS_Head, meshes);
+		// The sections are posed. The files can be written at once.
+		std::vector<std::thread> threads;
+		for(int i=0;i<3;i++) if(s[i].dst)
+		{
+			threads.emplace_back(&Md3Filter::writeSectionFile_data,this,std::ref(s[i]),std::ref(meshes));
+		}
+		for(auto&ea:threads) ea.join();
+		for(int i=0;i<3;i++) if(s[i].dst)
+		{
+			s[i].dst->close();
+		}
 
 		writeAnimations();
 
@@ -1960,11 +1992,59 @@ Model::ModelErrorE Md3Filter::writeFile(Model *model, const char *const filename
 }
 
 Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::MeshSectionE section,MeshList &meshes)
+{
+	SectionT s;
+	Model::ModelErrorE err = writeSectionFile_open(s,filename,section,meshes);
+	if(s.dst)
+	{
+		DestCloser fc(s.dst);
+		writeSectionFile_data(s,meshes);
+	}
+	return err;
+}
+
+// Calls f(i) for every i<n, spread over the available cores.
+template<class F> static void md3filter_parallel_for(size_t n, F f)
+{
+	size_t threads = std::min<size_t>(n,std::max(1u,std::thread::hardware_concurrency()));
+
+	std::atomic<size_t> next(0);
+	auto work = [&]()
+	{
+		for(size_t i;(i=next++)<n;) f(i);
+	};
+	std::vector<std::thread> pool;
+	for(size_t i=1;i<threads;i++) pool.emplace_back(work);
+	work();
+	for(auto&ea:pool) ea.join();
+}
+
+// These store MD3 (little endian) values into a buffer that is written
+// all at once. They return the end of the value.
+static uint8_t *md3filter_put(uint8_t *p, uint16_t i)
+{
+	p[0] = (uint8_t)i; p[1] = (uint8_t)(i>>8); return p+2;
+}
+static uint8_t *md3filter_put(uint8_t *p, int16_t i)
+{
+	return md3filter_put(p,(uint16_t)i);
+}
+static uint8_t *md3filter_put(uint8_t *p, float f)
+{
+	uint32_t i; memcpy(&i,&f,4);
+	p[0] = (uint8_t)i; p[1] = (uint8_t)(i>>8);
+	p[2] = (uint8_t)(i>>16); p[3] = (uint8_t)(i>>24); return p+4;
+}
+
+Model::ModelErrorE Md3Filter::writeSectionFile_open(SectionT &s, const char *filename, MeshSectionE section, MeshList &meshes)
 {
 	std::string modelPath = "";
 	std::string modelBaseName = "";
 	std::string modelFullName = "";
 
+	s.section = section;
+	s.dst = nullptr;
+
 	log_debug("writing section file %s\n",filename);
 	switch (section)
 	{
@@ -2020,7 +2100,7 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 	//We are making all the anims be one anim.
 	//unsigned animCount = m_model->getAnimationCount(Model::ANIMMODE_FRAME);
 	unsigned animCount = m_model->getAnimationCount();
-	_writeSF_anims2021.clear();
+	int_list &anims = s.anims;
 	for(unsigned i=0;i<animCount;i++)
 	if(m_model->getAnimType(i)&Model::ANIMMODE_FRAME) //2021
 	{
@@ -2030,10 +2110,12 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 			noAnim = false;
 			numFrames+=m_model->getAnimFrameCount(i);
 
-			_writeSF_anims2021.push_back(i);
+			anims.push_back(i);
 		}
 	}
-	if(noAnim) _writeSF_anims2021.push_back(0);
+	if(noAnim) anims.push_back(0);
+
+	s.noAnim = noAnim;
 
 	if(numFrames>MD3_MAX_FRAMES)
 	{
@@ -2047,6 +2129,23 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 		numFrames = 1;
 	}
 
+	s.numFrames = numFrames;
+
+	// The FRAMES, TAGS and VERTEX blocks all walk the same frames.
+	for(auto anim:anims)
+	{
+		unsigned aFrameCount = m_model->getAnimFrameCount(anim);
+
+		if(noAnim||!aFrameCount&&anims.size()<=1)
+		{
+			aFrameCount = 1;
+		}
+		for(unsigned t = 0; t<aFrameCount; t++)
+		{
+			s.frames.push_back({anim,t});
+		}
+	}
+
 	unsigned pcount = m_model->getPointCount();
 	int32_t numTags = (int32_t)pcount;
 	// If spliting model,count tags.
@@ -2119,34 +2218,143 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 		return Model::ERROR_FILTER_SPECIFIC;
 	}
 
+	// Names are checked before the file is opened since the rest of the
+	// section can be written on another thread.
+	for(unsigned j = 0; j<pcount; j++)
+	{
+		if(tagInSection(m_model->getPointName(j),section))
+		{
+			if(strlen(m_model->getPointName(j))>=MAX_QPATH)
+			{
+				log_error("Point name is too large\n");
+				m_model->setFilterSpecificError(TRANSLATE("LowLevel","Point name is too large for MD3 export."));
+				return Model::ERROR_FILTER_SPECIFIC;
+			}
+		}
+	}
+
+	//std::vector<Model::Material*> &modelMaterials = getMaterialList(m_model);
+	auto &modelMaterials = *(Model::_MaterialList*)&m_model->getMaterialList();
+
+	s.shaders.resize(meshes.size());
+	for(mlit = meshes.begin(); mlit!=meshes.end(); mlit++)
+	{
+		if((*mlit).group>=0&&groupInSection(m_model->getGroupName((*mlit).group),section))
+		{
+			char mName[MAX_QPATH];
+			memset(mName,0,MAX_QPATH);
+			if(snprintf(mName,sizeof(mName),"%s",m_model->getGroupName((*mlit).group))>MAX_QPATH)
+			{
+				log_error("group name is too large\n");
+				m_model->setFilterSpecificError(TRANSLATE("LowLevel","Group name is too large for MD3 export."));
+				return Model::ERROR_FILTER_SPECIFIC;
+			}
+
+			// SHADERS
+			int matId = m_model->getGroupTextureId((*mlit).group);
+			std::string matFileName;
+			std::string matFullName;
+			std::string matPath;
+			std::string matBaseName;
+			if(matId!=-1)
+			{
+				Model::Material *mat = modelMaterials[matId];
+				matFileName = mat->m_filename;
+			}
+			else
+			{
+				//Texture isn't set
+				matFileName = mName;
+				matFileName += ".tga";
+			}
+
+			char sName[MAX_QPATH];
+			std::string spk3Path;
+			memset(sName,0,MAX_QPATH);
+
+			if(matId>=0)
+			{
+				spk3Path = materialToPath(matId);
+				if(!spk3Path.empty()
+					  &&spk3Path[spk3Path.size()-1]!='/' 
+					  &&spk3Path.size()<(MAX_QPATH+1))
+				{
+					spk3Path += "/";
+				}
+			}
+
+			normalizePath(matFileName.c_str(),matFullName,matPath,matBaseName);
+
+			log_debug("comparing %s and %s\n",matFullName.c_str(),m_modelPath.c_str());
+			if(strncmp(matFullName.c_str(),m_modelPath.c_str(),m_modelPath.size())==0)
+			{
+				log_debug("path is common,using MD3_PATH\n");
+				// model path is the same as texture file path,remove model
+				// path and prepend MD3_PATH
+				if(snprintf(sName,sizeof(sName),"%s%s",
+							spk3Path.c_str(),matBaseName.c_str())>=MAX_QPATH)
+				{
+					log_error("MD3_PATH+texture_filename is to long.\n");
+					m_model->setFilterSpecificError(TRANSLATE("LowLevel","Texture filename is too long."));
+					return Model::ERROR_FILTER_SPECIFIC;
+				}
+			}
+			else if(pathIsAbsolute(matFileName.c_str()))
+			{
+				log_debug("path is not common,but is absolute\n");
+				// model path is not the same as texture file path,try to
+				// remove pk3 path from model and try again
+				std::string common;
+				common = m_modelPath;
+
+				// default to PK3 Path
+				snprintf(sName,sizeof(sName),"%s%s",
+						spk3Path.c_str(),matBaseName.c_str());
+			}
+			else
+			{
+				log_debug("path is relative,using as-is\n");
+				// relative path... sounds like a fallback,just use 
+				// matFileName as is
+				snprintf(sName,sizeof(sName),"%s",matFileName.c_str());
+			}
+			log_debug("writing texture path: %s\n",sName);
+
+			s.shaders[mlit-meshes.begin()] = sName;
+		}
+	}
+
 	// Open file for writing
 	Model::ModelErrorE err = Model::ERROR_NONE;
-	m_dst = openOutput(filename,err);
-	DestCloser fc(m_dst);
+	DataDest *dst = openOutput(filename,err);
 
 	if(err!=Model::ERROR_NONE)
-		return err;
+	{
+		dst->close(); return err;
+	}
+
+	s.dst = dst;
 
 	// write file header
-	m_dst->write(magic[0]);
-	m_dst->write(magic[1]);
-	m_dst->write(magic[2]);
-	m_dst->write(magic[3]);
-	m_dst->write(version);
-	m_dst->writeBytes(pk3Name,MAX_QPATH);
-	m_dst->write(flags);
-	m_dst->write(numFrames);
-	m_dst->write(numTags);
-	m_dst->write(numMeshes);
-	m_dst->write(numSkins);
-	m_dst->write(offsetFrames);
-	m_dst->write(offsetTags);
-	m_dst->write(offsetMeshes);
-
-	uint32_t endPos = m_dst->offset();
-	m_dst->write(offsetEnd);
-
-	int rootTag = -1;
+	dst->write(magic[0]);
+	dst->write(magic[1]);
+	dst->write(magic[2]);
+	dst->write(magic[3]);
+	dst->write(version);
+	dst->writeBytes(pk3Name,MAX_QPATH);
+	dst->write(flags);
+	dst->write(numFrames);
+	dst->write(numTags);
+	dst->write(numMeshes);
+	dst->write(numSkins);
+	dst->write(offsetFrames);
+	dst->write(offsetTags);
+	dst->write(offsetMeshes);
+
+	s.endPos = dst->offset();
+	dst->write(offsetEnd);
+
+	s.rootTag = -1;
 	// Change save matrix if needed
 	log_debug("finding root tag for section %s\n",modelBaseName.c_str());
 	for(unsigned p = 0; p<pcount; p++)
@@ -2154,196 +2362,221 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 		if(tagIsSectionRoot(m_model->getPointName(p),section))
 		{
 			log_debug("  root tag is %s\n",m_model->getPointName(p));
-			rootTag = p;
+			s.rootTag = p;
 		}
 	}
 
-	// FRAMES
-	log_debug("writing frames at %d/%d\n",offsetFrames,m_dst->offset());
-	
-	for(auto anim:_writeSF_anims2021)
-	{
-		unsigned aFrameCount = m_model->getAnimFrameCount(anim);
+	// Posing the model isn't thread-safe, so the vertices of each frame
+	// are copied here. The rest only reads the model.
+	m_model->setNoAnimation();
 
-		if(noAnim||!aFrameCount&&_writeSF_anims2021.size()<=1)
+	s.vertices.resize(meshes.size());
+	int anim = -1;
+	if(numMeshes) for(auto&f:s.frames)
+	{
+		if(!noAnim) //2020: Generate normals.
 		{
-			aFrameCount = 1;
+			if(anim!=f.first)
+			m_model->setCurrentAnimation(anim=f.first,Model::ANIMMODE_FRAME);
+			m_model->setCurrentAnimationFrame(f.second);
 		}
 
-		std::string animName = getSafeName(anim);
-		for(unsigned t = 0; t<aFrameCount; t++)
+		for(mlit = meshes.begin(); mlit!=meshes.end(); mlit++)
 		{
-			Matrix saveMatrix;
-			if(noAnim)
+			if((*mlit).group>=0&&groupInSection(m_model->getGroupName((*mlit).group),section))
 			{
-				saveMatrix = getMatrixFromPoint(-1,-1,rootTag).getInverse();
-			}
-			else
-			{
-				saveMatrix = getMatrixFromPoint(anim,t,rootTag).getInverse();
-			}
-			int_list::iterator vit;
-			double dmax[4] = { DBL_MIN,DBL_MIN,DBL_MIN,1 };
-			double dmin[4] = { DBL_MAX,DBL_MAX,DBL_MAX,1 };
-			for(mlit = meshes.begin(); mlit!=meshes.end(); mlit++)
-			{
-				int i = (*mlit).group;
-				if(i>=0&&groupInSection(m_model->getGroupName(i),section))
+				if(!noAnim) //2020: Generate normals.
 				{
-					for(int tri:m_model->getGroupTriangles(i))
-					{
-						for(int n = 0; n<3; n++)
-						{
-							int vertex = m_model->getTriangleVertex(tri,n);
-							double cords[3];
-							/*if(noAnim)
-							{
-								m_model->getVertexCoords(vertex,cords);
-							}
-							else m_model->getFrameAnimVertexCoords(anim,t,vertex,cords[0],cords[1],cords[2]);
-							*/
-							m_model->getVertexCoords(vertex,cords);
-							dmax[0] = greater(dmax[0],cords[0]);
-							dmax[1] = greater(dmax[1],cords[1]);
-							dmax[2] = greater(dmax[2],cords[2]);
-							dmin[0] = smaller(dmin[0],cords[0]);
-							dmin[1] = smaller(dmin[1],cords[1]);
-							dmin[2] = smaller(dmin[2],cords[2]);
-						}
-					}
+					resetVertexNormals(m_model,*mlit);
 				}
-			}
-			saveMatrix.apply(dmin);
-			saveMatrix.apply(dmax);
 
-			//min_bounds
-			for(int v = 0; v<3; v++)
-			{
-				m_dst->write((float)dmin[v]);
-			}
-			//max_bounds
-			for(int v = 0; v<3; v++)
-			{
-				m_dst->write((float)dmax[v]);
-			}
-			//local_origin
-			float temp = 0;
-			for(int v = 0; v<3; v++)
-			{
-				m_dst->write(temp);
+				auto &vertices = s.vertices[mlit-meshes.begin()];
+				if(vertices.empty())
+				vertices.reserve(s.frames.size()*(*mlit).vertices.size());
+
+				for(auto&ea:(*mlit).vertices)
+				{
+					SectionT::VertexT v;
+					m_model->getVertexCoords(ea.v,v.coord);
+					for(int i=3;i-->0;) v.norm[i] = ea.norm[i];
+					vertices.push_back(v);
+				}
 			}
-			//radius
-			double radiusm = sqrt(dmin[0] *dmin[0]+dmin[1] *dmin[1]+dmin[2] *dmin[2]);
-			double radius = sqrt(dmax[0] *dmax[0]+dmax[1] *dmax[1]+dmax[2] *dmax[2]);
-			if(radiusm>radius)
+		}
+	}
+
+	return Model::ERROR_NONE;
+}
+
+void Md3Filter::writeSectionFile_data(SectionT &s, MeshList &meshes)
+{
+	DataDest *dst = s.dst;
+
+	MeshSectionE section = s.section;
+	bool noAnim = s.noAnim;
+	int32_t numFrames = s.numFrames;
+	int rootTag = s.rootTag;
+	unsigned pcount = m_model->getPointCount();
+	size_t frames = s.frames.size();
+
+	std::vector<Matrix> saveMatrices(frames);
+	md3filter_parallel_for(frames,[&](size_t f)
+	{
+		if(noAnim)
+		{
+			saveMatrices[f] = getMatrixFromPoint(-1,-1,rootTag).getInverse();
+		}
+		else
+		{
+			saveMatrices[f] = getMatrixFromPoint(s.frames[f].first,s.frames[f].second,rootTag).getInverse();
+		}
+	});
+
+	// FRAMES
+	log_debug("writing frames at %d\n",dst->offset());
+
+	std::vector<uint8_t> buf(frames*FRAME_SIZE);
+	md3filter_parallel_for(frames,[&](size_t f)
+	{
+		const Matrix &saveMatrix = saveMatrices[f];
+		double dmax[4] = { DBL_MIN,DBL_MIN,DBL_MIN,1 };
+		double dmin[4] = { DBL_MAX,DBL_MAX,DBL_MAX,1 };
+		for(size_t m=0;m<meshes.size();m++)
+		{
+			auto &vertices = s.vertices[m];
+			if(vertices.empty()) continue;
+
+			size_t vcount = meshes[m].vertices.size();
+			for(size_t v=f*vcount,n=v+vcount;v<n;v++)
 			{
-				radius = radiusm;
+				double *cords = vertices[v].coord;
+				dmax[0] = greater(dmax[0],cords[0]);
+				dmax[1] = greater(dmax[1],cords[1]);
+				dmax[2] = greater(dmax[2],cords[2]);
+				dmin[0] = smaller(dmin[0],cords[0]);
+				dmin[1] = smaller(dmin[1],cords[1]);
+				dmin[2] = smaller(dmin[2],cords[2]);
 			}
-			//log_debug("Frame radius: %f\n",((float)radius));
-			m_dst->write((float)radius);
-			char name[16] = "MaverickModel3D"; // this is what other exporters do
-			snprintf(name,sizeof(name),"%s%02d",animName.c_str(),t);
-			m_dst->writeBytes(name,sizeof(name));
 		}
-	}
+		saveMatrix.apply(dmin);
+		saveMatrix.apply(dmax);
 
-	m_model->setNoAnimation();
+		uint8_t *p = buf.data()+f*FRAME_SIZE;
+
+		//min_bounds
+		for(int v = 0; v<3; v++)
+		{
+			p = md3filter_put(p,(float)dmin[v]);
+		}
+		//max_bounds
+		for(int v = 0; v<3; v++)
+		{
+			p = md3filter_put(p,(float)dmax[v]);
+		}
+		//local_origin
+		float temp = 0;
+		for(int v = 0; v<3; v++)
+		{
+			p = md3filter_put(p,temp);
+		}
+		//radius
+		double radiusm = sqrt(dmin[0] *dmin[0]+dmin[1] *dmin[1]+dmin[2] *dmin[2]);
+		double radius = sqrt(dmax[0] *dmax[0]+dmax[1] *dmax[1]+dmax[2] *dmax[2]);
+		if(radiusm>radius)
+		{
+			radius = radiusm;
+		}
+		//log_debug("Frame radius: %f\n",((float)radius));
+		p = md3filter_put(p,(float)radius);
+		char name[16] = "MaverickModel3D"; // this is what other exporters do
+		snprintf(name,sizeof(name),"%s%02d",getSafeName(s.frames[f].first),s.frames[f].second);
+		memcpy(p,name,sizeof(name));
+	});
+	dst->writeBytes(buf.data(),buf.size());
 
 	//TAGS
-	log_debug("writing tags at %d/%d\n",offsetTags,m_dst->offset());
+	log_debug("writing tags at %d\n",dst->offset());
 
-	for(auto anim:_writeSF_anims2021)
+	int_list tags;
+	for(unsigned j = 0; j<pcount; j++)
 	{
-		unsigned aFrameCount = m_model->getAnimFrameCount(anim);
-
-		if(noAnim||!aFrameCount&&_writeSF_anims2021.size()<=1)
+		if(tagInSection(m_model->getPointName(j),section))
 		{
-			aFrameCount = 1;
+			tags.push_back(j);
 		}
-		for(unsigned t = 0; t<aFrameCount; t++)
+	}
+
+	buf.assign(frames*tags.size()*TAG_SIZE,0);
+	md3filter_parallel_for(frames,[&](size_t f)
+	{
+		int anim = s.frames[f].first;
+		unsigned t = s.frames[f].second;
+
+		const Matrix &saveMatrix = saveMatrices[f];
+
+		uint8_t *p = buf.data()+f*tags.size()*TAG_SIZE;
+
+		for(unsigned j:tags)
 		{
-			Matrix saveMatrix;
+			// Checked by writeSectionFile_open.
+			strncpy((char*)p,m_model->getPointName(j),MAX_QPATH);
+			p+=MAX_QPATH;
+
+			// origin
+			double origin[4] = { 0,0,0,1 };
 			if(noAnim)
 			{
-				saveMatrix = getMatrixFromPoint(-1,-1,rootTag).getInverse();
+				m_model->getPointCoordsUnanimated(j,origin);
 			}
 			else
 			{
-				saveMatrix = getMatrixFromPoint(anim,t,rootTag).getInverse();
+				m_model->interpKeyframe(anim,t,{Model::PT_Point,j},origin,nullptr,nullptr);
 			}
-			for(unsigned j = 0; j<pcount; j++)
-			{
-				if(tagInSection(m_model->getPointName(j),section))
-				{
-					char tName[MAX_QPATH];
-					memset(tName,0,MAX_QPATH);
-					if(snprintf(tName,sizeof(tName),"%s",m_model->getPointName(j))>=MAX_QPATH)
-					{
-						log_error("Point name is too large\n");
-						m_model->setFilterSpecificError(TRANSLATE("LowLevel","Point name is too large for MD3 export."));
-						return Model::ERROR_FILTER_SPECIFIC;
-					}
-					m_dst->writeBytes(tName,MAX_QPATH);
 
-					// origin
-					double origin[4] = { 0,0,0,1 };
-					if(noAnim)
-					{
-						m_model->getPointCoordsUnanimated(j,origin);
-					}
-					else
-					{
-						m_model->interpKeyframe(anim,t,{Model::PT_Point,j},origin,nullptr,nullptr);
-					}
+			saveMatrix.apply(origin);
 
-					saveMatrix.apply(origin);
+			p = md3filter_put(p,(float)origin[0]);
+			p = md3filter_put(p,(float)origin[1]);
+			p = md3filter_put(p,(float)origin[2]);
 
-					m_dst->write((float)origin[0]);
-					m_dst->write((float)origin[1]);
-					m_dst->write((float)origin[2]);
-
-					Matrix rotMatrix;
-					double rotVector[3];
-					if(noAnim)
-					{
-						m_model->getPointRotationUnanimated(j,rotVector);
-					}
-					else
-					{
-						m_model->interpKeyframe(anim,t,{Model::PT_Point,j},nullptr,rotVector,nullptr);
-					}
+			Matrix rotMatrix;
+			double rotVector[3];
+			if(noAnim)
+			{
+				m_model->getPointRotationUnanimated(j,rotVector);
+			}
+			else
+			{
+				m_model->interpKeyframe(anim,t,{Model::PT_Point,j},nullptr,rotVector,nullptr);
+			}
 
-					// Seems whenver we have a nan its from a identity matrix
-					if(rotVector[0]!=rotVector[0]||rotVector[1]!=rotVector[1]||rotVector[2]!=rotVector[2])
-					{
-						rotMatrix.loadIdentity();
-					}
-					else
-					{
-						rotMatrix.setRotation(rotVector);
-					}
-					rotMatrix = rotMatrix*saveMatrix;
+			// Seems whenver we have a nan its from a identity matrix
+			if(rotVector[0]!=rotVector[0]||rotVector[1]!=rotVector[1]||rotVector[2]!=rotVector[2])
+			{
+				rotMatrix.loadIdentity();
+			}
+			else
+			{
+				rotMatrix.setRotation(rotVector);
+			}
+			rotMatrix = rotMatrix*saveMatrix;
 
-					// orientation
-					for(int m = 0; m<3; m++)
-					{
-						for(int n = 0; n<3; n++)
-						{
-							m_dst->write((float)rotMatrix.get(m,n));
-						}
-					}
+			// orientation
+			for(int m = 0; m<3; m++)
+			{
+				for(int n = 0; n<3; n++)
+				{
+					p = md3filter_put(p,(float)rotMatrix.get(m,n));
 				}
 			}
 		}
-	}
-
-	//std::vector<Model::Material*> &modelMaterials = getMaterialList(m_model);
-	auto &modelMaterials = *(Model::_MaterialList*)&m_model->getMaterialList();
+	});
+	dst->writeBytes(buf.data(),buf.size());
 
 	// MESHES
-	log_debug("writing meshes at %d/%d\n",offsetMeshes,m_dst->offset());
+	log_debug("writing meshes at %d\n",dst->offset());
 
-	for(mlit = meshes.begin(); mlit!=meshes.end(); mlit++)
+	for(auto mlit=meshes.begin(); mlit!=meshes.end(); mlit++)
 	{
 		if((*mlit).group>=0&&groupInSection(m_model->getGroupName((*mlit).group),section))
 		{
@@ -2355,12 +2588,7 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 			mMagic[3] = '3';
 			char mName[MAX_QPATH];
 			memset(mName,0,MAX_QPATH);
-			if(snprintf(mName,sizeof(mName),"%s",m_model->getGroupName((*mlit).group))>MAX_QPATH)
-			{
-				log_error("group name is too large\n");
-				m_model->setFilterSpecificError(TRANSLATE("LowLevel","Group name is too large for MD3 export."));
-				return Model::ERROR_FILTER_SPECIFIC;
-			}
+			snprintf(mName,sizeof(mName),"%s",m_model->getGroupName((*mlit).group));
 
 			const int TRI_SIZE = 3 *4;
 			const int SHADER_SIZE = MAX_QPATH+4;
@@ -2379,21 +2607,21 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 			int32_t mOffEnd		= mOffVerts+mNumFrames *mNumVerts *VERT_SIZE;
 
 			// write header
-			m_dst->write(mMagic[0]);
-			m_dst->write(mMagic[1]);
-			m_dst->write(mMagic[2]);
-			m_dst->write(mMagic[3]);
-			m_dst->writeBytes(mName,MAX_QPATH);
-			m_dst->write(mFlags);
-			m_dst->write(mNumFrames);
-			m_dst->write(mNumShaders);
-			m_dst->write(mNumVerts);
-			m_dst->write(mNumTris);
-			m_dst->write(mOffTris);
-			m_dst->write(mOffShaders);
-			m_dst->write(mOffST);
-			m_dst->write(mOffVerts);
-			m_dst->write(mOffEnd);
+			dst->write(mMagic[0]);
+			dst->write(mMagic[1]);
+			dst->write(mMagic[2]);
+			dst->write(mMagic[3]);
+			dst->writeBytes(mName,MAX_QPATH);
+			dst->write(mFlags);
+			dst->write(mNumFrames);
+			dst->write(mNumShaders);
+			dst->write(mNumVerts);
+			dst->write(mNumTris);
+			dst->write(mOffTris);
+			dst->write(mOffShaders);
+			dst->write(mOffST);
+			dst->write(mOffVerts);
+			dst->write(mOffEnd);
 
 			// TRIANGLES
 			Mesh::FaceList::iterator fit;
@@ -2401,84 +2629,18 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 			{
 				for(int j = 2; j>=0; j--)
 				{
-					m_dst->write((*fit).v[j]);
+					dst->write((*fit).v[j]);
 				}
 			}
 
 			// SHADERS
 			for(int32_t t = 0; t<mNumShaders; t++)
 			{
-				int matId = m_model->getGroupTextureId((*mlit).group);
-				std::string matFileName;
-				std::string matFullName;
-				std::string matPath;
-				std::string matBaseName;
-				if(matId!=-1)
-				{
-					Model::Material *mat = modelMaterials[matId];
-					matFileName = mat->m_filename;
-				}
-				else
-				{
-					//Texture isn't set
-					matFileName = mName;
-					matFileName += ".tga";
-				}
-
-				char sName[MAX_QPATH];
-				std::string spk3Path;
-				memset(sName,0,MAX_QPATH);
-
-				if(matId>=0)
-				{
-					spk3Path = materialToPath(matId);
-					if(!spk3Path.empty()
-						  &&spk3Path[spk3Path.size()-1]!='/' 
-						  &&spk3Path.size()<(MAX_QPATH+1))
-					{
-						spk3Path += "/";
-					}
-				}
-
-				normalizePath(matFileName.c_str(),matFullName,matPath,matBaseName);
-
-				log_debug("comparing %s and %s\n",matFullName.c_str(),m_modelPath.c_str());
-				if(strncmp(matFullName.c_str(),m_modelPath.c_str(),m_modelPath.size())==0)
-				{
-					log_debug("path is common,using MD3_PATH\n");
-					// model path is the same as texture file path,remove model
-					// path and prepend MD3_PATH
-					if(snprintf(sName,sizeof(sName),"%s%s",
-								spk3Path.c_str(),matBaseName.c_str())>=MAX_QPATH)
-					{
-						log_error("MD3_PATH+texture_filename is to long.\n");
-						m_model->setFilterSpecificError(TRANSLATE("LowLevel","Texture filename is too long."));
-						return Model::ERROR_FILTER_SPECIFIC;
-					}
-				}
-				else if(pathIsAbsolute(matFileName.c_str()))
-				{
-					log_debug("path is not common,but is absolute\n");
-					// model path is not the same as texture file path,try to
-					// remove pk3 path from model and try again
-					std::string common;
-					common = m_modelPath;
-
-					// default to PK3 Path
-					snprintf(sName,sizeof(sName),"%s%s",
-							spk3Path.c_str(),matBaseName.c_str());
-				}
-				else
-				{
-					log_debug("path is relative,using as-is\n");
-					// relative path... sounds like a fallback,just use 
-					// matFileName as is
-					snprintf(sName,sizeof(sName),"%s",matFileName.c_str());
-				}
-				log_debug("writing texture path: %s\n",sName);
+				char sName[MAX_QPATH] = {};
+				strncpy(sName,s.shaders[mlit-meshes.begin()].c_str(),MAX_QPATH-1);
 
-				m_dst->writeBytes(sName,MAX_QPATH);
-				m_dst->write(t);
+				dst->writeBytes(sName,MAX_QPATH);
+				dst->write(t);
 			}
 
 			// TEXT COORDS
@@ -2486,113 +2648,90 @@ Model::ModelErrorE Md3Filter::writeSectionFile(const char *filename,Md3Filter::M
 
 			for(vit = (*mlit).vertices.begin(); vit!=(*mlit).vertices.end(); vit++)
 			{
-				m_dst->write((*vit).uv[0]);
-				m_dst->write((float)(1.0f-(*vit).uv[1]));
+				dst->write((*vit).uv[0]);
+				dst->write((float)(1.0f-(*vit).uv[1]));
 			}
 
-			// VERTEX			
-			for(auto anim:_writeSF_anims2021)
-			{					
-				unsigned aFrameCount = m_model->getAnimFrameCount(anim);
-				if(noAnim||!aFrameCount&&_writeSF_anims2021.size()<=1)
-				{
-					aFrameCount = 1;
-				}
+			// VERTEX
+			size_t vcount = (*mlit).vertices.size();
+			auto &vertices = s.vertices[mlit-meshes.begin()];
+			buf.resize(frames*vcount*VERT_SIZE);
+			md3filter_parallel_for(frames,[&](size_t f)
+			{
+				const Matrix &saveMatrix = saveMatrices[f];
 
-				if(!noAnim) //2020: Generate normals.
-				m_model->setCurrentAnimation(anim,Model::ANIMMODE_FRAME);
-					
-				for(unsigned t = 0; t<aFrameCount; t++)
-				{	
-					if(!noAnim) //2020: Generate normals.
-					{
-						m_model->setCurrentAnimationFrame(t);
-						resetVertexNormals(m_model,*mlit);
-					}
+				uint8_t *p = buf.data()+f*vcount*VERT_SIZE;
 
-					Matrix saveMatrix;
+				for(size_t v=f*vcount,n=v+vcount;v<n;v++)
+				{
+					double meshVec[4] = {0,0,0,1};
+					double meshNor[4] = {0,0,0,1};
 
+					/*Removing getFrameAnimVertexNormal
+					//NOTE: Mesh would never produce ideal animations of the normals.
+					//https://github.com/zturtleman/mm3d/issues/109
 					if(noAnim)
 					{
-						saveMatrix = getMatrixFromPoint(-1,-1,rootTag).getInverse();
+						// force unanimated coordinates for head
+						m_model->getVertexCoords((*vit).v,meshVec);
+
+						float meshNorF[3];
+						if(getVertexNormal(m_model,(*mlit).group,(*vit).v,meshNorF))
+						{
+							meshNor[0] = meshNorF[0];
+							meshNor[1] = meshNorF[1];
+							meshNor[2] = meshNorF[2];
+						}
 					}
 					else
 					{
-						saveMatrix = getMatrixFromPoint(anim,t,rootTag).getInverse();
+						m_model->getFrameAnimVertexCoords(anim,t,(*vit).v,meshVec[0],meshVec[1],meshVec[2]);
+						m_model->getFrameAnimVertexNormal(anim,t,(*vit).v,meshNor[0],meshNor[1],meshNor[2]);
+					}*/
+					for(int i=3;i-->0;)
+					{
+						meshVec[i] = vertices[v].coord[i];
+						meshNor[i] = vertices[v].norm[i];
 					}
 
-					for(vit = (*mlit).vertices.begin(); vit!=(*mlit).vertices.end(); vit++)
+					saveMatrix.apply(meshVec);
+					saveMatrix.apply3(meshNor); // only apply rotation
+					normalize3(meshNor);
+					p = md3filter_put(p,(int16_t)(meshVec[0]/MD3_XYZ_SCALE+0.5));
+					p = md3filter_put(p,(int16_t)(meshVec[1]/MD3_XYZ_SCALE+0.5));
+					p = md3filter_put(p,(int16_t)(meshVec[2]/MD3_XYZ_SCALE+0.5));
+					int16_t lng;
+					int16_t lat;
+					if(meshNor[0]==0&&meshNor[1]==0)
 					{
-						double meshVec[4] = {0,0,0,1};
-						double meshNor[4] = {0,0,0,1};
-
-						/*Removing getFrameAnimVertexNormal
-						//NOTE: Mesh would never produce ideal animations of the normals.
-						//https://github.com/zturtleman/mm3d/issues/109
-						if(noAnim)
+						if(meshNor[2]>0)
 						{
-							// force unanimated coordinates for head
-							m_model->getVertexCoords((*vit).v,meshVec);
-
-							float meshNorF[3];
-							if(getVertexNormal(m_model,(*mlit).group,(*vit).v,meshNorF))
-							{
-								meshNor[0] = meshNorF[0];
-								meshNor[1] = meshNorF[1];
-								meshNor[2] = meshNorF[2];
-							}
+							lng = 0;
+							lat = 0;
 						}
 						else
 						{
-							m_model->getFrameAnimVertexCoords(anim,t,(*vit).v,meshVec[0],meshVec[1],meshVec[2]);
-							m_model->getFrameAnimVertexNormal(anim,t,(*vit).v,meshNor[0],meshNor[1],meshNor[2]);
-						}*/
-						m_model->getVertexCoords((*vit).v,meshVec);
-
-						meshNor[0] = vit->norm[0];
-						meshNor[1] = vit->norm[1];
-						meshNor[2] = vit->norm[2];							
-
-						saveMatrix.apply(meshVec);
-						saveMatrix.apply3(meshNor); // only apply rotation
-						normalize3(meshNor);
-						m_dst->write((int16_t)(meshVec[0]/MD3_XYZ_SCALE+0.5));
-						m_dst->write((int16_t)(meshVec[1]/MD3_XYZ_SCALE+0.5));
-						m_dst->write((int16_t)(meshVec[2]/MD3_XYZ_SCALE+0.5));
-						int16_t lng;
-						int16_t lat;
-						if(meshNor[0]==0&&meshNor[1]==0)
-						{
-							if(meshNor[2]>0)
-							{
-								lng = 0;
-								lat = 0;
-							}
-							else
-							{
-								lat = 128;
-								lng = 0;
-							}
+							lat = 128;
+							lng = 0;
 						}
-						else
-						{
-							lng = (int16_t)(acos(meshNor[2])*255/(2 *PI));
-							lat = (int16_t)(atan2(meshNor[1],meshNor[0])*255/(2 *PI));
-						}
-						// log_debug("%f,%f,%f lat %d lng %d\n",meshNor[0],meshNor[1],meshNor[2],lat,lng);
-						uint16_t normal = ((lat &255)*256)| (lng &255);
-						m_dst->write(normal);
 					}
-				}			
-			}
+					else
+					{
+						lng = (int16_t)(acos(meshNor[2])*255/(2 *PI));
+						lat = (int16_t)(atan2(meshNor[1],meshNor[0])*255/(2 *PI));
+					}
+					// log_debug("%f,%f,%f lat %d lng %d\n",meshNor[0],meshNor[1],meshNor[2],lat,lng);
+					uint16_t normal = ((lat &255)*256)| (lng &255);
+					p = md3filter_put(p,normal);
+				}
+			});
+			dst->writeBytes(buf.data(),buf.size());
 		}
 	}
 
-	offsetEnd = m_dst->offset();
-	m_dst->seek(endPos);
-	m_dst->write(offsetEnd);
-
-	return Model::ERROR_NONE;
+	int32_t offsetEnd = dst->offset();
+	dst->seek(s.endPos);
+	dst->write(offsetEnd);
 }
 
 bool Md3Filter::animSyncWarning(std::string name)
@@ -593,6 +593,46 @@ bool file_modifiedtime(const char *filename,time_t *modifiedtime)
 #endif
 }
 
+bool file_size(const char *filename, size_t *size) //NEW
+{
+#ifdef WIN32
+	*size = 0;
+
+	std::wstring wideString = utf8PathToWide(filename);
+	if(wideString.empty())
+		return false;
+
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(!GetFileAttributesExW(&wideString[0],GetFileExInfoStandard,&data))
+		return false;
+
+	*size = (size_t)((ULONGLONG)data.nFileSizeHigh<<32|data.nFileSizeLow);
+	return true;
+#else
+	struct stat statbuf;
+	if(stat(filename,&statbuf)==0)
+	{
+		*size = statbuf.st_size;
+		return true;
+	}
+	else
+	{
+		*size = 0;
+		return false;
+	}
+#endif
+}
+
+bool file_remove(const char *filename) //NEW
+{
+#ifdef WIN32
+	std::wstring wideString = utf8PathToWide(filename);
+	return !wideString.empty()&&DeleteFileW(&wideString[0])!=FALSE;
+#else
+	return unlink(filename)==0;
+#endif
+}
+
 bool file_exists(const char *filename)
 {
 #ifdef WIN32
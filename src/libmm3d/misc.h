@@ -56,7 +56,9 @@ std::string removeExtension(const char *infile);
 extern void getFileList(std::list<std::string> &l, const char *const path, const char *const name);
 
 extern bool file_modifiedtime(const char *filename,time_t *modifiedTime);
+extern bool file_size(const char *filename, size_t *size);
 extern bool file_exists(const char *filename);
+extern bool file_remove(const char *filename);
 extern bool is_directory(const char *filename);
 
 //TODO: Would like to remove UNUSED mode parameter.
@@ -30,6 +30,8 @@
 #include "filedatadest.h"
 #include "filedatasource.h"
 #include "texture.h"
+#include "texmgr.h"
+#include "memdatasource.h"
 #include "log.h"
 #include "misc.h"
 #include "mm3dport.h"
@@ -93,7 +95,7 @@ namespace
 	//	0x0101	 V		 Groups
 	//	0x0106	U		Smooth Angles (STOP USING ME)
 	//	0x0121	U		Texture Coordinates
-	//	0x0141	 V		 Embedded textures (UNIMPLEMENTED)
+	//	0x0141	 V		 Embedded textures
 	//	0x0142	 V		 External textures
 	//  0x0146	U	    Weighted Influences
 	//	0x0161	 V		 Materials
@@ -160,6 +162,10 @@ namespace
 	//	TEXTURE_SIZE	 uint32
 	//	DATA				uint8 *[TEXTURE_SIZE]
 	//
+	// NOTE: DATA is the texture's image file as is. The material's
+	// FLAGS type (lower 4 bits) is 1 when TEXTURE_INDEX refers to an
+	// embedded texture and 0 when it refers to an external texture.
+	//
 	// Material
 	//	FLAGS			  uint16
 	//	TEXTURE_INDEX	uint32
@@ -308,7 +314,7 @@ namespace
 		MDT_Groups,
 		MDT_SmoothAngles, //???
 		MDT_TexCoords,
-		//MDT_EmbTextures, //UNIMPLEMENTED
+		MDT_EmbTextures,
 		MDT_ExtTextures,
 		MDT_WeightedInfluences,
 		MDT_Materials,
@@ -341,7 +347,7 @@ namespace
 	{	0x0101,       "Groups" }, 
 	{	0x0106, /*U*/ "Smooth Angles" }, 
 	{	0x0121, /*U*/ "Texture Coordinates" }, 
-//	{	0x0141,       "Embedded Textures" }, //UNIMPLEMENTED
+	{	0x0141,       "Embedded Textures" }, 
 	{	0x0142,       "External Textures" }, 
 	{	0x0146, /*U*/ "Weighted Influences" }, 
 	{	0x0161,       "Materials" }, 
@@ -570,6 +576,8 @@ namespace
 		virtual const char *getReadTypes(){ return "MM3D"; }
 		virtual const char *getWriteTypes(){ return "MM3D"; }
 
+		virtual Options *getDefaultOptions(){ return new Mm3dOptions; };
+
 	protected:
 
 		DataSource *m_src;
@@ -973,6 +981,80 @@ Model::ModelErrorE MisfitFilter::readFile(Model *model, const char *const filena
 		}
 	}
 
+	// Embedded Textures
+	//NOTE: The section is read in one piece. The images are decoded from
+	//it by the TextureManager when their materials ask for them.
+	std::vector<std::string> embNames;
+	if(auto*os=seekOffset(MDT_EmbTextures))
+	{
+		size_t end = fileLength;
+		for(auto&ea:m_offsetList)
+		if(ea.offsetValue>os->offsetValue) end = std::min<size_t>(end,ea.offsetValue);
+
+		auto *blob = new std::vector<uint8_t>(end-os->offsetValue);
+		TextureManager::Blob shared(blob);
+		if(!m_src->readBytes(blob->data(),blob->size()))
+		{
+			return Model::ERROR_UNEXPECTED_EOF;
+		}
+		MemDataSource mem(blob->data(),blob->size());
+
+		uint16_t flags = 0;
+		uint32_t count = 0;
+		mem.read(flags);
+		mem.read(count);
+
+		uint32_t size = 0;
+		if(os->uniform())
+		{
+			mem.read(size);
+		}
+
+		auto *tm = TextureManager::getInstance();
+		for(unsigned t=0;t<count;t++)
+		{
+			log_debug("reading embedded texture %d/%d\n",t,count);
+			if(os->variable())
+			{
+				mem.read(size);
+			}
+			size_t next = (size_t)mem.offset()+size;
+
+			uint16_t flags; //SHADOWING
+			char format[5] = {};
+			uint32_t texSize = 0;
+
+			mem.read(flags);
+			mem.readBytes(format,4);
+			mem.read(texSize);
+
+			size_t offset = (size_t)mem.offset();
+			if(mem.errorOccurred()||offset+texSize>blob->size()||offset+texSize>next)
+			{
+				log_error("embedded texture %d is truncated\n",t);
+				return Model::ERROR_BAD_DATA;
+			}
+
+			//The material's filename is a stand-in that only needs to be
+			//unique and to end in the image's format.
+			for(int i=4;i-->0&&format[i]==' ';) format[i] = '\0';
+			for(char*p=format;*p;p++) *p = tolower(*p);
+			char name[32];
+			snprintf(name,sizeof(name),"#%u.%s",t,format);
+			std::string fullpath = modelFullName+name;
+
+			tm->addEmbeddedTexture(fullpath.c_str(),shared,offset,texSize);
+
+			log_debug("  embedded %s is %d bytes\n",fullpath.c_str(),texSize);
+
+			embNames.push_back(fullpath);
+
+			mem.seek(next);
+		}
+
+		model->keepEmbeddedTextures(shared);
+	}
+
 	// Materials
 	if(auto*os=seekOffset(MDT_Materials))
 	{
@@ -1024,6 +1106,18 @@ Model::ModelErrorE MisfitFilter::readFile(Model *model, const char *const filena
 					mat->m_filename = "";
 				}
 				break;
+			case 1:
+				log_debug("  got embedded texture %d\n",texIndex);
+				mat->m_type = Model::Material::MATTYPE_TEXTURE;
+				if(texIndex<embNames.size())
+				{
+					mat->m_filename = embNames[texIndex];
+				}
+				else
+				{
+					mat->m_filename = "";
+				}
+				break;
 			case 13: //UNUSED
 				mat->m_type = Model::Material::MATTYPE_COLOR;
 				mat->m_filename = "";
@@ -2343,7 +2437,47 @@ Model::ModelErrorE MisfitFilter::readFile(Model *model, const char *const filena
 	return Model::ERROR_NONE;
 }
 
-Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filename, Options&)
+struct mm3dfilter_emb_t //writeFile
+{
+	const uint8_t *data; size_t size; char format[4];
+
+	std::vector<uint8_t> file;
+
+	bool embed(const std::string &filename, bool files)
+	{
+		auto *tm = TextureManager::getInstance();
+		if(!tm->getEmbeddedTexture(filename.c_str(),&data,&size))
+		{
+			if(!files) return false;
+
+			FileDataSource src(filename.c_str());
+			file.resize(src.getFileSize());
+			if(src.errorOccurred()||!src.readBytes(file.data(),file.size()))
+			{
+				log_warning("can't embed %s, leaving it external\n",filename.c_str());
+				return false;
+			}
+			data = file.data(); size = file.size();
+		}
+
+		//'JPEG','PNG ','TGA ',etc.
+		memset(format,' ',sizeof(format));
+		size_t dot = filename.rfind('.');
+		if(dot!=filename.npos)
+		for(size_t i=0;i<4&&dot+1+i<filename.size();i++)
+		format[i] = toupper(filename[dot+1+i]);
+		return true;
+	}
+};
+void Mm3dOptions::setOptionsFromModel(Model *m)
+{
+	char value[32];
+	if(m->getMetaData("mm3d_embed_textures",value,sizeof(value)))
+	{
+		m_embedTextures = atoi(value)!=0;
+	}
+}
+Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filename, Options &o)
 {
 	/*if(sizeof(float32_t)!=4)
 	{
@@ -2400,6 +2534,23 @@ Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filen
 	for(auto*ea:modelVerts) influenced+=ea->m_influences.size();
 	for(auto*ea:modelPoints) influenced+=ea->m_influences.size();
 
+	//Textures that were embedded stay embedded since they don't have
+	//files to refer to.
+	bool embedFiles = o.getOptions<Mm3dOptions>()->m_embedTextures;
+	std::unordered_map<std::string,uint32_t> embMap;
+	std::list<mm3dfilter_emb_t> embList;
+	for(auto*ea:modelMaterials)
+	if(ea->m_type==Model::Material::MATTYPE_TEXTURE&&!ea->m_filename.empty())
+	if(!embMap.count(ea->m_filename))
+	{
+		embList.emplace_back();
+		if(embList.back().embed(ea->m_filename,embedFiles))
+		{
+			embMap[ea->m_filename] = embList.size()-1;
+		}
+		else embList.pop_back();
+	}
+
 	// Write header
 	//MisfitOffsetList offsetList;
 	m_offsetList.clear();
@@ -2412,6 +2563,7 @@ Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filen
 	addOffset(MDT_Groups			  , !modelGroups.empty());
 	addOffset(MDT_SmoothAngles		  , !modelGroups.empty());
 	addOffset(MDT_ExtTextures		  , !modelMaterials.empty());
+	addOffset(MDT_EmbTextures		  , !embList.empty());
 	// Some users map texture coordinates before assigning a texture (think: paint texture)
 	addOffset(MDT_TexCoords			  , !modelTriangles.empty()); 
 	addOffset(MDT_ProjectionTriangles , haveProjectionTriangles);
@@ -2592,7 +2744,7 @@ Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filen
 			uint32_t matSize = baseSize+mat->m_name.size()+1;
 
 			uint16_t flags = 0x0000;
-			uint32_t texIndex = ~0;  // TODO deal with embedded textures
+			uint32_t texIndex = ~0;
 
 			switch (mat->m_type)
 			{
@@ -2607,6 +2759,12 @@ Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filen
 				break;
 			case Model::Material::MATTYPE_TEXTURE:
 			{
+				auto it = embMap.find(mat->m_filename);
+				if(it!=embMap.end())
+				{
+					flags = 0x0001;
+					texIndex = it->second; break;
+				}
 				flags = 0x0000;
 				auto ins = texMap.insert({mat->m_filename,texNum});
 				if(ins.second) texNum++;
@@ -2648,7 +2806,7 @@ Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filen
 			m_dst->write(lightProp);
 
 		}
-		log_debug("wrote %d materials with %d internal textures\n",count,count-texNum);
+		log_debug("wrote %d materials with %d external and %d embedded textures\n",count,texNum,embList.size());
 	}
 	if(setOffset(MDT_Groups,false))
 	{
@@ -2748,6 +2906,31 @@ Model::ModelErrorE MisfitFilter::writeFile(Model *model, const char *const filen
 		log_debug("wrote %d external textures\n",count);
 	}
 
+	// Embedded Textures
+	if(setOffset(MDT_EmbTextures,false))
+	{
+		unsigned count = embList.size();
+
+		writeHeaderA(0x0000,count);
+
+		unsigned baseSize = sizeof(uint16_t)+4+sizeof(uint32_t);
+
+		for(auto&ea:embList)
+		{
+			uint32_t texSize = ea.size;
+			uint32_t embSize = baseSize+texSize;
+
+			uint16_t flags = 0x0000;
+
+			m_dst->write(embSize);
+			m_dst->write(flags);
+			m_dst->writeBytes(ea.format,4);
+			m_dst->write(texSize);
+			m_dst->writeBytes(ea.data,ea.size);
+		}
+		log_debug("wrote %d embedded textures\n",count);
+	}
+
 	// Texture Coordinates
 	if(setOffset(MDT_TexCoords,true))
 	{
@@ -42,6 +42,11 @@ typedef float float32_t;
 #include <memory> 
 #include <unordered_map>
 #include <unordered_set>
+#include <thread> //objfilter.cc
+#include <atomic> //md3filter.cc
+#include <mutex> //texmgr.cc
+#include <condition_variable> //texmgr.cc
+#include <future> //texmgr.h
 
 #include <math.h>
 #include <limits.h> //INT_MAX
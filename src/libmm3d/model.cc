@@ -226,6 +226,8 @@ static int model_findEdgePlaneIntersection(double *ipoint, double *p1, double *p
 Model::Model()
 	: m_filename(""),
 	m_validContext(false),
+	m_drawBuffers(),
+	m_drawProxy(),m_drawProxySerial(),
 	  m_validBspTree(false),
 	  m_canvasDrawMode(0),
 	  m_perspectiveDrawMode(3),
@@ -282,6 +284,11 @@ Model::~Model()
 		deleteGlTextures((*it)->m_context);
 	}
 	m_drawingContexts.clear();
+	deleteGlTextures(nullptr);
+
+	if(m_drawProxyJob.valid()) //NEW
+	delete m_drawProxyJob.get();
+	delete m_drawProxy;
 
 	while(!m_vertices.empty())
 	{
@@ -432,6 +439,7 @@ void Model::updateObservers(bool remove_me)
 	recursive++;
 	int change = m_changeBits; 
 	m_changeBits = 0; //2019
+	invalidateDrawBuffers(change); //NEW
 	for(auto*ea:m_observers) ea->modelChanged(change);
 	//m_changeBits = 0;
 	recursive--;
@@ -2382,6 +2390,8 @@ bool Model::hideVertex(unsigned v)
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	if(v<m_vertices.size())
 	{
 		m_vertices[v]->m_visible = false;
@@ -2397,6 +2407,8 @@ bool Model::hideTriangle(unsigned t)
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	if(t<m_triangles.size())
 	{
 		m_triangles[t]->m_visible = false;
@@ -2443,6 +2455,8 @@ bool Model::unhideVertex(unsigned v)
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	if(v<m_vertices.size())
 	{
 		m_vertices[v]->m_visible = true;
@@ -2458,6 +2472,8 @@ bool Model::unhideTriangle(unsigned t)
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	if(t<m_triangles.size())
 	{
 		m_triangles[t]->m_visible = true;
@@ -2503,6 +2519,8 @@ bool Model::hideSelected()
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	unsigned t = 0;
 	unsigned v = 0;
 
@@ -2629,6 +2647,8 @@ bool Model::hideUnselected()
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	unsigned t = 0;
 	unsigned v = 0;
 
@@ -2739,6 +2759,8 @@ bool Model::unhideAll()
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	for(unsigned v = 0; v<m_vertices.size(); v++)
 	{
 		if(!m_vertices[v]->m_visible)
@@ -2803,6 +2825,8 @@ void Model::hideTrianglesFromVertices()
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	// Hide triangles with at least one vertex hidden
 	for(unsigned t = 0; t<m_triangles.size(); t++)
 	{
@@ -2820,6 +2844,8 @@ void Model::unhideTrianglesFromVertices()
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	// Hide triangles with at least one vertex hidden
 	for(unsigned t = 0; t<m_triangles.size(); t++)
 	{
@@ -2837,6 +2863,8 @@ void Model::hideVerticesFromTriangles()
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	// Hide vertices with all triangles hidden
 	unsigned t;
 
@@ -2861,6 +2889,8 @@ void Model::unhideVerticesFromTriangles()
 {
 	//LOG_PROFILE(); //???
 
+	m_changeBits|=HideGeometry; //NEW
+
 	// Unhide vertices with at least one triangle visible
 	for(unsigned t = 0; t<m_triangles.size(); t++)
 	{
@@ -4024,6 +4054,7 @@ void Model::calculateBspTree()
 {
 	log_debug("calculating BSP tree\n");
 	m_bspTree.clear();
+	m_depthSort.clear(); //NEW
 
 	for(unsigned m = 0; m<m_groups.size(); m++)
 	{
@@ -4040,30 +4071,29 @@ void Model::calculateBspTree()
 					Triangle *triangle = m_triangles[ti];
 					triangle->m_marked = true;
 
-					BspTree::Poly *poly = BspTree::Poly::get();
+					BspTree::Poly poly;
 					
 					for(int i=0;i<3;i++)
 					{
-						poly->coord[0][i] = m_vertices[triangle->m_vertexIndices[0]]->m_absSource[i];
-						poly->coord[1][i] = m_vertices[triangle->m_vertexIndices[1]]->m_absSource[i];
-						poly->coord[2][i] = m_vertices[triangle->m_vertexIndices[2]]->m_absSource[i];
+						poly.coord[0][i] = (float)m_vertices[triangle->m_vertexIndices[0]]->m_absSource[i];
+						poly.coord[1][i] = (float)m_vertices[triangle->m_vertexIndices[1]]->m_absSource[i];
+						poly.coord[2][i] = (float)m_vertices[triangle->m_vertexIndices[2]]->m_absSource[i];
 
-						poly->drawNormals[0][i] = triangle->m_normalSource[0][i];
-						poly->drawNormals[1][i] = triangle->m_normalSource[1][i];
-						poly->drawNormals[2][i] = triangle->m_normalSource[2][i];
+						poly.drawNormals[0][i] = (float)triangle->m_normalSource[0][i];
+						poly.drawNormals[1][i] = (float)triangle->m_normalSource[1][i];
+						poly.drawNormals[2][i] = (float)triangle->m_normalSource[2][i];
 
-						poly->norm[i] = triangle->m_flatSource[i];
+						poly.norm[i] = (float)triangle->m_flatSource[i];
 					}
 
 					for(int i = 0; i<3; i++)
 					{
-						poly->s[i] = triangle->m_s[i];
-						poly->t[i] = triangle->m_t[i];
+						poly.s[i] = triangle->m_s[i];
+						poly.t[i] = triangle->m_t[i];
 					}
-					poly->texture = index;
-					poly->material = static_cast<void*>(m_materials[index]);
-					poly->triangle = static_cast<void*>(triangle);
-					poly->calculateD();
+					poly.material = index;
+					poly.triangle = ti;
+					poly.calculateD();
 					m_bspTree.addPoly(poly);
 				}
 			}
@@ -4073,6 +4103,36 @@ void Model::calculateBspTree()
 	m_validBspTree = true;
 }
 
+void Model::calculateDepthSort()
+{
+	m_bspTree.clear();
+	m_depthSort.clear();
+
+	for(Group*grp:m_groups)
+	{
+		int index = grp->m_materialIndex;
+		if(index<0) continue;
+
+		Material *mat = m_materials[index];
+		if(mat->m_type==Model::Material::MATTYPE_TEXTURE
+		&&mat->m_textureData->m_format==Texture::FORMAT_RGBA)
+		{
+			for(int ti:grp->m_triangleIndices)
+			{
+				auto *vi = m_triangles[ti]->m_vertexIndices;
+
+				m_depthSort.addTriangle(ti,index,
+				m_vertices[vi[0]]->m_absSource,
+				m_vertices[vi[1]]->m_absSource,
+				m_vertices[vi[2]]->m_absSource);
+			}
+		}
+	}
+	m_depthSort.build();
+
+	m_validBspTree = true;
+}
+
 void Model::invalidateBspTree()
 {
 	m_validBspTree = false;
@@ -4121,8 +4181,6 @@ void model_show_alloc_stats()
 	Model::Animation::stats();
 	Model::FrameAnimVertex::stats();
 //	Model::FrameAnimPoint::stats();
-	BspTree::Poly::stats();
-	BspTree::Node::stats();
 	log_debug("Textures: none/%d\n",Texture::s_allocated);
 	log_debug("GlTextures: none/%d\n",Model::s_glTextures);
 #ifdef MM3D_EDIT
@@ -4146,8 +4204,6 @@ int model_free_primitives()
 	c += Model::Keyframe::flush();
 	//c += Model::SkelAnim::flush();
 	c += Model::Animation::flush();
-	c += BspTree::Poly::flush();
-	c += BspTree::Node::flush();
 	//c += Model::FrameAnim::flush();
 	c += Model::FrameAnimVertex::flush();
 //	c += Model::FrameAnimPoint::flush();
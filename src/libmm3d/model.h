@@ -109,6 +109,7 @@ class Model
 			AnimationProperty    = 0x00040000, // Set animation times/frames/fps/wrap
 			ShowJoints           = 0x00080000, // Joints forced visible
 			ShowProjections      = 0x00100000, // Projections forced visible
+			HideGeometry         = 0x00200000, // Hid or unhid vertices or faces
 			ChangeAll			 = 0xFFFFFFFF,	// All of the above
 
 			AnimationChange = AnimationMode|AnimationSet|AnimationFrame|AnimationProperty,
@@ -593,6 +594,14 @@ class Model
 				std::string	m_alphaFilename;  // Unused
 				Texture	  *m_textureData;	 // Texture data (for MATTYPE_TEXTURE)
 
+				// m_textureData is a placeholder until the texture manager's 
+				// worker thread is finished (see Model::loadTextures)
+				bool		 m_texturePending;
+
+				// Assigns m_textureData, holding a reference on it so the
+				// texture manager won't evict it (see TextureManager)
+				void setTextureData(Texture*);
+
 				bool propEqual(const Material &rhs, int propBits=PropAll, double tolerance=0.00001)const;
 				bool operator==(const Material &rhs)const{ return propEqual(rhs); }
 
@@ -1093,6 +1102,8 @@ class Model
 
 			int xyz3d; //1|2|4
 
+			int proxy3d; //DO_PROXY triangles (0 is off)
+
 			ViewportUnits(){ memset(this,0x00,sizeof(*this)); }
 		};
 
@@ -1203,6 +1214,12 @@ class Model
 			DO_BACKFACECULL	= 0x20, // Do not render triangles that face away from the camera
 
 			DO_BONES = 0x40, //2019 //Removing DrawJointModeE
+
+			DO_ALPHA_SORT = 0x80, //NEW: DO_ALPHA uses DepthSort, not BspTree
+
+			DO_PROXY = 0x100, //NEW: Draw DrawingProxy if over ViewportUnits::proxy3d
+
+			DO_FRUSTUM = 0x200, //NEW: Skip DrawingBuffers::Chunk out of GL's view
 		};
 
 		//REMOVE ME
@@ -1322,6 +1339,14 @@ class Model
 		void clearMetaData();
 		void removeLastMetaData();  // For undo only!
 
+		//NEW: MM3D files keep the image files of embedded textures in a
+		//buffer that the TextureManager only holds weakly. The model holds
+		//it so it's freed with the model and can be saved again.
+		void keepEmbeddedTextures(std::shared_ptr<const void> blob)
+		{
+			m_embeddedTextures.push_back(blob);
+		}
+
 		// Background image accessors. See the BackgroundImage class.
 		bool setBackgroundImage(unsigned index, const char *str);
 		bool setBackgroundScale(unsigned index, double scale);
@@ -1356,6 +1381,7 @@ class Model
 		void drawLines(float alpha=1);
 		void drawVertices(float alpha=1);
 		void _drawPolygons(int,bool mark=false); //2019
+		void _drawDepthSort(double*,DrawingContext*); //NEW
 		void drawPoints();
 		void drawProjections();
 		void drawJoints(float alpha=1, float axis=0);
@@ -1398,8 +1424,20 @@ class Model
 
 		// Open GL needs textures allocated for each viewport that renders the textures.
 		// A ContextT associates a set of OpenGL textures with a viewport.
+		//
+		// NEW: The texture objects belong to a DrawingShareGroup and are shared
+		// by all the models drawn in it, so each texture is uploaded once. The
+		// nullptr ContextT and contexts that haven't set a share use one group.
+		//
+		// NEW: Textures that aren't in the TextureManager's cache are decoded
+		// on worker threads and drawn with placeholders until they're ready.
+		// loadPendingTextures uploads the ones that are, returning true if it
+		// uploaded any. draw calls it. getTextureData waits on the texture.
 		bool loadTextures(ContextT context = nullptr);
+		bool loadPendingTextures(ContextT context = nullptr);
+		bool hasPendingTextures(ContextT context = nullptr);
 		void removeContext(ContextT context);
+		void setContextShare(ContextT context, ContextT share);
 
 		// Forces a reload and re-initialization of all textures in all
 		// viewports (contexts)
@@ -1752,6 +1790,11 @@ class Model
 		int addVertex(double x, double y, double z);
 		int addTriangle(unsigned vert1, unsigned vert2, unsigned vert3);
 
+		// Import filters that know their counts up front can use these
+		// to avoid regrowing the primitive lists.
+		void reserveVertices(unsigned n){ m_vertices.reserve(n); }
+		void reserveTriangles(unsigned n){ m_triangles.reserve(n); }
+
 		//2020: This API leaves dangling references to vertices!
 		void deleteVertex(unsigned vertex);
 		void deleteTriangle(unsigned triangle);
@@ -1816,6 +1859,11 @@ class Model
 		// are drawn on top of them).
 		void calculateBspTree(), invalidateBspTree();
 
+		// With DO_ALPHA_SORT the same triangles are put in a DepthSort that
+		// is sorted every frame. It's much faster to build. m_validBspTree
+		// applies to whichever of the two was built last.
+		void calculateDepthSort();
+
 		//2020: I've removed the trans/rot argument to focus on the task at hand
 		//Please use applyMatrix.
 		bool mergeModels(const Model *model, bool textures, AnimationMergeE mergeMode, bool emptyGroups);
@@ -1867,6 +1915,16 @@ class Model
 		int removeUnusedMaterials();
 		int mergeIdenticalMaterials();
 
+		// Packs the textures of materials into one image that's written to
+		// filename (TGA) and merges the materials into one new one that has
+		// the first's lighting. The texture coordinates of their triangles
+		// are remapped into the image. Coordinates that wrap repeat the image
+		// and the edges are padded so that filtering doesn't bleed. Materials
+		// with projected triangles, or clamped coordinates outside 0-1, are
+		// skipped. Returns how many materials were merged or -1 if the image
+		// couldn't be written.
+		int bakeTextureAtlas(const int_list &materials, const char *filename, int maxSize=4096, int padding=4);
+
 		// These implicitly change the material type.
 		void setMaterialTexture(unsigned textureId,Texture *tex);
 		void removeMaterialTexture(unsigned textureId);
@@ -2431,6 +2489,19 @@ class Model
 		DrawingContext *getDrawingContext(ContextT context);
 		void deleteGlTextures(ContextT context);
 
+		// Updates draw's buffer objects, creating them if need be.
+		// Returns false if there's no OpenGL 1.5 to make them with.
+		bool validateDrawBuffers(DrawingBuffers*&, unsigned drawOptions);
+		bool validateLineBuffers(DrawingBuffers*&); //drawLines/drawVertices
+		void deleteDrawBuffers(DrawingBuffers*&);
+		void invalidateDrawBuffers(int changeBits);
+
+		// Returns the DO_PROXY stand-in if the model has more than
+		// ViewportUnits::proxy3d triangles and it's ready. If not it
+		// starts making it on a worker thread and returns nullptr.
+		DrawingProxy *validateDrawProxy();
+		void _updateDrawProxy(DrawingProxy*); //arrays
+
 		// If any group is using material "id",set the group to having
 		// no texture (used when materials are deleted).
 		void noTexture(unsigned id);
@@ -2530,6 +2601,7 @@ class Model
 		std::list<std::string> m_loadErrors; //queue
 
 		MetaDataList			 m_metaData;
+		std::vector<std::shared_ptr<const void>> m_embeddedTextures; //NEW
 		_VertexList m_vertices;
 		_TriangleList m_triangles;
 		_GroupList m_groups;
@@ -2545,10 +2617,17 @@ class Model
 		//REMOVE US
 		DrawingContextList m_drawingContexts;
 		bool m_validContext; //2020
+		std::vector<int> m_pendingTextures; //loadPendingTextures
+		MaterialTextureList m_matTextures; //loadTextures(nullptr)
+		DrawingBuffers *m_drawBuffers; //draw(nullptr)
+		DrawingProxy *m_drawProxy; //draw(DO_PROXY)
+		std::future<DrawingProxy*> m_drawProxyJob;
+		unsigned m_drawProxySerial; //Topology/selection changes.
 
 		bool m_validBspTree;
 
 		BspTree m_bspTree;
+		DepthSort m_depthSort; //NEW
 
 		std::vector<FormatData*> m_formatData;
 		
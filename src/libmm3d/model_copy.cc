@@ -189,6 +189,7 @@ Model *Model::copySelected(bool animated)const
 			m->setTextureSClamp(t,getTextureSClamp(t));
 			m->setTextureTClamp(t,getTextureTClamp(t));
 		}
+		m->m_embeddedTextures = m_embeddedTextures; //NEW
 
 		// TODO Only copy selected groups?
 		// Copy groups
@@ -26,6 +26,162 @@
 #include "log.h"
 #include "texture.h"
 
+#ifndef _WIN32
+#include <dlfcn.h> //dlsym
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+//NEW: OpenGL 1.5 buffer objects. These are looked up at run time since
+//Windows' headers and libraries stop at 1.1. A context must be current.
+static struct model_draw_gl15_t
+{
+	enum //Also not in Windows' gl.h.
+	{
+		ARRAY_BUFFER=0x8892,ELEMENT_ARRAY_BUFFER=0x8893,DYNAMIC_DRAW=0x88E8
+	};
+
+	int init; //-1 if unavailable.
+
+	void(APIENTRY*GenBuffers)(GLsizei,GLuint*);
+	void(APIENTRY*DeleteBuffers)(GLsizei,const GLuint*);
+	void(APIENTRY*BindBuffer)(GLenum,GLuint);
+	void(APIENTRY*BufferData)(GLenum,ptrdiff_t,const void*,GLenum);
+	void(APIENTRY*BufferSubData)(GLenum,ptrdiff_t,ptrdiff_t,const void*);
+
+	template<class T> static bool proc(T &f, const char *name, const char *arb)
+	{
+		char buf[32]; snprintf(buf,sizeof(buf),"%s%s",name,arb);
+		#ifdef _WIN32
+		f = (T)wglGetProcAddress(buf);
+		#else
+		f = (T)dlsym(RTLD_DEFAULT,buf);
+		#endif
+		return f!=nullptr;
+	}
+	bool load()
+	{
+		if(init) return init==1;
+
+		auto v = (const char*)glGetString(GL_VERSION);
+		if(!v) return false; //No context?
+
+		int major = 0, minor = 0; 
+		sscanf(v,"%d.%d",&major,&minor);
+		const char *arb = "";
+		if(major==1&&minor<5)
+		{
+			auto x = (const char*)glGetString(GL_EXTENSIONS);
+			arb = x&&strstr(x,"GL_ARB_vertex_buffer_object")?"ARB":nullptr;
+		}
+		init = arb
+		&&proc(GenBuffers,"glGenBuffers",arb)
+		&&proc(DeleteBuffers,"glDeleteBuffers",arb)
+		&&proc(BindBuffer,"glBindBuffer",arb)
+		&&proc(BufferData,"glBufferData",arb)
+		&&proc(BufferSubData,"glBufferSubData",arb)?1:-1;
+
+		if(init!=1) log_debug("OpenGL buffer objects unavailable (%s)\n",v);
+
+		return init==1;
+	}
+
+}model_draw_gl15 = {};
+
+static bool model_draw_alpha(Model::Material *mat, unsigned drawOptions)
+{
+	return (drawOptions&Model::DO_ALPHA)&&(drawOptions&Model::DO_TEXTURE)
+	&&mat&&mat->m_type==Model::Material::MATTYPE_TEXTURE
+	&&mat->m_textureData->m_format==Texture::FORMAT_RGBA;
+}
+
+//NEW: DO_FRUSTUM's planes. They're taken from OpenGL's matrices so
+//that they agree with whatever the caller has set up to draw with.
+struct model_draw_frustum
+{
+	double planes[6][4];
+
+	void load()
+	{
+		double p[16],m[16],c[16]; //Column major.
+		glGetDoublev(GL_PROJECTION_MATRIX,p);
+		glGetDoublev(GL_MODELVIEW_MATRIX,m);
+		for(int i=0;i<4;i++) for(int j=0;j<4;j++)
+		{
+			double sum = 0;
+			for(int k=0;k<4;k++) sum+=p[k*4+j]*m[i*4+k];
+			c[i*4+j] = sum;
+		}
+		//Left, right, bottom, top, near, far.
+		for(int i=0;i<6;i++) for(int j=0;j<4;j++)
+		{
+			double r = c[j*4+i/2];
+			planes[i][j] = c[j*4+3]+(i%2?-r:r);
+		}
+	}
+
+	bool test(const float box[6])const //Min, max.
+	{
+		for(auto&pl:planes)
+		{
+			double d = pl[3];
+			for(int i=0;i<3;i++) d+=pl[i]*box[pl[i]>0?3+i:i];
+			if(d<0) return false;
+		}
+		return true;
+	}
+};
+
+//NEW: Adds DrawingBuffers::Chunk for the "count" elements of ii from
+//"first". They are "per" to a primitive and index "pos" by "stride".
+static void model_draw_chunk(std::vector<DrawingBuffers::Chunk> &out,
+const unsigned *ii, unsigned first, unsigned count, unsigned per, const float *pos, int stride)
+{
+	enum{ chunk=1024 };
+	for(unsigned i=first,i1=first+count;i<i1;)
+	{
+		unsigned n = std::min<unsigned>(chunk*per,i1-i);
+		DrawingBuffers::Chunk c = {i,n,{+FLT_MAX,+FLT_MAX,+FLT_MAX,-FLT_MAX,-FLT_MAX,-FLT_MAX}};
+		for(unsigned j=i;j<i+n;j++)
+		{
+			const float *p = pos+ii[j]*stride;
+			for(int k=0;k<3;k++)
+			{
+				c.box[k] = std::min(c.box[k],p[k]);
+				c.box[3+k] = std::max(c.box[3+k],p[k]);
+			}
+		}
+		out.push_back(c); i+=n;
+	}
+}
+
+//NEW: glDrawElements but if f isn't null the chunks in the range that
+//are out of view are left out. The rest are drawn in as few calls as
+//they can be.
+static void model_draw_elements(GLenum mode, unsigned first, unsigned count,
+const std::vector<DrawingBuffers::Chunk> &chunks, const model_draw_frustum *f)
+{
+	unsigned run = first, end = first+count;
+	if(f)
+	{
+		auto it = std::lower_bound(chunks.begin(),chunks.end(),first,
+		[](const DrawingBuffers::Chunk &c, unsigned i){ return c.first<i; });
+
+		unsigned last = end; end = first;
+		for(;it<chunks.end()&&it->first<last;it++) if(f->test(it->box))
+		{
+			if(it->first!=end)
+			{
+				if(end>run) glDrawElements(mode,end-run,GL_UNSIGNED_INT,(void*)(run*sizeof(unsigned)));
+				run = it->first;
+			}
+			end = it->first+it->count;
+		}
+	}
+	if(end>run) glDrawElements(mode,end-run,GL_UNSIGNED_INT,(void*)(run*sizeof(unsigned)));
+}
+
 static void model_draw_defaultMaterial()
 {
 	float fval[4] = { 0.2f,0.2f,0.2f,1.0f };
@@ -348,7 +504,12 @@ void Model::draw(unsigned drawOptions, ContextT context, double viewPoint[3])
 #endif
 	}
 
-	validateNormals();
+	//NEW: The proxy is drawn flat and opaque so that neither normals
+	//nor BspTree must be recalculated while its vertices are moving.
+	DrawingProxy *proxy = nullptr;
+	if(drawOptions&DO_PROXY) proxy = validateDrawProxy();
+	if(proxy) drawOptions&=~DO_ALPHA;
+	else validateNormals();
 
 	//FIX ME
 	//If not using ContextT textures aren't loaded
@@ -369,53 +530,37 @@ void Model::draw(unsigned drawOptions, ContextT context, double viewPoint[3])
 	{
 		loadTextures();
 	}
+	loadPendingTextures(context); //NEW
 
 
 	if(drawOptions &DO_ALPHA)
 	{
-		if(!m_validBspTree)
+		bool sort = (drawOptions&DO_ALPHA_SORT)!=0; //NEW
+
+		if(!m_validBspTree||sort!=m_depthSort.isBuilt())
 		{
-			calculateBspTree();
+			if(sort) calculateDepthSort(); else calculateBspTree();
 		}
 	}
 
-	for(unsigned t = 0; t<m_triangles.size(); t++)
-	{
-		m_triangles[t]->m_marked = false;
-	}
-
 	glDisable(GL_BLEND);
 	glEnable(GL_LIGHT0);
 	glDisable(GL_LIGHT1);
 	model_draw_defaultMaterial();
 	glColor3f(0.9f,0.9f,0.9f);
 
-	//https://github.com/zturtleman/mm3d/issues/98
-	//bool colorSelected = false;
-	int colorSelected;
-	for(unsigned m = 0; m<m_groups.size(); m++)
+	//NEW: The retained and immediate paths both set up groups with
+	//this. It returns false for groups that BspTree draws instead.
+	auto material = [&](int index)->bool
 	{
-		Group *grp = m_groups[m];
-
 		if(drawOptions &DO_TEXTURE)
 		{
 			glColor3f(1.0,1.0,1.0);
-			if(grp->m_materialIndex>=0)
+			if(index>=0)
 			{
-				int index = grp->m_materialIndex;
-
-				if((drawOptions &DO_ALPHA)
-						&&m_materials[index]->m_type==Model::Material::MATTYPE_TEXTURE
-						&&m_materials[index]->m_textureData->m_format==Texture::FORMAT_RGBA)
-				{
-					// Alpha blended groups are drawn by bspTree later
-					for(unsigned triIndex:grp->m_triangleIndices)
-					{
-						Triangle *triangle = m_triangles[triIndex];
-						triangle->m_marked = true;
-					}
-					continue;
-				}
+				// Alpha blended groups are drawn by bspTree later
+				if(model_draw_alpha(m_materials[index],drawOptions))
+				return false;
 
 				glMaterialfv(GL_FRONT,GL_AMBIENT,
 						m_materials[index]->m_ambient);
@@ -434,18 +579,18 @@ void Model::draw(unsigned drawOptions, ContextT context, double viewPoint[3])
 					if(drawContext)
 					{
 						glBindTexture(GL_TEXTURE_2D,
-								drawContext->m_matTextures[grp->m_materialIndex]);
+								drawContext->m_matTextures[index]);
 					}
 					else
 					{
 						glBindTexture(GL_TEXTURE_2D,
-								m_materials[grp->m_materialIndex]->m_texture);
+								m_materials[index]->m_texture);
 					}
 
 					glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,
-							(m_materials[grp->m_materialIndex]->m_sClamp ? GL_CLAMP : GL_REPEAT));
+							(m_materials[index]->m_sClamp ? GL_CLAMP : GL_REPEAT));
 					glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,
-							(m_materials[grp->m_materialIndex]->m_tClamp ? GL_CLAMP : GL_REPEAT));
+							(m_materials[index]->m_tClamp ? GL_CLAMP : GL_REPEAT));
 
 					glEnable(GL_TEXTURE_2D);
 				}
@@ -462,6 +607,160 @@ void Model::draw(unsigned drawOptions, ContextT context, double viewPoint[3])
 			glDisable(GL_TEXTURE_2D);
 			glColor3f(0.9f,0.9f,0.9f);
 		}
+		return true;
+	};
+
+	DrawingBuffers *&buffers = drawContext?drawContext->m_buffers:m_drawBuffers;
+	if(proxy) //NEW
+	{
+		_updateDrawProxy(proxy);
+
+		float *a = proxy->arrays.data();
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glVertexPointer(3,GL_FLOAT,8*sizeof(float),a);
+		glNormalPointer(GL_FLOAT,8*sizeof(float),a+3);
+		glTexCoordPointer(2,GL_FLOAT,8*sizeof(float),a+6);
+
+		//Each batch has its unselected faces then selected ones.
+		for(int pass=0;pass<2;pass++)
+		{
+			glDisable(pass?GL_LIGHT0:GL_LIGHT1);
+			glEnable(pass?GL_LIGHT1:GL_LIGHT0);
+
+			unsigned first = 0, *n = proxy->counts.data();
+			for(auto&ea:proxy->batches)
+			{
+				if(pass) first+=n[0];
+				if(n[pass])
+				{
+					bool colored = !(drawOptions&DO_TEXTURE);
+					if(ea.material>=-1)
+					{
+						material(ea.material);
+					}
+					else //Ungrouped.
+					{
+						model_draw_defaultMaterial();
+						glDisable(GL_TEXTURE_2D); colored = true;
+					}
+					if(colored) 
+					{
+						if(pass) glColor3f(1,0,0);
+						else glColor3f(0.9f,0.9f,0.9f);
+					}
+					glDrawArrays(GL_TRIANGLES,first*3,n[pass]*3);
+				}
+				first+=pass?n[1]:n[0]+n[1]; n+=2;
+			}
+		}
+		glDisable(GL_LIGHT1);
+		glEnable(GL_LIGHT0);
+
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+		goto alpha; //DO_ALPHA is off.
+	}
+	if(validateDrawBuffers(buffers,drawOptions)) //NEW
+	{
+		model_draw_frustum frustum, *f = nullptr;
+		if(drawOptions&DO_FRUSTUM)
+		{
+			frustum.load(); f = &frustum;
+
+			if(!buffers->chunked)
+			{
+				auto &c = buffers->chunks; c.clear();
+				unsigned *ii = buffers->indices.data();
+				float *vp = buffers->vertices.data();
+				for(auto&ea:buffers->batches) if(!ea.alpha)
+				{
+					unsigned i = ea.first*3, n = (ea.count-ea.selected)*3;
+					model_draw_chunk(c,ii,i,n,3,vp,8);
+					model_draw_chunk(c,ii,i+n,ea.selected*3,3,vp,8);
+				}
+				buffers->chunked = true;
+			}
+		}
+
+		auto &gl = model_draw_gl15;
+		gl.BindBuffer(gl.ARRAY_BUFFER,buffers->vbo);
+		gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,buffers->ibo);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glVertexPointer(3,GL_FLOAT,8*sizeof(float),(void*)0);
+		glNormalPointer(GL_FLOAT,8*sizeof(float),(void*)(3*sizeof(float)));
+		glTexCoordPointer(2,GL_FLOAT,8*sizeof(float),(void*)(6*sizeof(float)));
+
+		//Selected faces are lit by GL_LIGHT1.
+		for(int pass=0;pass<2;pass++)
+		{
+			glDisable(pass?GL_LIGHT0:GL_LIGHT1);
+			glEnable(pass?GL_LIGHT1:GL_LIGHT0);
+
+			for(auto&ea:buffers->batches) if(!ea.alpha)
+			{
+				size_t n = pass?ea.selected:ea.count-ea.selected;
+				if(!n) continue;
+
+				bool colored = !(drawOptions&DO_TEXTURE);
+				if(ea.material>=-1)
+				{
+					material(ea.material);
+				}
+				else //Ungrouped.
+				{
+					model_draw_defaultMaterial();
+					glDisable(GL_TEXTURE_2D); colored = true;
+				}
+				if(colored) 
+				{
+					if(pass) glColor3f(1,0,0);
+					else glColor3f(0.9f,0.9f,0.9f);
+				}
+
+				size_t first = ea.first;
+				if(pass) first+=ea.count-ea.selected;
+				model_draw_elements(GL_TRIANGLES,first*3,n*3,buffers->chunks,f);
+			}
+		}
+		glDisable(GL_LIGHT1);
+		glEnable(GL_LIGHT0);
+
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		gl.BindBuffer(gl.ARRAY_BUFFER,0);
+		gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,0);
+
+		goto alpha; //Skip immediate mode.
+	}
+
+	for(unsigned t = 0; t<m_triangles.size(); t++)
+	{
+		m_triangles[t]->m_marked = false;
+	}
+
+	//https://github.com/zturtleman/mm3d/issues/98
+	//bool colorSelected = false;
+	int colorSelected;
+	for(unsigned m = 0; m<m_groups.size(); m++)
+	{
+		Group *grp = m_groups[m];
+
+		if(!material(grp->m_materialIndex))
+		{
+			for(unsigned triIndex:grp->m_triangleIndices)
+			{
+				Triangle *triangle = m_triangles[triIndex];
+				triangle->m_marked = true;
+			}
+			continue;
+		}
 
 		//colorSelected = false;
 		colorSelected = -1;
@@ -596,10 +895,14 @@ void Model::draw(unsigned drawOptions, ContextT context, double viewPoint[3])
 	}
 
 	// Draw depth-sorted alpha blended polys last
+	alpha:
 	if((drawOptions &DO_ALPHA)&&viewPoint)
 	{
 		glEnable(GL_BLEND);
-		m_bspTree.render(viewPoint,drawContext);
+		if(drawOptions&DO_ALPHA_SORT) //NEW
+		_drawDepthSort(viewPoint,drawContext);
+		else
+		m_bspTree.render(viewPoint,drawContext,this);
 		glDisable(GL_BLEND);
 	}
 	
@@ -607,12 +910,659 @@ void Model::draw(unsigned drawOptions, ContextT context, double viewPoint[3])
 	glDisable(GL_TEXTURE_2D);
 }
 
+//NEW: Regenerates n elements of "stride" floats in "shadow" by calling
+//fill(i,w) on several threads, where w holds the old values going in,
+//and uploads the 4096 element chunks that changed to buffer object vbo.
+template<class F>
+static void model_draw_update(unsigned vbo, std::vector<float> &shadow, size_t n, int stride, F fill)
+{
+	enum{ chunk=4096 }; assert(stride<=8);
+
+	bool grow = shadow.size()!=n*stride;
+	if(grow) shadow.assign(n*stride,0);
+	
+	size_t kN = (n+chunk-1)/chunk;
+	std::vector<char> dirty(kN);
+	float *vp = shadow.data();
+	auto f = [&](size_t k0, size_t k1)
+	{
+		for(size_t k=k0;k<k1;k++)
+		{
+			bool d = false;
+			size_t i1 = std::min(n,(k+1)*chunk);
+			for(size_t i=k*chunk;i<i1;i++)
+			{
+				float w[8], *o = vp+i*stride;
+				memcpy(w,o,stride*sizeof(float));
+				fill(i,w);
+				if(memcmp(w,o,stride*sizeof(float)))
+				{
+					memcpy(o,w,stride*sizeof(float)); d = true;
+				}
+			}
+			dirty[k] = d;
+		}
+	};
+	int nt = std::thread::hardware_concurrency();
+	nt = std::max(1,std::min<int>(8,std::min<size_t>(nt,kN/4)));
+	std::vector<std::thread> threads;
+	for(int i=1;i<nt;i++) threads.emplace_back(f,kN*i/nt,kN*(i+1)/nt);
+	f(0,kN/nt);
+	for(auto&ea:threads) ea.join();
+
+	auto &gl = model_draw_gl15;
+	gl.BindBuffer(gl.ARRAY_BUFFER,vbo);
+	if(grow)
+	{
+		gl.BufferData(gl.ARRAY_BUFFER,n*stride*sizeof(float),vp,gl.DYNAMIC_DRAW);
+	}
+	else for(size_t k=0;k<kN;k++) if(dirty[k])
+	{
+		size_t k0 = k; while(k+1<kN&&dirty[k+1]) k++;
+		size_t i0 = k0*chunk, i1 = std::min(n,(k+1)*chunk);
+		gl.BufferSubData(gl.ARRAY_BUFFER,i0*stride*sizeof(float),
+		(i1-i0)*stride*sizeof(float),vp+i0*stride);
+	}
+	gl.BindBuffer(gl.ARRAY_BUFFER,0);
+}
+
+//ChangeBits that may move vertices.
+static const int model_draw_moved = Model::MoveGeometry|Model::MoveOther
+|Model::AnimationChange|Model::AddGeometry|Model::AddAnimation;
+
+static DrawingBuffers *model_draw_buffers()
+{
+	auto &gl = model_draw_gl15;
+	auto *b = new DrawingBuffers();
+	gl.GenBuffers(1,&b->vbo); gl.GenBuffers(1,&b->ibo);
+	gl.GenBuffers(1,&b->points); gl.GenBuffers(1,&b->lines);
+	b->changes = b->lineChanges = Model::ChangeAll; 
+	b->options = -1; return b;
+}
+
+bool Model::validateDrawBuffers(DrawingBuffers* &b, unsigned drawOptions)
+{
+	#ifndef MM3D_EDIT
+	return false; //There's no m_changeBits to go by.
+	#else
+	auto &gl = model_draw_gl15; if(!gl.load()) return false;
+
+	enum //ChangeBits
+	{
+		Positions = model_draw_moved,
+		Normals = Positions|MoveNormals,
+		TexCoords = MoveTexture|AddGeometry|AddOther,
+		Layout = AddGeometry|AddOther|SelectionFaces|HideGeometry,
+	};
+
+	if(!b) b = model_draw_buffers();
+	int changes = b->changes|m_changeBits; b->changes = 0;
+
+	int options = drawOptions&(DO_TEXTURE|DO_SMOOTHING|DO_ALPHA);
+	if((options^b->options)&DO_SMOOTHING) changes|=MoveNormals;
+	if(options!=b->options) changes|=AddOther;
+	b->options = options;
+
+	size_t tN = m_triangles.size();
+	if(tN!=b->triangles) changes|=AddGeometry;
+
+	//Textures may change format when reloaded.
+	for(auto&ea:b->batches) if(ea.material>=0)
+	{
+		if((size_t)ea.material>=m_materials.size()
+		||ea.alpha!=model_draw_alpha(m_materials[ea.material],options))
+		{
+			changes|=AddOther; break;
+		}
+	}
+
+	if(changes&(Positions|Layout)) b->chunked = false; //NEW
+
+	if(changes&(Normals|TexCoords))
+	{
+		validateAnim(); //m_absSource
+
+		size_t cN = tN*3;
+		if(b->vertices.size()!=cN*8) changes|=Normals|TexCoords;
+
+		bool pos = (changes&Positions)!=0;
+		bool nrm = (changes&Normals)!=0;
+		bool tex = (changes&TexCoords)!=0;
+		bool smooth = (options&DO_SMOOTHING)!=0;
+		model_draw_update(b->vbo,b->vertices,cN,8,[&](size_t c, float *w)
+		{
+			auto *tri = m_triangles[c/3]; int v = c%3;
+			if(pos)
+			{
+				double *p = m_vertices[tri->m_vertexIndices[v]]->m_absSource;
+				for(int i=0;i<3;i++) w[i] = (float)p[i];
+			}
+			if(nrm)
+			{
+				double *p = smooth?tri->m_normalSource[v]:tri->m_flatSource;
+				for(int i=0;i<3;i++) w[3+i] = (float)p[i];
+			}
+			if(tex)
+			{
+				w[6] = tri->m_s[v]; w[7] = tri->m_t[v];
+			}
+		});
+	}
+
+	if(changes&(Layout&~SelectionFaces))
+	{
+		//Sort the visible faces into a batch per material.
+		std::vector<int> map(m_materials.size()+2,-1);
+		b->batches.clear();
+		auto batch = [&](int m)->DrawingBuffers::Batch&
+		{
+			int &i = map[m+2]; if(i==-1)
+			{
+				i = (int)b->batches.size();
+				b->batches.push_back(DrawingBuffers::Batch());
+				auto &bt = b->batches.back();
+				bt.material = m;
+				bt.alpha = m>=0&&model_draw_alpha(m_materials[m],options);
+			}
+			return b->batches[i];
+		};
+
+		for(auto*ea:m_triangles) ea->m_marked = false;
+
+		for(auto*grp:m_groups)
+		{
+			int m = grp->m_materialIndex;
+			if(m>=(int)m_materials.size()) m = -1; //Paranoia.
+
+			auto &bt = batch(m);
+			for(int i:grp->m_triangleIndices)
+			{
+				auto *tri = m_triangles[i];
+				tri->m_marked = true;
+				if(tri->m_visible) bt.faces.push_back(i);
+			}
+		}
+		for(unsigned i=0;i<tN;i++)
+		{
+			auto *tri = m_triangles[i];
+			if(!tri->m_marked&&tri->m_visible) batch(-2).faces.push_back(i);
+		}
+
+		//Ungrouped faces go last as before. Textured materials go
+		//before plain ones so GL_TEXTURE_2D is toggled less often.
+		std::sort(b->batches.begin(),b->batches.end(),
+		[&](const DrawingBuffers::Batch &x, const DrawingBuffers::Batch &y)
+		{
+			auto key = [&](int m)
+			{
+				return m==-2?2:m==-1||m_materials[m]->m_type
+				!=Model::Material::MATTYPE_TEXTURE?1:0;
+			};
+			int kx = key(x.material), ky = key(y.material);
+			return kx!=ky?kx<ky:x.material<y.material;
+		});
+		unsigned first = 0;
+		for(auto&ea:b->batches)
+		{
+			ea.first = first; ea.count = (unsigned)ea.faces.size();
+			first+=ea.count;
+			ea.selected = ~0u; //Force upload.
+		}
+		b->indices.clear(); b->indices.resize(first*3);
+
+		changes|=SelectionFaces;
+	}
+	if(changes&SelectionFaces)
+	{
+		//Partition each batch by selection. Only the batches that
+		//changed are uploaded unless the layout itself is new.
+		bool all = b->indices.empty()||b->batches.empty()
+		||b->batches[0].selected==~0u;
+
+		gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,b->ibo);
+		if(all) gl.BufferData(gl.ELEMENT_ARRAY_BUFFER,
+		b->indices.size()*sizeof(unsigned),nullptr,gl.DYNAMIC_DRAW);
+
+		std::vector<unsigned> run;
+		for(auto&ea:b->batches)
+		{
+			run.clear(); size_t unselected = 0;
+			for(int pass=0;pass<2;pass++)
+			{
+				for(unsigned i:ea.faces) if(m_triangles[i]->m_selected==(pass==1))
+				{
+					for(unsigned j=0;j<3;j++) run.push_back(i*3+j);
+				}
+				if(!pass) unselected = run.size()/3;
+			}
+			unsigned selected = ea.count-(unsigned)unselected;
+
+			unsigned *dst = b->indices.data()+ea.first*3;
+			if(ea.selected==~0u||memcmp(dst,run.data(),run.size()*sizeof(unsigned)))
+			{
+				if(!run.empty()) 
+				{
+					memcpy(dst,run.data(),run.size()*sizeof(unsigned));
+					gl.BufferSubData(gl.ELEMENT_ARRAY_BUFFER,ea.first*3*sizeof(unsigned),
+					run.size()*sizeof(unsigned),dst);
+				}
+			}
+			ea.selected = selected;
+		}
+		gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,0);
+	}
+
+	b->triangles = tN; return true;
+	#endif
+}
+bool Model::validateLineBuffers(DrawingBuffers* &b)
+{
+	#ifndef MM3D_EDIT
+	return false; //There's no m_changeBits to go by.
+	#else
+	auto &gl = model_draw_gl15; if(!gl.load()) return false;
+
+	enum //ChangeBits
+	{
+		Lists = AddGeometry|SelectionFaces|SelectionVertices|HideGeometry,
+	};
+
+	if(!b) b = model_draw_buffers();
+
+	int changes = b->lineChanges|m_changeBits; b->lineChanges = 0;
+
+	size_t tN = m_triangles.size(), vN = m_vertices.size();
+	if(tN!=b->edgeTriangles||b->positions.size()!=vN*3)
+	changes|=AddGeometry;
+
+	if(changes&(model_draw_moved|Lists)) b->lineChunked = false; //NEW
+
+	if(changes&model_draw_moved)
+	{
+		validateAnim(); //m_absSource
+
+		model_draw_update(b->points,b->positions,vN,3,[&](size_t i, float *w)
+		{
+			double *p = m_vertices[i]->m_absSource;
+			for(int j=0;j<3;j++) w[j] = (float)p[j];
+		});
+	}
+
+	if(changes&AddGeometry)
+	{
+		//Bucket the faces' edges by their lower vertex and then
+		//merge the duplicates in each bucket.
+		std::vector<unsigned> start(vN+1);
+		for(auto*ea:m_triangles) for(int i=0;i<3;i++)
+		{
+			unsigned v0 = ea->m_vertexIndices[i];
+			unsigned v1 = ea->m_vertexIndices[(i+1)%3];
+			start[std::min(v0,v1)]++;
+		}
+		unsigned sum = 0;
+		for(auto&ea:start){ unsigned n = ea; ea = sum; sum+=n; }
+
+		std::vector<std::pair<unsigned,unsigned>> half(sum); //Vertex, face.
+		std::vector<unsigned> next(start.begin(),start.end()-1);
+		for(unsigned t=0;t<tN;t++) for(int i=0;i<3;i++)
+		{
+			unsigned v0 = m_triangles[t]->m_vertexIndices[i];
+			unsigned v1 = m_triangles[t]->m_vertexIndices[(i+1)%3];
+			if(v0>v1) std::swap(v0,v1);
+			half[next[v0]++] = std::make_pair(v1,t);
+		}
+
+		b->edges.clear(); b->edgeFaces.clear(); b->edgeFacesEnd.clear();
+		for(unsigned v=0;v<vN;v++)
+		{
+			auto it = half.begin()+start[v], itt = half.begin()+start[v+1];
+			std::sort(it,itt);
+			for(;it<itt;it++)
+			{
+				if(b->edges.empty()||b->edges.back()!=it->first
+				||b->edges[b->edges.size()-2]!=v)
+				{
+					if(!b->edges.empty()) b->edgeFacesEnd.push_back((unsigned)b->edgeFaces.size());
+					b->edges.push_back(v); b->edges.push_back(it->first);
+				}
+				b->edgeFaces.push_back(it->second);
+			}
+		}
+		if(!b->edges.empty()) b->edgeFacesEnd.push_back((unsigned)b->edgeFaces.size());
+
+		b->edgeTriangles = tN;
+	}
+
+	if(changes&Lists)
+	{
+		//An edge is drawn with the unselected faces if any of them
+		//share it, and again with the selected faces. Lines come
+		//first, then points.
+		auto &indices = b->lineIndices; indices.clear();
+		indices.reserve(b->edges.size()+vN);
+		for(int pass=0;pass<2;pass++)
+		{
+			size_t n = indices.size();
+			unsigned f = 0, *e = b->edges.data();
+			for(unsigned i=0;i<b->edgeFacesEnd.size();i++)
+			{
+				unsigned f1 = b->edgeFacesEnd[i];
+				for(;f<f1;f++)
+				{
+					auto *tri = m_triangles[b->edgeFaces[f]];
+					if(tri->m_visible&&tri->m_selected==(pass==1))
+					{
+						indices.push_back(e[i*2]);
+						indices.push_back(e[i*2+1]); break;
+					}
+				}
+				f = f1;
+			}
+			b->lineCount[pass] = (unsigned)(indices.size()-n)/2;
+		}
+		for(int pass=0;pass<2;pass++)
+		{
+			size_t n = indices.size();
+			for(unsigned i=0;i<vN;i++)
+			{
+				auto *vp = m_vertices[i];
+				if(vp->m_visible&&vp->m_selected==(pass==1)) indices.push_back(i);
+			}
+			b->pointCount[pass] = (unsigned)(indices.size()-n);
+		}
+
+		gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,b->lines);
+		gl.BufferData(gl.ELEMENT_ARRAY_BUFFER,
+		indices.size()*sizeof(unsigned),indices.data(),gl.DYNAMIC_DRAW);
+		gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,0);
+	}
+
+	return true;
+	#endif
+}
+void Model::deleteDrawBuffers(DrawingBuffers* &b)
+{
+	if(!b) return;
+
+	auto &gl = model_draw_gl15; if(gl.init==1)
+	{
+		gl.DeleteBuffers(1,&b->vbo); gl.DeleteBuffers(1,&b->ibo);
+		gl.DeleteBuffers(1,&b->points); gl.DeleteBuffers(1,&b->lines);
+	}
+	delete b; b = nullptr;
+}
+void Model::invalidateDrawBuffers(int changeBits)
+{
+	auto f = [=](DrawingBuffers *b)
+	{
+		if(b){ b->changes|=changeBits; b->lineChanges|=changeBits; }
+	};
+	f(m_drawBuffers);
+	for(auto*ea:m_drawingContexts) f(ea->m_buffers);
+
+	//NEW: The proxy keeps selected vertices in their own clusters.
+	if(changeBits&(AddGeometry|AddOther|SelectionVertices)) m_drawProxySerial++;
+}
+
+//NEW: Makes DrawingProxy by vertex clustering. The vertices are put
+//into a grid and each cell's faces are collapsed onto the vertex that
+//is nearest their average. Faces that collapse are dropped. Selected
+//vertices are kept apart so the proxy follows the selection as it is
+//dragged. This runs on a worker thread, so it gets a copy of the data.
+struct model_draw_proxy_job
+{
+	std::vector<float> pos; //3 per vertex.
+	std::vector<char> sel; //Per vertex.
+	std::vector<unsigned> tris; //3 per triangle.
+	std::vector<int> mats; //Per triangle.
+
+	size_t target; unsigned serial;
+
+	DrawingProxy *operator()()
+	{
+		size_t vN = sel.size(), tN = mats.size();
+
+		float lo[3] = {+FLT_MAX,+FLT_MAX,+FLT_MAX};
+		float hi[3] = {-FLT_MAX,-FLT_MAX,-FLT_MAX};
+		for(size_t v=0;v<vN;v++) for(int i=0;i<3;i++)
+		{
+			lo[i] = std::min(lo[i],pos[v*3+i]);
+			hi[i] = std::max(hi[i],pos[v*3+i]);
+		}
+		float ext = 0;
+		for(int i=0;i<3;i++) ext = std::max(ext,hi[i]-lo[i]);
+		if(!(ext>0)) ext = 1;
+
+		//A surface crosses about 6g^2 cells of a g^3 grid and has
+		//about 2 faces per cell. If that's too many faces the grid
+		//is made coarser until it isn't.
+		std::vector<unsigned> cluster(vN),rep,out;
+		std::vector<double> sum;
+		std::unordered_map<uint64_t,unsigned> cells;
+		double g = std::max(4.0,sqrt(target/12.0));
+		for(int pass=0;pass<8;pass++,g*=0.75)
+		{
+			double s = g/ext; uint64_t d = (uint64_t)g+2;
+
+			cells.clear(); sum.clear();
+			for(size_t v=0;v<vN;v++)
+			{
+				float *p = &pos[v*3];
+				uint64_t key = 0;
+				for(int i=3;i-->0;) key = key*d+(uint64_t)((p[i]-lo[i])*s);
+				auto ins = cells.emplace(key*2+sel[v],(unsigned)cells.size());
+				unsigned c = ins.first->second;
+				if(ins.second) sum.resize(sum.size()+4);
+				for(int i=0;i<3;i++) sum[c*4+i]+=p[i];
+				sum[c*4+3]++; cluster[v] = c;
+			}
+			size_t cN = cells.size();
+			std::vector<double> best(cN,DBL_MAX); rep.assign(cN,0);
+			for(size_t v=0;v<vN;v++)
+			{
+				unsigned c = cluster[v]; double *m = &sum[c*4], dd = 0;
+				for(int i=0;i<3;i++)
+				{
+					double x = pos[v*3+i]-m[i]/m[3]; dd+=x*x;
+				}
+				if(dd<best[c]){ best[c] = dd; rep[c] = (unsigned)v; }
+			}
+
+			out.clear();
+			for(size_t t=0;t<tN;t++)
+			{
+				unsigned *tv = &tris[t*3];
+				unsigned a = cluster[tv[0]], b = cluster[tv[1]], c = cluster[tv[2]];
+				if(a==b||b==c||a==c) continue;
+				out.push_back((unsigned)t);
+				out.push_back(rep[a]); out.push_back(rep[b]); out.push_back(rep[c]);
+			}
+			if(out.size()/4<=target) break;
+		}
+
+		//Faces that collapse onto the same vertices are duplicates.
+		size_t fN = out.size()/4;
+		std::vector<std::array<unsigned,5>> keys(fN);
+		for(size_t f=0;f<fN;f++)
+		{
+			auto &k = keys[f]; unsigned *o = &out[f*4];
+			int m = mats[o[0]];
+			k[0] = m==-2?~0u:(unsigned)(m+1); //Ungrouped last.
+			k[1] = o[1]; k[2] = o[2]; k[3] = o[3]; k[4] = (unsigned)f;
+			std::sort(k.begin()+1,k.begin()+4);
+		}
+		std::sort(keys.begin(),keys.end());
+
+		auto *p = new DrawingProxy;
+		p->triangles = tN; p->vertices = vN; p->serial = serial;
+		p->faces.reserve(out.size());
+		for(size_t f=0;f<fN;f++)
+		{
+			auto &k = keys[f];
+			if(f&&std::equal(k.begin()+1,k.begin()+4,keys[f-1].begin()+1))
+			continue;
+
+			unsigned *o = &out[k[4]*4];
+			int m = mats[o[0]];
+			if(p->batches.empty()||p->batches.back().material!=m)
+			{
+				unsigned first = (unsigned)p->faces.size()/4;
+				p->batches.push_back({m,first,0});
+			}
+			p->batches.back().count++;
+			p->faces.insert(p->faces.end(),o,o+4);
+		}
+		return p;
+	}
+};
+
+DrawingProxy *Model::validateDrawProxy()
+{
+	size_t tN = m_triangles.size(), vN = m_vertices.size();
+	int limit = m_viewportUnits.proxy3d;
+	if(limit<=0||tN<=(size_t)limit) return nullptr;
+
+	if(m_drawProxyJob.valid()&&m_drawProxyJob.wait_for
+	(std::chrono::seconds(0))==std::future_status::ready)
+	{
+		delete m_drawProxy; m_drawProxy = m_drawProxyJob.get();
+	}
+
+	auto *p = m_drawProxy;
+	if(p&&(p->serial!=m_drawProxySerial||p->triangles!=tN||p->vertices!=vN))
+	{
+		p = nullptr; //Out of date.
+	}
+	if(!p&&!m_drawProxyJob.valid())
+	{
+		validateAnim(); //m_absSource
+
+		model_draw_proxy_job job;
+		job.target = std::max(1,limit/2);
+		job.serial = m_drawProxySerial;
+		job.pos.resize(vN*3); job.sel.resize(vN);
+		for(size_t v=0;v<vN;v++)
+		{
+			auto *vp = m_vertices[v];
+			for(int i=0;i<3;i++) job.pos[v*3+i] = (float)vp->m_absSource[i];
+			job.sel[v] = vp->m_selected;
+		}
+		job.tris.resize(tN*3); job.mats.assign(tN,-2);
+		for(size_t t=0;t<tN;t++)
+		{
+			auto *tp = m_triangles[t];
+			for(int i=0;i<3;i++) job.tris[t*3+i] = tp->m_vertexIndices[i];
+		}
+		for(auto*grp:m_groups)
+		{
+			int m = grp->m_materialIndex;
+			if(m>=(int)m_materials.size()) m = -1; //Paranoia.
+			for(int i:grp->m_triangleIndices) job.mats[i] = m;
+		}
+		m_drawProxyJob = std::async(std::launch::async,std::move(job));
+	}
+	return p;
+}
+void Model::_updateDrawProxy(DrawingProxy *p)
+{
+	validateAnim(); //m_absSource
+
+	size_t bN = p->batches.size();
+	p->counts.assign(bN*2,0);
+	for(size_t b=0;b<bN;b++)
+	{
+		auto &bt = p->batches[b];
+		for(unsigned f=bt.first;f<bt.first+bt.count;f++)
+		{
+			auto *tri = m_triangles[p->faces[f*4]];
+			if(tri->m_visible) p->counts[b*2+tri->m_selected]++;
+		}
+	}
+	std::vector<unsigned> next(bN*2); unsigned sum = 0;
+	for(size_t i=0;i<bN*2;i++){ next[i] = sum; sum+=p->counts[i]; }
+
+	p->arrays.resize(sum*3*8);
+	for(size_t b=0;b<bN;b++)
+	{
+		auto &bt = p->batches[b];
+		for(unsigned f=bt.first;f<bt.first+bt.count;f++)
+		{
+			unsigned *o = &p->faces[f*4];
+			auto *tri = m_triangles[o[0]];
+			if(!tri->m_visible) continue;
+
+			double *v[3], n[3];
+			for(int i=0;i<3;i++) v[i] = m_vertices[o[1+i]]->m_absSource;
+			calculate_normal(n,v[0],v[1],v[2]);
+
+			float *w = &p->arrays[next[b*2+tri->m_selected]++*3*8];
+			for(int i=0;i<3;i++,w+=8)
+			{
+				for(int j=0;j<3;j++)
+				{
+					w[j] = (float)v[i][j]; w[3+j] = (float)n[j];
+				}
+				w[6] = tri->m_s[i]; w[7] = tri->m_t[i];
+			}
+		}
+	}
+}
+
+//NEW: Draws validateLineBuffers' edges (GL_LINES) or vertices.
+static void model_draw_lines(DrawingBuffers *b, GLenum mode, int pass, const model_draw_frustum *f)
+{
+	if(f&&!b->lineChunked) //NEW
+	{
+		auto &c = b->lineChunks; c.clear();
+		unsigned *ii = b->lineIndices.data(), i = 0;
+		float *vp = b->positions.data();
+		for(int j=0;j<4;j++)
+		{
+			unsigned n = j<2?b->lineCount[j]*2:b->pointCount[j-2];
+			model_draw_chunk(c,ii,i,n,j<2?2:1,vp,3); i+=n;
+		}
+		b->lineChunked = true;
+	}
+
+	size_t first,count;
+	if(mode==GL_LINES)
+	{
+		first = pass?b->lineCount[0]*2:0; count = b->lineCount[pass]*2;
+	}
+	else
+	{
+		first = (b->lineCount[0]+b->lineCount[1])*2;
+		if(pass) first+=b->pointCount[0]; count = b->pointCount[pass];
+	}
+	if(!count) return;
+
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_CULL_FACE);
+
+	auto &gl = model_draw_gl15;
+	gl.BindBuffer(gl.ARRAY_BUFFER,b->points);
+	gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,b->lines);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3,GL_FLOAT,0,(void*)0);
+	model_draw_elements(mode,first,count,b->lineChunks,f);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	gl.BindBuffer(gl.ARRAY_BUFFER,0);
+	gl.BindBuffer(gl.ELEMENT_ARRAY_BUFFER,0);
+}
+
 void Model::drawLines(float a)
 {
 	//TESTING
 	//CAUTION: I don't know what the blend mode is
 	//at this point?
 	//https://github.com/zturtleman/mm3d/issues/95
+	//NEW: Unless culling, each edge is drawn once.
+	DrawingBuffers *b = nullptr;
+	if(~m_drawOptions&DO_BACKFACECULL)
+	if(validateLineBuffers(m_drawBuffers)) b = m_drawBuffers;
+	model_draw_frustum frustum, *f = nullptr;
+	if(b&&m_drawOptions&DO_FRUSTUM){ frustum.load(); f = &frustum; }
+
 	if(1!=a) glEnable(GL_BLEND);
 
 	//The goal of this is to not double-blend over
@@ -633,7 +1583,8 @@ void Model::drawLines(float a)
 
 		glColor4f(1,1,1,a); //white
 		if(a) //Hide?
-		_drawPolygons(0);
+		if(b) model_draw_lines(b,GL_LINES,0,f);
+		else _drawPolygons(0);
 
 	glDisable(GL_BLEND);
 
@@ -658,7 +1609,8 @@ void Model::drawLines(float a)
 		//FELT THE EXPERIMENTS WERE NO BETTER.
 
 		glColor4f(1,0,0,1); //red
-		_drawPolygons(1);
+		if(b) model_draw_lines(b,GL_LINES,1,f);
+		else _drawPolygons(1);
 
 	//glLineWidth(1.0);
 	glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
@@ -670,6 +1622,31 @@ void Model::drawVertices(float a)
 	//REMINDER: The reason for a (alpha) is
 	//primarily to hide unselected vertices.
 
+	//NEW: Unless culling _drawPolygons doesn't mark
+	//any vertices, so they can all come from buffers.
+	DrawingBuffers *b = nullptr;
+	if(!a||~m_drawOptions&DO_BACKFACECULL)
+	if(validateLineBuffers(m_drawBuffers)) b = m_drawBuffers;
+	if(b)
+	{
+		model_draw_frustum frustum, *f = nullptr;
+		if(m_drawOptions&DO_FRUSTUM){ frustum.load(); f = &frustum; }
+
+		if(a)
+		{
+			glPointSize(3);
+			glDepthFunc(GL_LESS);
+			glColor3ub(255,255,255);
+			model_draw_lines(b,GL_POINTS,0,f);
+		}
+		glPointSize(5);
+		glDepthFunc(GL_ALWAYS);
+		glColor3ub(255,0,0);
+		model_draw_lines(b,GL_POINTS,1,f);
+		glDepthFunc(GL_LEQUAL);
+		return;
+	}
+
 	if(!a) //Hide unselected?
 	{
 		//HACK: This should match the below
@@ -771,6 +1748,51 @@ void Model::drawVertices(float a)
 	glDepthFunc(GL_LEQUAL);
 	//glEnable(GL_DEPTH_TEST);
 }
+void Model::_drawDepthSort(double *point, DrawingContext *context)
+{
+	validateAnim();
+
+	int current = -1;
+	glEnable(GL_TEXTURE_2D);
+	glBegin(GL_TRIANGLES);
+	for(auto&ea:m_depthSort.sort(point))
+	{
+		Triangle *tri = m_triangles[ea.triangle];
+		if(!tri->m_visible) continue;
+
+		if(ea.material!=current)
+		{
+			glEnd();
+
+			current = ea.material;
+			Material *mat = m_materials[current];
+			glMaterialfv(GL_FRONT,GL_AMBIENT,mat->m_ambient);
+			glMaterialfv(GL_FRONT,GL_DIFFUSE,mat->m_diffuse);
+			glMaterialfv(GL_FRONT,GL_SPECULAR,mat->m_specular);
+			glMaterialfv(GL_FRONT,GL_EMISSION,mat->m_emissive);
+			glMaterialf(GL_FRONT,GL_SHININESS,mat->m_shininess);
+
+			//Like bsptree_setMaterial, m_texture is used without a context.
+			glBindTexture(GL_TEXTURE_2D,
+			context?context->m_matTextures[current]:mat->m_texture);
+			glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,
+			mat->m_sClamp?GL_CLAMP:GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,
+			mat->m_tClamp?GL_CLAMP:GL_REPEAT);
+
+			glBegin(GL_TRIANGLES);
+		}
+
+		for(int i=0;i<3;i++)
+		{
+			glTexCoord2f(tri->m_s[i],tri->m_t[i]);
+			glNormal3dv(tri->m_normalSource[i]);
+			glVertex3dv(m_vertices[tri->m_vertexIndices[i]]->m_absSource);
+		}
+	}
+	glEnd();
+	glDisable(GL_TEXTURE_2D);
+}
 void Model::_drawPolygons(int pass, bool mark)
 {	
 	validateAnim();
@@ -28,6 +28,8 @@
 
 #ifdef MM3D_EDIT
 #include "modelundo.h"
+#include "texmgr.h"
+#include "texatlas.h"
 #endif // MM3D_EDIT
 
 #ifdef MM3D_EDIT
@@ -262,6 +264,8 @@ void Model::removeTriangleFromGroup(unsigned groupNum, unsigned triangleNum)
 		{
 			c.erase(it);
 
+			m_changeBits |= AddOther; //NEW
+
 			if(m_undoEnabled)
 			{
 				auto undo = new MU_RemoveFromGroup;
@@ -503,3 +507,135 @@ int Model::mergeIdenticalMaterials()
 	return merged;
 }
 
+int Model::bakeTextureAtlas(const int_list &materials, const char *filename, int maxSize, int padding)
+{
+	if(!filename||!*filename) return -1;
+
+	enum{ max_tiles=8 };
+
+	std::vector<TextureAtlasItem> items;
+	int_list mats; std::vector<int> origins; //s0,t0
+	for(int m:materials)
+	{
+		if(m<0||m>=(int)m_materials.size()) continue;
+		if(std::find(mats.begin(),mats.end(),m)!=mats.end()) continue;
+
+		Material *mat = m_materials[m];
+		if(mat->m_type!=Material::MATTYPE_TEXTURE) continue;
+		Texture *tex = getTextureData(m);
+		if(!tex||tex->m_isBad||tex->m_data.empty()) continue;
+
+		bool used = false, projected = false;
+		float st[2][2] = {{FLT_MAX,FLT_MAX},{-FLT_MAX,-FLT_MAX}};
+		for(auto*grp:m_groups) if(grp->m_materialIndex==m)
+		for(int i:grp->m_triangleIndices)
+		{
+			Triangle *tri = m_triangles[i];
+			if(tri->m_projection>=0) projected = true;
+			for(int v=0;v<3;v++)
+			{
+				st[0][0] = std::min(st[0][0],tri->m_s[v]);
+				st[0][1] = std::min(st[0][1],tri->m_t[v]);
+				st[1][0] = std::max(st[1][0],tri->m_s[v]);
+				st[1][1] = std::max(st[1][1],tri->m_t[v]);
+			}
+			used = true;
+		}
+		if(!used) continue;
+		if(projected)
+		{
+			log_warning("not baking material %d, it has projected triangles\n",m);
+			continue;
+		}
+
+		TextureAtlasItem it;
+		it.tex = tex;
+		it.clampS = mat->m_sClamp;
+		it.clampT = mat->m_tClamp;
+		//Clamping can't be baked into the coordinates without changing
+		//how triangles that cross the edge are interpolated.
+		bool clamped = false;
+		for(int i=0;i<2;i++) if(i?it.clampT:it.clampS)
+		{
+			if(st[0][i]<-0.0001f||st[1][i]>1.0001f) clamped = true;
+		}
+		if(clamped)
+		{
+			log_warning("not baking material %d, it's clamped outside 0-1\n",m);
+			continue;
+		}
+		int o[2], tiles[2];
+		for(int i=0;i<2;i++) if(i?it.clampT:it.clampS)
+		{
+			o[i] = 0; tiles[i] = 1;
+		}
+		else //The epsilon keeps 0-1 coordinates on one tile.
+		{
+			o[i] = (int)floorf(st[0][i]+0.0001f);
+			tiles[i] = std::max(1,(int)ceilf(st[1][i]-0.0001f)-o[i]);
+		}
+		if(tiles[0]>max_tiles||tiles[1]>max_tiles)
+		{
+			log_warning("not baking material %d, it repeats too many times\n",m);
+			continue;
+		}
+		it.tilesS = tiles[0]; it.tilesT = tiles[1];
+		items.push_back(it);
+		mats.push_back(m);
+		origins.push_back(o[0]); origins.push_back(o[1]);
+	}
+	if(items.empty()) return 0;
+
+	int w,h;
+	if(!texture_atlas_pack(items,padding,maxSize,w,h))
+	{
+		log_warning("textures don't fit in a %dx%d atlas\n",maxSize,maxSize);
+		return 0;
+	}
+
+	auto *tm = TextureManager::getInstance();
+	Texture *atlas = texture_atlas_blit(items,padding,w,h);
+	if(tm->write(atlas,filename))
+	{
+		delete atlas; return -1;
+	}
+	atlas = tm->cacheTexture(filename,atlas);
+
+	int n = addTexture(atlas);
+	Material *first = m_materials[mats[0]];
+	setTextureAmbient(n,first->m_ambient);
+	setTextureDiffuse(n,first->m_diffuse);
+	setTextureSpecular(n,first->m_specular);
+	setTextureEmissive(n,first->m_emissive);
+	setTextureShininess(n,first->m_shininess);
+	setTextureSClamp(n,true);
+	setTextureTClamp(n,true);
+
+	for(size_t i=0;i<items.size();i++)
+	{
+		auto &it = items[i];
+		float s0 = (float)origins[i*2+0], t0 = (float)origins[i*2+1];
+		float sw = (float)it.tex->m_width/w, th = (float)it.tex->m_height/h;
+		float sx = (float)it.x/w, ty = (float)it.y/h;
+
+		for(unsigned g=0;g<m_groups.size();g++)
+		if(m_groups[g]->m_materialIndex==mats[i])
+		{
+			for(int j:m_groups[g]->m_triangleIndices)
+			{
+				Triangle *tri = m_triangles[j];
+				for(int v=0;v<3;v++)
+				{
+					float s = tri->m_s[v], t = tri->m_t[v];
+					setTextureCoords(j,v,sx+(s-s0)*sw,ty+(t-t0)*th);
+				}
+			}
+			setGroupTextureId(g,n);
+		}
+	}
+
+	std::sort(mats.begin(),mats.end());
+	for(size_t i=mats.size();i-->0;) deleteTexture(mats[i]);
+
+	return (int)items.size();
+}
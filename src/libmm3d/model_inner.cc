@@ -24,6 +24,7 @@
 
 #include "model.h"
 #include "texture.h"
+#include "texmgr.h"
 #include "log.h"
 
 static bool model_inner_recycle = true;
@@ -487,7 +488,8 @@ Model::Material::Material()
 	  m_sClamp(false),
 	  m_tClamp(false),
 	  m_texture(0),
-	  m_textureData(nullptr)
+	  m_textureData(nullptr),
+	  m_texturePending(false)
 {
 	s_allocated++;
 }
@@ -496,6 +498,7 @@ Model::Material::~Material()
 {
 	s_allocated--;
 	// Do NOT free m_textureData.  TextureManager does that
+	setTextureData(nullptr);
 }
 
 void Model::Material::init()
@@ -503,13 +506,23 @@ void Model::Material::init()
 	m_name.clear(); //ABUSED (init?)
 	m_filename.clear(); //ABUSED (init?)
 	m_alphaFilename.clear(); //ABUSED (init?)
-	m_textureData	= nullptr;
+	setTextureData(nullptr);
+	m_texturePending = false;
 	m_texture		 = 0;
 	m_type			 = MATTYPE_TEXTURE;
 	m_sClamp		  = false;
 	m_tClamp		  = false;
 }
 
+void Model::Material::setTextureData(Texture *tex)
+{
+	if(tex==m_textureData) return;
+
+	TextureManager::addTextureRef(tex);
+	TextureManager::removeTextureRef(m_textureData);
+	m_textureData = tex;
+}
+
 int Model::Material::flush()
 {
 	int c = 0;
@@ -546,6 +559,8 @@ Model::Material *Model::Material::get()
 
 void Model::Material::release()
 {
+	setTextureData(nullptr); //Let TextureManager evict it.
+
 	if(model_inner_recycle)
 	{
 		s_recycle.push_back(this);
@@ -1341,6 +1341,9 @@ bool Model::mergeModels(const Model *model, bool textures, AnimationMergeE anima
 	{
 		TextureManager *texmgr = TextureManager::getInstance();
 
+		auto &emb = model->m_embeddedTextures; //NEW
+		m_embeddedTextures.insert(m_embeddedTextures.end(),emb.begin(),emb.end());
+
 		count = model->getTextureCount();
 		for(n = 0; n<count; n++)
 		{
@@ -26,6 +26,7 @@
 #include "log.h"
 #include "texture.h"
 #include "texmgr.h"
+#include "texscale.h"
 #include "translate.h"
 
 #include "mm3dport.h"
@@ -37,6 +38,79 @@
 
 int Model::s_glTextures = 0;
 
+static int model_texture_anisotropy()
+{
+	int anisof = 0;
+	glGetIntegerv(0x84FF,&anisof); //GL_TEXTURE_MAX_ANISOTROPY_EXT
+	//TODO: Add to preferences.
+	return std::min(16,anisof);
+}
+static void model_texture_upload(Texture *tex, GLuint texture, int anisof)
+{
+	glBindTexture(GL_TEXTURE_2D,texture);
+
+	//https://github.com/zturtleman/mm3d/issues/85
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,
+			/*GL_LINEAR*/GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,
+			GL_LINEAR);
+
+	glTexParameteri(GL_TEXTURE_2D,0x84FE,anisof); //GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+
+	texture_scale_upload(tex); //gluBuild2DMipmaps
+}
+
+DrawingShareGroup *DrawingShareGroup::get(ContextT share)
+{
+	static std::unordered_map<ContextT,DrawingShareGroup> groups;
+
+	return &groups[share];
+}
+int DrawingShareGroup::acquire(Texture *tex)
+{
+	if(m_anisotropy==-1) m_anisotropy = model_texture_anisotropy();
+
+	Object &o = m_objects[tex];
+	if(!o.refs++)
+	{
+		GLuint texture; glGenTextures(1,&texture);
+		o.texture = (int)texture;
+		o.revision = tex->m_revision-1; //Upload.
+		m_textures[o.texture] = tex;
+
+		Model::s_glTextures++;
+		log_debug("GL textures: %d\n",Model::s_glTextures);
+	}
+	if(o.revision!=tex->m_revision)
+	{
+		o.revision = tex->m_revision;
+
+		log_debug("uploaded texture %s as %d\n",tex->m_name.c_str(),o.texture);
+
+		model_texture_upload(tex,o.texture,m_anisotropy);
+	}
+	return o.texture;
+}
+void DrawingShareGroup::release(int texture)
+{
+	auto it = m_textures.find(texture);
+	if(it==m_textures.end()) return; //-1?
+
+	auto jt = m_objects.find(it->second);
+	if(--jt->second.refs) return;
+
+	GLuint tn = texture; glDeleteTextures(1,&tn);
+
+	Model::s_glTextures--;
+	log_debug("GL textures: %d\n",Model::s_glTextures);
+
+	m_objects.erase(jt); m_textures.erase(it);
+}
+int DrawingShareGroup::replace(int texture, Texture *tex)
+{
+	int ret = acquire(tex); release(texture); return ret;
+}
+
 bool Model::loadTextures(ContextT context)
 {
 	//LOG_PROFILE(); //???
@@ -44,95 +118,73 @@ bool Model::loadTextures(ContextT context)
 	DrawingContext *drawContext = nullptr;
 	if(context)
 	{
-		deleteGlTextures(context);
 		drawContext = getDrawingContext(context);
-		drawContext->m_fileTextures.clear();
-		drawContext->m_matTextures.clear();
 	}
+	auto &pending = drawContext?drawContext->m_pendingTextures:m_pendingTextures;
+	pending.clear();
 
-	int anisof = 0;
-	glGetIntegerv(0x84FF,&anisof); //GL_TEXTURE_MAX_ANISOTROPY_EXT
-	//TODO: Add to preferences.
-	anisof = std::min(16,anisof);
+	//NEW: Texture objects are shared by every model in the context's
+	//share group. The old references are released after the new ones
+	//are made so that textures that haven't changed aren't reuploaded.
+	auto *group = DrawingShareGroup::get(drawContext?drawContext->m_share:nullptr);
+	auto &bound = drawContext?drawContext->m_matTextures:m_matTextures;
+	MaterialTextureList old; old.swap(bound);
+
+	auto *tm = TextureManager::getInstance();
+
+	//NEW: Get all of the textures decoding on worker threads before
+	//waiting on any of them. The ones that aren't ready yet are given
+	//placeholders that draw replaces as they come in.
+	for(auto*ea:m_materials)
+	if(ea->m_filename[0]&&ea->m_type==Model::Material::MATTYPE_TEXTURE)
+	{
+		ea->m_texturePending = tm->loadTextureAsync(ea->m_filename.c_str());
+	}
 
 	for(unsigned t = 0; t<m_materials.size(); t++)
 	{
-		if(drawContext)
-		{
-			drawContext->m_matTextures.push_back(-1);
-		}
+		bound.push_back(-1);
 
 		if(m_materials[t]->m_filename[0] 
 			  &&m_materials[t]->m_type==Model::Material::MATTYPE_TEXTURE)
 		{
-			Texture *tex = TextureManager::getInstance()->getTexture(m_materials[t]->m_filename.c_str());
-
-			if(!tex)
+			Texture *tex = nullptr;
+			
+			if(m_materials[t]->m_texturePending)
+			{
+				if(tm->isTexturePending(m_materials[t]->m_filename.c_str()))
+				{
+					pending.push_back(t);
+				}
+				else m_materials[t]->m_texturePending = false;
+			}
+			if(!m_materials[t]->m_texturePending)
 			{
+				tex = tm->getTexture(m_materials[t]->m_filename.c_str());
+
+				if(!tex)
+				{
 #ifdef MM3D_EDIT
-				std::string msg = TRANSLATE("LowLevel","Could not load texture");
-				msg += std::string(" ")+m_materials[t]->m_filename;
-				model_status(this,StatusError,STATUSTIME_LONG,msg.c_str());
+					std::string msg = TRANSLATE("LowLevel","Could not load texture");
+					msg += std::string(" ")+m_materials[t]->m_filename;
+					model_status(this,StatusError,STATUSTIME_LONG,msg.c_str());
 #endif // MM3D_EDIT
-				tex = TextureManager::getInstance()->getDefaultTexture(m_materials[t]->m_filename.c_str());
+				}
+			}
+			if(!tex)
+			{
+				tex = tm->getDefaultTexture(m_materials[t]->m_filename.c_str());
 			}
 			
 			if(tex)
 			{
-				m_materials[t]->m_textureData = tex;
-
-				if(drawContext)
-				{
-					int texNum = -1;
-					FileTextureMap::iterator it = drawContext->m_fileTextures.find(m_materials[t]->m_filename);
-					if(it!=drawContext->m_fileTextures.end())
-					{
-						texNum = it->second;
-					}
-					else
-					{
-						glGenTextures(1,&(m_materials[t]->m_texture));
-						s_glTextures++;
-						log_debug("GL textures: %d\n",s_glTextures);
-
-						drawContext->m_fileTextures[m_materials[t]->m_filename] =
-							m_materials[t]->m_texture;
-
-						texNum = m_materials[t]->m_texture;
-					}
-					drawContext->m_matTextures[t] = texNum;
-				}
-				else
-				{
-					glGenTextures(1,&m_materials[t]->m_texture);
-					s_glTextures++;
-					log_debug("GL textures: %d\n",s_glTextures);
-				}
-
-				log_debug("loaded texture %s as %d\n",tex->m_name.c_str(),m_materials[t]->m_texture);
-
-				//if(context)
-				{
-					glBindTexture(GL_TEXTURE_2D,m_materials[t]->m_texture);
-
-					//https://github.com/zturtleman/mm3d/issues/85
-					glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,
-							/*GL_LINEAR*/GL_LINEAR_MIPMAP_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,
-							GL_LINEAR);
-
-					glTexParameteri(GL_TEXTURE_2D,0x84FE,anisof); //GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+				m_materials[t]->setTextureData(tex);
 
-					GLuint format = tex->m_format==Texture::FORMAT_RGBA ? GL_RGBA : GL_RGB;
+				bound[t] = group->acquire(tex);
 
-					//https://github.com/zturtleman/mm3d/issues/85
-					glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+				if(!drawContext) m_materials[t]->m_texture = bound[t];
 
-					gluBuild2DMipmaps(GL_TEXTURE_2D,format, //GLU
-							tex->m_width,tex->m_height,
-							format,GL_UNSIGNED_BYTE,
-							tex->m_data.data());
-				}
+				log_debug("loaded texture %s as %d\n",tex->m_name.c_str(),bound[t]);
 			}
 			else
 			{
@@ -141,6 +193,8 @@ bool Model::loadTextures(ContextT context)
 		}
 	}
 
+	for(int ea:old) group->release(ea);
+
 	//REMOVE ME
 	if(drawContext)
 	{
@@ -153,6 +207,68 @@ bool Model::loadTextures(ContextT context)
 	return true;
 }
 
+bool Model::loadPendingTextures(ContextT context)
+{
+	DrawingContext *drawContext = nullptr;
+	if(context)
+	{
+		drawContext = getDrawingContext(context);
+	}
+	auto &pending = drawContext?drawContext->m_pendingTextures:m_pendingTextures;
+	if(pending.empty()) return false;
+
+	auto *tm = TextureManager::getInstance();
+	
+	tm->finishTextures();
+
+	auto *group = DrawingShareGroup::get(drawContext?drawContext->m_share:nullptr);
+	auto &bound = drawContext?drawContext->m_matTextures:m_matTextures;
+
+	bool ret = false, bsp = false;
+
+	for(size_t i=pending.size();i-->0;)
+	{
+		unsigned t = pending[i];
+		if(t>=m_materials.size()||t>=bound.size()) //Paranoia
+		{
+			pending.erase(pending.begin()+i); continue;
+		}
+		auto *mat = m_materials[t];
+		if(mat->m_texturePending)
+		{
+			if(tm->isTexturePending(mat->m_filename.c_str()))
+			{
+				continue; 
+			}
+			bsp|=!getTextureData(t)->m_isBad;
+		}
+		pending.erase(pending.begin()+i);
+
+		//getTextureData has done this if the texture has failed.
+		Texture *tex = mat->m_textureData; if(tex->m_isBad) continue;
+
+		//The placeholder's texture object is shared, so it's swapped.
+		bound[t] = group->replace(bound[t],tex);
+
+		if(!drawContext) mat->m_texture = bound[t];
+
+		log_debug("loaded texture %s as %d\n",tex->m_name.c_str(),bound[t]);
+
+		ret = true;
+	}
+
+	//The placeholders aren't RGBA.
+	if(bsp) m_validBspTree = false;
+
+	if(bsp) texture_manager_do_warning(this); return ret;
+}
+bool Model::hasPendingTextures(ContextT context)
+{
+	if(context) return !getDrawingContext(context)->m_pendingTextures.empty();
+
+	return !m_pendingTextures.empty();
+}
+
 #ifdef MM3D_EDIT
 
 int Model::addTexture(Texture *tex)
@@ -170,7 +286,7 @@ int Model::addTexture(Texture *tex)
 		material->m_name = tex->m_name;
 		material->m_type = Material::MATTYPE_TEXTURE;
 		material->m_texture = 0;
-		material->m_textureData = tex;
+		material->setTextureData(tex);
 		material->m_filename = tex->m_filename;
 		for(int m = 0; m<3; m++)
 		{
@@ -218,7 +334,7 @@ int Model::addColorMaterial(const char *name)
 	material->m_name = name;
 	material->m_type = Material::MATTYPE_BLANK;
 	material->m_texture = 0;
-	material->m_textureData = nullptr;
+	material->setTextureData(nullptr);
 	material->m_filename = "";
 	for(int m = 0; m<3; m++)
 	{
@@ -475,11 +591,12 @@ void Model::setMaterialTexture(unsigned textureId,Texture *tex)
 		if(m_undoEnabled)
 		{
 			auto undo = new MU_SetMaterialTexture;
-			undo->setMaterialTexture(textureId,tex,m_materials[textureId]->m_textureData);
+			undo->setMaterialTexture(textureId,tex,getTextureData(textureId));
 			sendUndo(undo/*,true*/);
 		}
 
-		m_materials[textureId]->m_textureData = tex;
+		m_materials[textureId]->setTextureData(tex);
+		m_materials[textureId]->m_texturePending = false;
 		m_materials[textureId]->m_filename = tex->m_filename;
 		m_materials[textureId]->m_type = Material::MATTYPE_TEXTURE;
 
@@ -495,11 +612,12 @@ void Model::removeMaterialTexture(unsigned textureId)
 		if(m_undoEnabled)
 		{
 			auto undo = new MU_SetMaterialTexture;
-			undo->setMaterialTexture(textureId,nullptr,m_materials[textureId]->m_textureData);
+			undo->setMaterialTexture(textureId,nullptr,getTextureData(textureId));
 			sendUndo(undo/*,true*/);
 		}
 
-		m_materials[textureId]->m_textureData = nullptr;
+		m_materials[textureId]->setTextureData(nullptr);
+		m_materials[textureId]->m_texturePending = false;
 		m_materials[textureId]->m_filename = "";
 		m_materials[textureId]->m_type = Material::MATTYPE_BLANK;
 
@@ -588,7 +706,30 @@ Texture *Model::getTextureData(unsigned textureId)
 {
 	if(textureId>=0&&textureId<m_materials.size())
 	{
-		return m_materials[textureId]->m_textureData;
+		auto *mat = m_materials[textureId];
+
+		//NEW: Wait on loadTextures's worker thread?
+		if(mat->m_texturePending)
+		{
+			mat->m_texturePending = false;
+
+			const char *fn = mat->m_filename.c_str();
+			if(Texture *tex=TextureManager::getInstance()->getTexture(fn))
+			{
+				mat->setTextureData(tex);
+			}
+			else
+			{
+#ifdef MM3D_EDIT
+				std::string msg = TRANSLATE("LowLevel","Could not load texture");
+				msg += std::string(" ")+mat->m_filename;
+				model_status(this,StatusError,STATUSTIME_LONG,msg.c_str());
+#endif // MM3D_EDIT
+				log_error("Could not load texture %s\n",fn);
+			}
+		}
+
+		return mat->m_textureData;
 	}
 	else
 	{
@@ -757,6 +898,8 @@ DrawingContext *Model::getDrawingContext(ContextT context)
 
 	DrawingContext *drawContext = new DrawingContext;
 	drawContext->m_context = context;
+	drawContext->m_share = nullptr;
+	drawContext->m_buffers = nullptr;
 	drawContext->m_valid = false;
 	m_drawingContexts.push_back(drawContext);
 
@@ -773,19 +916,37 @@ void Model::invalidateTextures() //OVERKILL
 
 void Model::deleteGlTextures(ContextT context)
 {
-	DrawingContext *drawContext = getDrawingContext(context);
-	for(auto&ea:drawContext->m_fileTextures)
+	DrawingContext *drawContext = nullptr;
+	if(context)
 	{
-		int texId = ea.second; if(texId>0)
-		{
-			glDeleteTextures(1,(GLuint*)&texId);
-			s_glTextures--;
-			log_debug("GL textures: %d\n",s_glTextures);
-		}
+		drawContext = getDrawingContext(context);
 	}
-	drawContext->m_fileTextures.clear();
-	drawContext->m_matTextures.clear();
-	drawContext->m_valid = false;
+	auto *group = DrawingShareGroup::get(drawContext?drawContext->m_share:nullptr);
+	auto &bound = drawContext?drawContext->m_matTextures:m_matTextures;
+	for(int ea:bound) group->release(ea);
+	bound.clear();
+
+	if(drawContext)
+	{
+		drawContext->m_pendingTextures.clear();
+		drawContext->m_valid = false;
+	}
+	else
+	{
+		for(auto*ea:m_materials) ea->m_texture = 0;
+		m_pendingTextures.clear();
+		m_validContext = false;
+	}
+
+	deleteDrawBuffers(drawContext?drawContext->m_buffers:m_drawBuffers); //NEW
+}
+
+void Model::setContextShare(ContextT context, ContextT share)
+{
+	DrawingContext *drawContext = getDrawingContext(context);
+	if(drawContext->m_share==share) return;
+
+	deleteGlTextures(context); drawContext->m_share = share;
 }
 
 void Model::removeContext(ContextT context)
@@ -794,8 +955,8 @@ void Model::removeContext(ContextT context)
 	if((*it)->m_context==context)
 	{
 		deleteGlTextures(context);
-		m_drawingContexts.erase(it);
 		delete *it;
+		m_drawingContexts.erase(it);
 		return;
 	}
 }
@@ -217,6 +217,17 @@ protected:
 //files so finding a file doesn't involve wading through
 //hundreds of source code files!!
 
+class Mm3dOptions : public ModelFilter::Options
+{
+public:
+
+	// Store texture files in the model. Textures that were
+	// read from a model's embedded textures are always kept.
+	bool m_embedTextures = false;
+
+	virtual void setOptionsFromModel(Model*); //mm3dfilter.cc
+};
+
 class Ms3dOptions : public ModelFilter::Options
 {
 public:
@@ -25,6 +25,7 @@
 #include "modelfilter.h"
 #include "datadest.h"
 #include "datasource.h"
+#include "textdest.h"
 
 //#include "objfilter.h"
 class ObjFilter : public ModelFilter
@@ -72,11 +73,34 @@ public:
 	};
 	typedef std::vector<MaterialGroupT> MaterialGroupList;
 
+	// A run of whole lines that is parsed on its own thread. Relative
+	// (negative) face indices are counted from the start of the chunk
+	// and listed in m_vFixups/m_vtFixups so readFile can rebase them
+	// once the vertex counts of the preceding chunks are known.
+	struct ChunkT
+	{
+		const char *m_begin,*m_end;
+
+		std::vector<float> m_coords; //xyz
+		UvDataList m_uvs;
+
+		struct FaceT{ unsigned corner,count; bool tex; };
+		std::vector<FaceT> m_faces;
+		int_list m_v,m_vt; //One per corner.
+		std::vector<size_t> m_vFixups,m_vtFixups;
+
+		// Group/material lines are stateful so readFile replays
+		// them in order between the faces.
+		struct DirectiveT{ size_t face; const char *line; size_t len; };
+		std::vector<DirectiveT> m_directives;
+
+		int m_vertexLines,m_faceLines,m_groupLines,m_badUvLines;
+	};
+
 protected:
-	bool readLine(char *line);
-	bool readVertex(char *line);
-	bool readTextureCoord(char *line);
-	bool readFace(char *line);
+	static void parseChunk(ChunkT *chunk);
+
+	bool addFace(const int *vlist, const int *vtlist, unsigned count, bool tex);
 	bool readGroup(char *line);
 	bool readLibrary(char *line);
 	bool readMaterial(char *line);
@@ -95,7 +119,7 @@ protected:
 	Model		 *m_model;
 	ObjOptions  *m_options;
 	DataSource  *m_src;
-	DataDest	 *m_dst;
+	TextDest	 *m_dst;
 	int			  m_curGroup;
 	int			  m_curMaterial;
 	bool			 m_needGroup;
@@ -123,14 +147,112 @@ protected:
 #include "filtermgr.h"
 #include "mm3dport.h"
 
-static void objfilter_replace(char *str,char this_char,char that_char)
+static void objfilter_replace(char *str,size_t len,char this_char,char that_char)
 {
-	for(size_t t=strlen(str);t-->0;)
+	for(size_t t=len;t-->0;)
 	{
 		if(str[t]==this_char) str[t] = that_char;
 	}
 }
 
+// Files smaller than this are parsed on one thread.
+enum{ objfilter_chunk_min=1024*1024 };
+
+// Parses an integer the way sscanf("%d") does, without crossing e.
+// Returns nullptr if there aren't any digits.
+static const char *objfilter_strtol(const char *p, const char *e, int &out)
+{
+	while(p<e&&isspace(*p)) p++;
+
+	bool neg = false;
+	if(p<e&&(*p=='-'||*p=='+')) neg = *p++=='-';
+
+	if(p==e||(unsigned)(*p-'0')>9) return nullptr;
+
+	int i = 0;
+	for(;p<e&&(unsigned)(*p-'0')<=9;p++) i = i*10+(*p-'0');
+
+	out = neg?-i:i; return p;
+}
+
+// Parses a float the way sscanf("%f") does, without crossing e,
+// except that ',' is accepted as a decimal point (objfilter_replace
+// used to do that.) Returns nullptr if there isn't a number.
+//
+// Decimal numbers with up to 15 significant digits and a small
+// exponent are computed with a single exact double operation, i.e.
+// correctly rounded, and then rounded to float. If that second rounding
+// could be a tie the number is handed off to strtof, as are hex
+// numbers, inf, nan, etc.
+static const char *objfilter_strtof(const char *p, const char *e, float &out)
+{
+	static const double pow10[] = 
+	{
+		1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,
+		1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22
+	};
+
+	while(p<e&&isspace(*p)) p++;
+
+	const char *s = p;
+
+	bool neg = false;
+	if(p<e&&(*p=='-'||*p=='+')) neg = *p++=='-';
+
+	uint64_t m = 0; int digits = 0, exp10 = 0; bool any = false;
+
+	for(;p<e&&(unsigned)(*p-'0')<=9;p++,any=true)
+	{
+		if(m||*p!='0') digits++; m = m*10+(*p-'0');
+
+		if(digits>15) goto slow;
+	}
+	if(p<e&&(*p=='.'||*p==','))
+	{
+		for(p++;p<e&&(unsigned)(*p-'0')<=9;p++,any=true)
+		{
+			if(m||*p!='0') digits++; m = m*10+(*p-'0'); exp10--;
+
+			if(digits>15) goto slow;
+		}
+	}
+	if(!any||p<e&&(*p=='x'||*p=='X')) goto slow;
+
+	if(p+1<e&&(*p=='e'||*p=='E'))
+	{
+		const char *q = p+1; int x;
+		if((unsigned)(*q-'0')<=9||(*q=='-'||*q=='+')&&q+1<e&&(unsigned)(q[1]-'0')<=9)
+		{
+			q = objfilter_strtol(q,e,x); if(x<-400||x>400) goto slow;
+
+			exp10+=x; p = q;
+		}
+	}
+	if(exp10<-22||exp10>22) goto slow;
+	{
+		double d = (double)m;
+		d = exp10<0?d/pow10[-exp10]:d*pow10[exp10];
+
+		uint64_t bits; memcpy(&bits,&d,sizeof(bits));
+		if((bits&0x1FFFFFFF)==0x10000000) goto slow; //Tie?
+		if(d>FLT_MAX||d&&d<FLT_MIN) goto slow; //Denormal?
+
+		out = (float)(neg?-d:d); return p;
+	}
+
+slow: char buf[128]; size_t len = 0;
+	for(p=s;p<e&&len<sizeof(buf)-1&&!isspace(*p);p++)
+	{
+		buf[len++] = *p==','?'.':*p;
+	}
+	buf[len] = '\0';
+
+	char *q; float f = strtof(buf,&q);
+	if(q==buf) return nullptr;
+
+	out = f; return s+(q-buf);
+}
+
 ObjFilter::ObjMaterial::ObjMaterial()
 	: name(""),
 	  shininess(0.0f),
@@ -177,11 +299,100 @@ Model::ModelErrorE ObjFilter::readFile(Model *model, const char *const filename)
 	m_uvList.clear();
 	m_mgList.clear();
 
-	char line[1024];
-	while(m_src->readLine(line,sizeof(line)))
+	//NOTE: The whole file is read into one buffer (through the
+	//DataSource so FileFactory still works) and then split on line
+	//boundaries into chunks that are parsed in parallel.
+	size_t size = m_src->getFileSize();
+	std::vector<char> buf(size+1);
+	if(size&&!m_src->readBytes(buf.data(),size))
 	{
-		line[sizeof(line)-1] = '\0';
-		readLine(line);
+		if(m_src->unexpectedEof()) return Model::ERROR_UNEXPECTED_EOF;
+
+		return errnoToModelError(m_src->getErrno(),Model::ERROR_FILE_READ);
+	}
+	buf[size] = '\0';
+
+	size_t n = std::thread::hardware_concurrency();
+	n = std::max<size_t>(1,std::min<size_t>(n,size/objfilter_chunk_min));
+
+	std::vector<ChunkT> chunks(n);
+	const char *p = buf.data(), *e = p+size;
+	for(size_t i=0;i<n;i++)
+	{
+		const char *q = e;
+		if(i+1<n)
+		{
+			q = std::max<const char*>(p,buf.data()+size/n*(i+1));
+			q = (const char*)memchr(q,'\n',e-q);
+			q = q?q+1:e;
+		}
+		chunks[i].m_begin = p; chunks[i].m_end = p = q;
+	}
+	std::vector<std::thread> pool;
+	for(size_t i=1;i<n;i++)
+	pool.emplace_back(parseChunk,&chunks[i]);
+	parseChunk(&chunks[0]);
+	for(auto&ea:pool) ea.join();
+
+	// Merge: vertices and texture coordinates are appended in file
+	// order, relative indices are rebased, then faces are replayed.
+	size_t vcount = 0, tcount = 0, uvcount = 0;
+	for(auto&ea:chunks)
+	{
+		vcount+=ea.m_coords.size()/3; uvcount+=ea.m_uvs.size();
+
+		for(auto&f:ea.m_faces) if(f.count>=3) tcount+=f.count-2;
+	}
+	m_model->reserveVertices(m_model->getVertexCount()+vcount);
+	m_model->reserveTriangles(m_model->getTriangleCount()+tcount);
+	m_uvList.reserve(uvcount);
+
+	int badUvLines = 0;
+	for(auto&ea:chunks)
+	{
+		int vbase = m_model->getVertexCount();
+		int vtbase = (int)m_uvList.size();
+
+		auto *xyz = ea.m_coords.data();
+		for(size_t i=ea.m_coords.size()/3;i-->0;xyz+=3)
+		{
+			m_model->addVertex(xyz[0],xyz[1],xyz[2]);
+		}
+		m_uvList.insert(m_uvList.end(),ea.m_uvs.begin(),ea.m_uvs.end());
+
+		for(size_t i:ea.m_vFixups) ea.m_v[i]+=vbase;
+		for(size_t i:ea.m_vtFixups) ea.m_vt[i]+=vtbase;
+
+		m_vertices+=ea.m_vertexLines;
+		m_faces+=ea.m_faceLines;
+		m_groups+=ea.m_groupLines;
+		badUvLines+=ea.m_badUvLines;
+	}
+	if(badUvLines)
+	{
+		log_warning("could not read 2 texture coordinates from %d lines\n",badUvLines);
+	}
+	for(auto&ea:chunks)
+	{
+		auto d = ea.m_directives.begin(), dd = ea.m_directives.end();
+		for(size_t f=0;f<=ea.m_faces.size();f++)
+		{
+			for(;d!=dd&&d->face==f;d++)
+			{
+				std::string line(d->line,d->len);
+				switch(line[0])
+				{
+				case 'g': readGroup(&line[0]); break;
+				case 'm': readLibrary(&line[0]); break;
+				case 'u': readMaterial(&line[0]); break;
+				}
+			}
+			if(f<ea.m_faces.size())
+			{
+				auto &face = ea.m_faces[f];
+				addFace(&ea.m_v[face.corner],&ea.m_vt[face.corner],face.count,face.tex);
+			}
+		}
 	}
 
 	log_debug("read %d vertices,%d faces,%d groups\n",m_vertices,m_faces,m_groups);
@@ -192,12 +403,14 @@ Model::ModelErrorE ObjFilter::readFile(Model *model, const char *const filename)
 Model::ModelErrorE ObjFilter::writeFile(Model *model, const char *const filename, Options &o)
 {
 	Model::ModelErrorE err = Model::ERROR_NONE;
-	m_dst = openOutput(filename,err);
-	DestCloser fc(m_dst);
+	DataDest *dst = openOutput(filename,err);
+	DestCloser fc(dst);
 
 	if(err!=Model::ERROR_NONE)
 		return err;
 
+	TextDest text(dst); m_dst = &text;
+
 	m_model = model;
 
 	m_materialNames.clear();
@@ -222,145 +435,28 @@ bool ObjFilter::writeLine(const char *line,...)
 	va_start(ap,line);
 	m_dst->writeVPrintf(line,ap);
 	va_end(ap);
-	m_dst->writePrintf("\r\n");
+	m_dst->writeBytes("\r\n",2);
 	return true;
 }
 
-enum objfilter_OFWS_StateE
-{
-	OFWS_Whitespace,
-	OFWS_Token,
-	OFWS_Number,
-	OFWS_Decimal,
-	OFWS_AfterDecimal
-};
-
 bool ObjFilter::writeStripped(const char *fmt,...)
 {
-	char line[512];
-	char line2[512];
+	m_dst->reserve(512); //Keep the line in the buffer.
+
+	size_t mark = m_dst->mark();
 
 	va_list ap;
 	va_start(ap,fmt);
-	vsnprintf(line,sizeof(line),fmt,ap);
-	objfilter_replace(line,',','.');
+	m_dst->writeVPrintf(fmt,ap);
 	va_end(ap);
 
-	objfilter_OFWS_StateE state = OFWS_Whitespace;
-
-	size_t s = 0;
-	size_t d = 0;
-	size_t len = strlen(line);
-
-	while(s<len) switch(state)
+	if(char *line=m_dst->text(mark))
 	{
-	case OFWS_Token:
-
-		line2[d] = line[s];
-		if(isspace(line2[d]))
-		{
-			state = OFWS_Whitespace;
-		}
-		s++; d++; break;
-
-	case OFWS_Whitespace:
-
-		line2[d] = line[s];
-		if(!isspace(line2[d]))
-		{
-			if(isdigit(line2[d])||line2[d]=='-')
-			{
-				state = OFWS_Number;
-			}
-			else
-			{
-				state = OFWS_Token;
-			}
-		}
-		s++; d++; break;
-
-	case OFWS_Number:
-
-		line2[d] = line[s];
-		if(!isdigit(line2[d]))
-		{
-			if(line2[d]=='.')
-			{
-				state = OFWS_Decimal;
-			}
-			else if(isspace(line2[d]))
-			{
-				state = OFWS_Whitespace;
-			}
-			else
-			{
-				state = OFWS_Token;
-			}
-		}
-		s++; d++; break;
-
-	case OFWS_Decimal:
-
-		line2[d] = line[s];
-		if(isdigit(line2[d]))
-		{
-			state = OFWS_AfterDecimal;
-		}
-		else if(isspace(line2[d]))
-		{
-			state = OFWS_Whitespace;
-		}
-		else
-		{
-			state = OFWS_Token;
-		}
-		//INTENTIONAL???
-		//https://github.com/zturtleman/mm3d/issues/152
-		//s++; d++;
-		s++; d++; break; //2021
-
-	case OFWS_AfterDecimal:
-
-		if(isdigit(line[s]))
-		{
-			if(line[s]=='0')
-			{
-				size_t bak = s;
-
-				while(line[s]=='0')
-				{
-					s++;
-				}
-
-				if(isspace(line[s])||line[s]=='\0')
-				{
-					state = OFWS_Whitespace;
-				}
-				else
-				{
-					s = bak;
-				}
-			}
-			line2[d] = line[s];
-		}
-		else
-		{
-			line2[d] = line[s];
-			if(isspace(line2[d]))
-			{
-				state = OFWS_Whitespace;
-			}
-			else
-			{
-				state = OFWS_Token;
-			}
-		}
-		s++; d++; break;
+		objfilter_replace(line,m_dst->mark()-mark,',','.');
 	}
-	
-	line2[d] = '\0';
+	m_dst->stripZeros(mark);
 
-	m_dst->writePrintf("%s\r\n",line2);
+	m_dst->writeBytes("\r\n",2);
 
 	return true;
 }
@@ -422,8 +518,8 @@ bool ObjFilter::writeMaterials()
 		writeLine("mtllib %s",m_materialFile.c_str());
 		writeLine("");
 
-		DataDest *saveDst = m_dst;
-		m_dst = dst;
+		TextDest *saveDst = m_dst;
+		TextDest text(dst); m_dst = &text;
 
 		writeLine("# Material file for %s",m_modelBaseName.c_str());
 		writeLine("");
@@ -476,7 +572,7 @@ bool ObjFilter::writeMaterials()
 
 		m_dst = saveDst;
 
-		dst->close();
+		text.flush(); dst->close();
 	}
 	return true;
 }
@@ -688,147 +784,135 @@ char *ObjFilter::skipSpace(char *str)
 	return str;
 }
 
-bool ObjFilter::readLine(char *line)
-{
-	char *str = skipSpace(line);
-
-	if(strncmp(str,"v ",2)==0)
-	{
-		m_vertices++;
-		objfilter_replace(str,',','.');
-		readVertex(str);
-	}
-	else if(strncmp(str,"vt ",3)==0)
-	{
-		objfilter_replace(str,',','.');
-		readTextureCoord(str);
-	}
-	else if(strncmp(str,"f ",2)==0)
-	{
-		m_faces++;
-		readFace(str);
-	}
-	else if(strncmp(str,"g ",2)==0)
-	{
-		m_groups++;
-		readGroup(str);
-	}
-	else if(strncmp(str,"mtllib",6)==0)
-	{
-		readLibrary(str);
-	}
-	else if(strncmp(str,"usemtl",6)==0)
-	{
-		readMaterial(str);
-	}
-	return true;
-}
-
-bool ObjFilter::readVertex(char *line)
+void ObjFilter::parseChunk(ChunkT *c)
 {
-	line += 2;
-	float x,y,z;
-	if(sscanf(line,"%f %f %f",&x,&y,&z)==3)
-	{
-		m_model->addVertex(x,y,z);
-		return true;
-	}
-	return false;
-}
+	c->m_vertexLines = c->m_faceLines = c->m_groupLines = 0;
+	c->m_badUvLines = 0;
 
-bool ObjFilter::readTextureCoord(char *line)
-{
-	line += 3;
-	UvDataT uvd;
-	uvd.u = 0.0f;
-	uvd.v = 0.0f;
-
-	if(sscanf(line,"%f %f",&uvd.u,&uvd.v)!=2)
+	for(const char *p=c->m_begin,*e=c->m_end;p<e;)
 	{
-		log_warning("could not read 2 texture coordinates from %s\n",line);
-	}
+		const char *s = p;
+		const char *eol = (const char*)memchr(p,'\n',e-p);
+		p = eol?eol+1:e;
 
-	m_uvList.push_back(uvd);
+		while(s<p&&isspace(*s)) s++;
 
-	return true;
-}
+		size_t len = p-s; if(len<2) continue;
 
-bool ObjFilter::readFace(char *line)
-{
-	line += 2;
-	std::vector<int> vlist;
-	std::vector<int> vtlist;
-	int len = 0;
-	int v = 0;
-
-	while(sscanf(line,"%d%n",&v,&len)>0)
-	{
-		if(v<0)
+		if(s[0]=='v'&&s[1]==' ')
 		{
-			v = (int)m_model->getVertexCount()+v;
+			c->m_vertexLines++;
+
+			float xyz[3]; s+=2;
+			if((s=objfilter_strtof(s,p,xyz[0]))
+			 &&(s=objfilter_strtof(s,p,xyz[1]))
+			 &&(s=objfilter_strtof(s,p,xyz[2])))
+			{
+				c->m_coords.insert(c->m_coords.end(),xyz,xyz+3);
+			}
 		}
-		else
+		else if(s[0]=='v'&&s[1]=='t'&&len>=3&&s[2]==' ')
 		{
-			v = v-1;
+			UvDataT uvd = {0.0f,0.0f}; s+=3;
+			if(!(s=objfilter_strtof(s,p,uvd.u))
+			 ||!(s=objfilter_strtof(s,p,uvd.v)))
+			{
+				c->m_badUvLines++;
+			}
+			c->m_uvs.push_back(uvd);
 		}
+		else if(s[0]=='f'&&s[1]==' ')
+		{
+			c->m_faceLines++;
 
-		int texidx  = -1;
-		int normidx = -1;
-
-		vlist.push_back(v);
-
-		line = &line[len];
+			int vcount = (int)c->m_coords.size()/3;
+			int vtcount = (int)c->m_uvs.size();
 
-		// Face has texture coords or normals
-		if(line[0]=='/')
-		{
-			line++;
+			ChunkT::FaceT f = {(unsigned)c->m_v.size(),0,true};
 
-			if(line[0]!='/')
+			int v; for(s+=2;s=objfilter_strtol(s,p,v);)
 			{
-				// Read texture coord index
-				texidx = atoi(line);
-				if(texidx<0)
+				if(v<0)
 				{
-					texidx = m_uvList.size()+texidx;
+					c->m_vFixups.push_back(c->m_v.size());
+					v = vcount+v;
 				}
-				else
-				{
-					texidx = texidx-1;
-				}
-				vtlist.push_back(texidx);
+				else v = v-1;
 
-				while(line[0]!='\0'&&line[0]!='/'&&!isspace(line[0]))
-				{
-					line++;
-				}
-			}
-
-			if(line[0]=='/')
-			{
-				line++;
-				// Read normal index (and ignore it)
-				// NOTE adjust for negative indices
-				normidx = atoi(line)-1;
+				int texidx = 0; bool tex = false;
 
-				while(line[0]!='\0'&&line[0]!=' ')
+				// Face has texture coords or normals
+				if(s<p&&s[0]=='/')
 				{
-					line++;
+					s++;
+
+					if(s<p&&s[0]!='/')
+					{
+						// Read texture coord index
+						objfilter_strtol(s,p,texidx);
+						if(texidx<0)
+						{
+							c->m_vtFixups.push_back(c->m_vt.size());
+							texidx = vtcount+texidx;
+						}
+						else texidx = texidx-1;
+
+						tex = true;
+
+						while(s<p&&s[0]!='/'&&!isspace(s[0]))
+						{
+							s++;
+						}
+					}
+
+					if(s<p&&s[0]=='/')
+					{
+						// Skip normal index (normals aren't read)
+						while(s<p&&!isspace(s[0]))
+						{
+							s++;
+						}
+					}
 				}
+
+				c->m_v.push_back(v);
+				c->m_vt.push_back(texidx);
+				f.count++;
+				f.tex = f.tex&&tex;
 			}
+
+			c->m_faces.push_back(f);
 		}
+		else if(s[0]=='g'&&s[1]==' '
+		||len>=6&&(!memcmp(s,"mtllib",6)||!memcmp(s,"usemtl",6)))
+		{
+			if(s[0]=='g') c->m_groupLines++;
 
-		line = skipSpace(line);
+			c->m_directives.push_back({c->m_faces.size(),s,len});
+		}
 	}
+}
 
-	if(vlist.size()<3)
+bool ObjFilter::addFace(const int *vlist, const int *vtlist, unsigned count, bool tex)
+{
+	if(count<3)
 	{
 		log_warning("face with less than 3 vertices\n");
 		return false;
 	}
 
-	bool addTextureCoords = (vtlist.size()==vlist.size())? true : false;
-	for(unsigned n = 0; n+2<vlist.size(); n++)
+	bool addTextureCoords = tex;
+	for(unsigned n=0;n<count&&tex;n++)
+	{
+		if((unsigned)vtlist[n]>=m_uvList.size())
+		{
+			log_warning("texture coordinate index %d out of range\n",vtlist[n]+1);
+			addTextureCoords = false;
+			break;
+		}
+	}
+
+	for(unsigned n = 0; n+2<count; n++)
 	{
 		int tri = m_model->addTriangle(vlist[0],vlist[n+1],vlist[n+2]);
 
@@ -855,6 +939,8 @@ bool ObjFilter::readFace(char *line)
 			m_needGroup = false;
 		}
 
+		if(tri<0) continue; //Vertex index out of range.
+
 		if(m_curGroup>=0)
 		{
 			m_model->addTriangleToGroup(m_curGroup,tri);
@@ -885,7 +971,7 @@ bool ObjFilter::readGroup(char *line)
 	char *temp = strdup(line);
 	char *ptr = temp;
 
-	while(!isspace(ptr[0]))
+	while(ptr[0]&&!isspace(ptr[0]))
 	{
 		ptr++;
 	}
@@ -0,0 +1,313 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2007 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+
+#include "mm3dtypes.h" //PCH
+
+#include "offscreen.h"
+#include "glheaders.h"
+#include "log.h"
+
+#ifndef _WIN32
+#include <dlfcn.h> //dlopen
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+//NOTE: These are from EGL/egl.h and EGL/eglext.h, which aren't needed
+//to build since libEGL is looked up at run time.
+static struct offscreen_egl_t
+{
+	enum
+	{
+		NONE=0x3038,SURFACE_TYPE=0x3033,PBUFFER_BIT=0x0001,
+		RENDERABLE_TYPE=0x3040,OPENGL_BIT=0x0008,OPENGL_API=0x30A2,
+		RED_SIZE=0x3024,GREEN_SIZE=0x3023,BLUE_SIZE=0x3022,ALPHA_SIZE=0x3021,
+		DEPTH_SIZE=0x3025,WIDTH=0x3057,HEIGHT=0x3056,EXTENSIONS=0x3055,
+		PLATFORM_SURFACELESS_MESA=0x31DD,
+	};
+	typedef int32_t EGLint; typedef unsigned EGLBoolean;
+
+	void*(*GetProcAddress)(const char*);
+	void*(*GetDisplay)(void*);
+	void*(*GetPlatformDisplayEXT)(unsigned,void*,const EGLint*);
+	const char*(*QueryString)(void*,EGLint);
+	EGLBoolean(*Initialize)(void*,EGLint*,EGLint*);
+	EGLBoolean(*Terminate)(void*);
+	EGLBoolean(*BindAPI)(unsigned);
+	EGLBoolean(*ChooseConfig)(void*,const EGLint*,void**,EGLint,EGLint*);
+	void*(*CreatePbufferSurface)(void*,void*,const EGLint*);
+	void*(*CreateContext)(void*,void*,void*,const EGLint*);
+	EGLBoolean(*MakeCurrent)(void*,void*,void*,void*);
+	EGLBoolean(*DestroySurface)(void*,void*);
+	EGLBoolean(*DestroyContext)(void*,void*);
+	EGLint(*GetError)();
+
+	template<class T> bool proc(void *lib, T &f, const char *name)
+	{
+		#ifndef _WIN32
+		f = (T)dlsym(lib,name);
+		#endif
+		return f!=nullptr;
+	}
+	bool load(void *lib)
+	{
+		return proc(lib,GetProcAddress,"eglGetProcAddress")
+		&&proc(lib,GetDisplay,"eglGetDisplay")
+		&&proc(lib,QueryString,"eglQueryString")
+		&&proc(lib,Initialize,"eglInitialize")
+		&&proc(lib,Terminate,"eglTerminate")
+		&&proc(lib,BindAPI,"eglBindAPI")
+		&&proc(lib,ChooseConfig,"eglChooseConfig")
+		&&proc(lib,CreatePbufferSurface,"eglCreatePbufferSurface")
+		&&proc(lib,CreateContext,"eglCreateContext")
+		&&proc(lib,MakeCurrent,"eglMakeCurrent")
+		&&proc(lib,DestroySurface,"eglDestroySurface")
+		&&proc(lib,DestroyContext,"eglDestroyContext")
+		&&proc(lib,GetError,"eglGetError");
+	}
+
+}offscreen_egl = {};
+
+bool OffscreenContext::create(int w, int h)
+{
+	destroy(); if(w<=0||h<=0) return false;
+
+	#ifdef _WIN32
+	log_error("offscreen rendering isn't implemented on Windows\n");
+	return false;
+	#else
+
+	auto &egl = offscreen_egl;
+
+	//NOTE: OSMesa isn't tried because it has its own GL entry points.
+	//libGL's (GLVND's) don't reach its contexts. Mesa's EGL does the same
+	//software rendering when there's no GPU.
+	m_lib = dlopen("libEGL.so.1",RTLD_NOW|RTLD_GLOBAL);
+	if(!m_lib||!egl.load(m_lib))
+	{
+		log_error("offscreen rendering needs libEGL.so.1\n");
+		destroy(); return false;
+	}
+
+	//The client extensions are queried without a display. Surfaceless
+	//doesn't need a display server or a GPU at all.
+	auto x = egl.QueryString(nullptr,egl.EXTENSIONS);
+	if(x&&strstr(x,"EGL_MESA_platform_surfaceless"))
+	{
+		(void*&)egl.GetPlatformDisplayEXT = egl.GetProcAddress("eglGetPlatformDisplayEXT");
+		if(egl.GetPlatformDisplayEXT)
+		m_display = egl.GetPlatformDisplayEXT(egl.PLATFORM_SURFACELESS_MESA,nullptr,nullptr);
+	}
+	if(!m_display) m_display = egl.GetDisplay(nullptr); //EGL_DEFAULT_DISPLAY
+
+	offscreen_egl_t::EGLint major,minor,n = 0;
+	if(!m_display||!egl.Initialize(m_display,&major,&minor))
+	{
+		log_error("eglInitialize failed (0x%x)\n",egl.GetError());
+		m_display = nullptr; destroy(); return false;
+	}
+	log_debug("EGL %d.%d offscreen context is %dx%d\n",major,minor,w,h);
+
+	const offscreen_egl_t::EGLint attribs[] =
+	{
+		egl.SURFACE_TYPE,egl.PBUFFER_BIT,
+		egl.RENDERABLE_TYPE,egl.OPENGL_BIT,
+		egl.RED_SIZE,8,egl.GREEN_SIZE,8,egl.BLUE_SIZE,8,egl.ALPHA_SIZE,8,
+		egl.DEPTH_SIZE,24,egl.NONE
+	};
+	const offscreen_egl_t::EGLint size[] = { egl.WIDTH,w,egl.HEIGHT,h,egl.NONE };
+
+	void *config = nullptr;
+	if(egl.BindAPI(egl.OPENGL_API)
+	&&egl.ChooseConfig(m_display,attribs,&config,1,&n)&&n==1
+	&&(m_surface=egl.CreatePbufferSurface(m_display,config,size))
+	&&(m_context=egl.CreateContext(m_display,config,nullptr,nullptr))
+	&&egl.MakeCurrent(m_display,m_surface,m_surface,m_context))
+	{
+		m_width = w; m_height = h;
+
+		log_debug("GL_RENDERER is %s\n",(const char*)glGetString(GL_RENDERER));
+
+		return true;
+	}
+	log_error("could not make an EGL pbuffer context (0x%x)\n",egl.GetError());
+
+	destroy(); return false;
+
+	#endif
+}
+
+void OffscreenContext::destroy()
+{
+	#ifndef _WIN32
+	auto &egl = offscreen_egl;
+
+	if(m_display)
+	{
+		egl.MakeCurrent(m_display,nullptr,nullptr,nullptr);
+		if(m_context) egl.DestroyContext(m_display,m_context);
+		if(m_surface) egl.DestroySurface(m_display,m_surface);
+		egl.Terminate(m_display);
+	}
+	//NOTE: libEGL is left loaded since libGL's dispatch may refer to it.
+	#endif
+
+	m_display = m_surface = m_context = nullptr;
+
+	m_lib = nullptr; m_width = m_height = 0;
+}
+
+//NEW: Pixel buffer objects. Like model_draw.cc these are looked up at
+//run time since Windows' headers and libraries stop at 1.1.
+static struct offscreen_pbo_t
+{
+	enum //Also not in Windows' gl.h.
+	{
+		PIXEL_PACK_BUFFER=0x88EB,STREAM_READ=0x88E1,READ_ONLY=0x88B8
+	};
+
+	int init; //-1 if unavailable.
+
+	void(APIENTRY*GenBuffers)(GLsizei,GLuint*);
+	void(APIENTRY*DeleteBuffers)(GLsizei,const GLuint*);
+	void(APIENTRY*BindBuffer)(GLenum,GLuint);
+	void(APIENTRY*BufferData)(GLenum,ptrdiff_t,const void*,GLenum);
+	void*(APIENTRY*MapBuffer)(GLenum,GLenum);
+	GLboolean(APIENTRY*UnmapBuffer)(GLenum);
+
+	template<class T> static bool proc(T &f, const char *name, const char *arb)
+	{
+		char buf[32]; snprintf(buf,sizeof(buf),"%s%s",name,arb);
+		#ifdef _WIN32
+		f = (T)wglGetProcAddress(buf);
+		#else
+		f = (T)dlsym(RTLD_DEFAULT,buf);
+		#endif
+		return f!=nullptr;
+	}
+	bool load()
+	{
+		if(init) return init==1;
+
+		auto v = (const char*)glGetString(GL_VERSION);
+		if(!v) return false; //No context?
+
+		int major = 0, minor = 0; 
+		sscanf(v,"%d.%d",&major,&minor);
+		const char *arb = "";
+		if(major<2||major==2&&minor<1)
+		{
+			auto x = (const char*)glGetString(GL_EXTENSIONS);
+			arb = x&&strstr(x,"GL_ARB_pixel_buffer_object")?"ARB":nullptr;
+		}
+		init = arb
+		&&proc(GenBuffers,"glGenBuffers",arb)
+		&&proc(DeleteBuffers,"glDeleteBuffers",arb)
+		&&proc(BindBuffer,"glBindBuffer",arb)
+		&&proc(BufferData,"glBufferData",arb)
+		&&proc(MapBuffer,"glMapBuffer",arb)
+		&&proc(UnmapBuffer,"glUnmapBuffer",arb)?1:-1;
+
+		if(init!=1) log_debug("OpenGL pixel buffer objects unavailable (%s)\n",v);
+
+		return init==1;
+	}
+
+}offscreen_pbo = {};
+
+FrameReader::FrameReader(int x, int y, int w, int h, bool alpha)
+	:
+m_x(x),m_y(y),m_w(w),m_h(h),m_alpha(alpha),
+m_buffers(),m_next(),m_mapped(),m_pending()
+{
+	size_t sz = (size_t)w*h*(alpha?4:3);
+
+	auto &gl = offscreen_pbo; if(gl.load())
+	{
+		gl.GenBuffers(2,m_buffers);
+		for(int i=0;i<2;i++)
+		{
+			gl.BindBuffer(gl.PIXEL_PACK_BUFFER,m_buffers[i]);
+			gl.BufferData(gl.PIXEL_PACK_BUFFER,sz,nullptr,gl.STREAM_READ);
+		}
+		gl.BindBuffer(gl.PIXEL_PACK_BUFFER,0);
+	}
+	else for(int i=0;i<2;i++) m_pixels[i].resize(sz);
+}
+FrameReader::~FrameReader()
+{
+	_unmap(); if(isAsync()) offscreen_pbo.DeleteBuffers(2,m_buffers);
+}
+
+const void *FrameReader::read()
+{
+	_unmap();
+
+	int i = m_next; m_next = !i;
+
+	glPixelStorei(GL_PACK_ALIGNMENT,1);
+	GLenum fmt = m_alpha?GL_RGBA:GL_RGB;
+	if(isAsync())
+	{
+		auto &gl = offscreen_pbo;
+		gl.BindBuffer(gl.PIXEL_PACK_BUFFER,m_buffers[i]);
+		glReadPixels(m_x,m_y,m_w,m_h,fmt,GL_UNSIGNED_BYTE,nullptr);
+		gl.BindBuffer(gl.PIXEL_PACK_BUFFER,0);
+	}
+	else glReadPixels(m_x,m_y,m_w,m_h,fmt,GL_UNSIGNED_BYTE,m_pixels[i].data());
+
+	bool prev = m_pending; m_pending = true; 
+	
+	return prev?_map(!i):nullptr;
+}
+const void *FrameReader::finish()
+{
+	_unmap(); 
+	
+	if(!m_pending) return nullptr;
+
+	m_pending = false; return _map(!m_next);
+}
+const void *FrameReader::_map(int i)
+{
+	if(!isAsync()) return m_pixels[i].data();
+
+	auto &gl = offscreen_pbo;
+	gl.BindBuffer(gl.PIXEL_PACK_BUFFER,m_buffers[i]);
+	void *p = gl.MapBuffer(gl.PIXEL_PACK_BUFFER,gl.READ_ONLY);
+	gl.BindBuffer(gl.PIXEL_PACK_BUFFER,0);
+	
+	if(p) m_mapped = 1+i; return p;
+}
+void FrameReader::_unmap()
+{
+	if(!m_mapped) return;
+
+	auto &gl = offscreen_pbo;
+	gl.BindBuffer(gl.PIXEL_PACK_BUFFER,m_buffers[m_mapped-1]);
+	gl.UnmapBuffer(gl.PIXEL_PACK_BUFFER);
+	gl.BindBuffer(gl.PIXEL_PACK_BUFFER,0);
+
+	m_mapped = 0;
+}
@@ -0,0 +1,99 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2007 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+
+#ifndef __OFFSCREEN_H
+#define __OFFSCREEN_H
+
+// An OpenGL context that renders into a pbuffer instead of a window, so
+// that Model::draw can be used without a display (e.g. to render frames
+// from the command line on a build server.) It uses EGL, preferring Mesa's
+// surfaceless platform, which falls back to its software rasterizer if
+// there isn't a GPU. libEGL is loaded at run time so MM3D doesn't depend
+// on it. It's not implemented on Windows.
+//
+// The context is a legacy (compatibility) context like the UI's is.
+//
+class OffscreenContext
+{
+public:
+
+	OffscreenContext():m_lib(),m_display(),m_surface(),m_context()
+	,m_width(),m_height(){}
+	~OffscreenContext(){ destroy(); }
+
+	// Makes a current context with a w by h RGBA framebuffer that has a
+	// depth buffer. Returns false (having logged why) if it can't.
+	bool create(int w, int h);
+	void destroy();
+
+	bool isCurrent(){ return m_context!=nullptr; }
+
+	int getWidth(){ return m_width; }
+	int getHeight(){ return m_height; }
+
+protected:
+
+	void *m_lib; //dlopen
+
+	void *m_display,*m_surface,*m_context; //EGL
+
+	int m_width,m_height;
+};
+
+// FrameReader reads back rendered frames (e.g. to save them) without
+// waiting on them. read starts copying the framebuffer into one of two
+// pixel pack buffers and returns the frame started before it, so that one
+// frame is copied out while the next renders. The first read returns
+// nullptr and finish returns the last frame. Without pixel buffer objects
+// (OpenGL 2.1 or ARB_pixel_buffer_object) it does plain glReadPixels with
+// the same one frame delay.
+//
+// The pixels are w*h*(alpha?4:3) bytes, bottom row first, as is expected
+// by TextureManager::writeAsync. They're good until the next call. The
+// context must be current for all calls, including the destructor.
+//
+class FrameReader
+{
+public:
+
+	FrameReader(int x, int y, int w, int h, bool alpha);
+	~FrameReader();
+
+	const void *read();
+	const void *finish();
+
+	bool isAsync(){ return m_buffers[0]!=0; }
+
+protected:
+
+	int m_x,m_y,m_w,m_h; bool m_alpha;
+
+	unsigned m_buffers[2]; int m_next,m_mapped; bool m_pending;
+
+	std::vector<uint8_t> m_pixels[2]; //!isAsync
+
+	const void *_map(int);
+	void _unmap();
+};
+
+#endif // __OFFSCREEN_H
@@ -64,49 +64,57 @@ public:
 	virtual const char *getReadTypes(){ return "PCX"; }
 
 	virtual Texture::ErrorE readData(Texture &texture, DataSource &src, const char*);
+
+	virtual bool isReentrant(){ return true; } //NEW
 		
 protected:
 
-	Texture::ErrorE load_image(DataSource &src);
-	void load_1(DataSource &src, int width, int height, uint8_t *buffer, int bytes);
-	void load_4(DataSource &src, int width, int height, uint8_t *buffer, int bytes);
-	void load_8(DataSource &src, int width, int height, uint8_t *buffer, int bytes);
-	void load_24(DataSource &src, int width, int height, uint8_t *buffer, int bytes);
-	void readline(DataSource &src, uint8_t *buffer, int	 bytes);
+	struct Header
+	{
+		uint8_t manufacturer;
+		uint8_t version;
+		uint8_t compression;
+		uint8_t bpp;
+		int16_t x1,y1;
+		int16_t x2,y2;
+		int16_t hdpi;
+		int16_t vdpi;
+		uint8_t colormap[48];
+		uint8_t reserved;
+		uint8_t planes;
+		int16_t bytesperline;
+		int16_t color;
+		uint8_t filler[58];
+	};
+
+	// The image is decoded from memory. This had been static state.
+	struct Reader
+	{
+		Header header;
+
+		const uint8_t *p,*end; uint8_t count,value;
+
+		uint8_t palette[256][3];
+	};
 
-	uint8_t m_palette[256][3];
-	Texture *m_texture;
+	Texture::ErrorE load_image(Texture &texture, DataSource &src);
+	void load_1(Reader &src, int width, int height, uint8_t *buffer, int bytes);
+	void load_4(Reader &src, int width, int height, uint8_t *buffer, int bytes);
+	void load_8(Reader &src, int width, int height, uint8_t *buffer, int bytes);
+	void load_24(Reader &src, int width, int height, uint8_t *buffer, int bytes);
+	void readline(Reader &src, uint8_t *buffer, int	 bytes);
 };
 
 extern TextureFilter *pcxtex(){ return new PcxTextureFilter; }
 
 Texture::ErrorE PcxTextureFilter::readData(Texture &texture, DataSource &src, const char*)
 {
-	m_texture = &texture; auto e = load_image(src);
-	m_texture = nullptr; return e;
+	return load_image(texture,src);
 }
 
 static uint8_t pcxtex_mono[6]= { 0,0,0,255,255,255 };
 
-static struct
-{
-	uint8_t manufacturer;
-	uint8_t version;
-	uint8_t compression;
-	uint8_t bpp;
-	int16_t x1,y1;
-	int16_t x2,y2;
-	int16_t hdpi;
-	int16_t vdpi;
-	uint8_t colormap[48];
-	uint8_t reserved;
-	uint8_t planes;
-	int16_t bytesperline;
-	int16_t color;
-	uint8_t filler[58];
-} pcx_header;
-
-Texture::ErrorE PcxTextureFilter::load_image(DataSource &src)
+Texture::ErrorE PcxTextureFilter::load_image(Texture &texture, DataSource &src)
 {
 	int offset_x,offset_y;
 
@@ -115,6 +123,8 @@ Texture::ErrorE PcxTextureFilter::load_image(DataSource &src)
 		return errnoToTextureError(src.getErrno(),Texture::ERROR_FILE_OPEN);
 	}
 
+	Reader rd; Header &pcx_header = rd.header;
+
 	src.read(pcx_header.manufacturer);
 	src.read(pcx_header.version);
 	src.read(pcx_header.compression);
@@ -142,41 +152,49 @@ Texture::ErrorE PcxTextureFilter::load_image(DataSource &src)
 		return Texture::ERROR_BAD_MAGIC;
 	}
 
+	std::vector<uint8_t> buf(src.getRemaining());
+	if(!src.readBytes(buf.data(),buf.size()))
+	{
+		return errnoToTextureError(src.getErrno(),Texture::ERROR_FILE_READ);
+	}
+	rd.p = buf.data(); rd.end = rd.p+buf.size();
+	rd.count = rd.value = 0;
+
 	offset_x =  (pcx_header.x1);
 	offset_y =  (pcx_header.y1);
-	m_texture->m_width =  (pcx_header.x2)-offset_x+1;
-	m_texture->m_height =  (pcx_header.y2)-offset_y+1;
+	texture.m_width =  (pcx_header.x2)-offset_x+1;
+	texture.m_height =  (pcx_header.y2)-offset_y+1;
 
-	m_texture->m_data.resize(m_texture->m_width*m_texture->m_height*3);
-	uint8_t *data = m_texture->m_data.data();
+	//NOTE: This had been left as FORMAT_RGBA.
+	texture.m_format = Texture::FORMAT_RGB;
+	texture.m_data.resize(texture.m_width*texture.m_height*3);
+	uint8_t *data = texture.m_data.data();
 
 	if(pcx_header.planes==1&&pcx_header.bpp==1)
 	{
-		memcpy(m_palette,pcxtex_mono,(2*3));
-		load_1 (src,m_texture->m_width,m_texture->m_height,data, (pcx_header.bytesperline));
+		memcpy(rd.palette,pcxtex_mono,(2*3));
+		load_1 (rd,texture.m_width,texture.m_height,data, (pcx_header.bytesperline));
 	}
 #if 0 //UNIMPLEMENTED
 	else if(pcx_header.planes==4&&pcx_header.bpp==1)
 	{
-		memcpy(m_palette,pcx_header.colormap,(16*3));
-		load_4(src,m_texture->m_width,m_texture->m_height,data, (pcx_header.bytesperline));
+		memcpy(rd.palette,pcx_header.colormap,(16*3));
+		load_4(rd,texture.m_width,texture.m_height,data, (pcx_header.bytesperline));
 	}
 #endif
 	else if(pcx_header.planes==1&&pcx_header.bpp==8)
 	{
-		off_t pos = src.offset();
-		src.seek(src.getFileSize()-(256*3));
-		src.readBytes(&m_palette[0][0],(256*3));
-		src.seek(pos);
-		if(src.errorOccurred())
+		if(buf.size()<256*3)
 		{
-			return errnoToTextureError(src.getErrno(),Texture::ERROR_FILE_READ);
+			return Texture::ERROR_FILE_READ;
 		}
-		load_8(src,m_texture->m_width,m_texture->m_height,data, (pcx_header.bytesperline));
+		memcpy(rd.palette,rd.end-256*3,256*3);
+
+		load_8(rd,texture.m_width,texture.m_height,data, (pcx_header.bytesperline));
 	}
 	else if(pcx_header.planes==3&&pcx_header.bpp==8)
 	{
-		load_24(src,m_texture->m_width,m_texture->m_height,data, (pcx_header.bytesperline));
+		load_24(rd,texture.m_width,texture.m_height,data, (pcx_header.bytesperline));
 	}
 	else
 	{
@@ -186,31 +204,27 @@ Texture::ErrorE PcxTextureFilter::load_image(DataSource &src)
 	return Texture::ERROR_NONE;
 }
 
-void PcxTextureFilter::load_8(DataSource &src, int m_width, int m_height, uint8_t *buffer, int	bytes)
+void PcxTextureFilter::load_8(Reader &src, int m_width, int m_height, uint8_t *buffer, int	bytes)
 {
 	int x,y;
-	uint8_t *line;
-	line = (uint8_t *)malloc (bytes);
+	std::vector<uint8_t> line(std::max(bytes,m_width));
 	uint8_t *row;
 
 	for(y = m_height-1; y>=0; --y)
 	{
 		row = &buffer[y *(m_width*3)];
-		readline (src,line,bytes);
+		readline (src,line.data(),bytes);
 		for(x = 0; x<m_width; ++x)
 		{
-			memcpy(&row[x*3],m_palette[line[x]],3);
+			memcpy(&row[x*3],src.palette[line[x]],3);
 		}
 	}
-
-	free (line);
 }
 
-void PcxTextureFilter::load_24(DataSource &src, int m_width, int m_height,uint8_t *buffer, int	bytes)
+void PcxTextureFilter::load_24(Reader &src, int m_width, int m_height,uint8_t *buffer, int	bytes)
 {
 	int x,y,c;
-	uint8_t *line;
-	line = (uint8_t *)malloc (bytes *3);
+	std::vector<uint8_t> line(std::max(bytes,m_width));
 	uint8_t *row;
 
 	for(y = m_height-1; y>=0; --y)
@@ -218,45 +232,40 @@ void PcxTextureFilter::load_24(DataSource &src, int m_width, int m_height,uint8_
 		row = &buffer[y *(m_width*3)];
 		for(c = 0; c<3; ++c)
 		{
-			readline (src,line,bytes);
+			readline (src,line.data(),bytes);
 			for(x = 0; x<m_width; ++x)
 			{
 				row[x *3+c] = line[x];
 			}
 		}
 	}
-
-	free (line);
 }
 
-void PcxTextureFilter::load_1(DataSource &src, int m_width, int m_height, uint8_t *buffer, int	bytes)
+void PcxTextureFilter::load_1(Reader &src, int m_width, int m_height, uint8_t *buffer, int	bytes)
 {
 	int x,y;
-	uint8_t *line;
-	line = (uint8_t *)malloc (bytes);
+	std::vector<uint8_t> line(std::max(bytes,(m_width+7)/8));
 	uint8_t *row;
 
 	for(y = m_height-1; y>=0; --y)
 	{
 		row = &buffer[y *(m_width*3)];
-		readline (src,line,bytes);
+		readline (src,line.data(),bytes);
 		for(x = 0; x<m_width; ++x)
 		{
 			if(line[x/8] &(128>> (x%8)))
 			{
-				memcpy(&row[x*3],m_palette[1],3);
+				memcpy(&row[x*3],src.palette[1],3);
 			}
 			else
 			{
-				memcpy(&row[x*3],m_palette[0],3);
+				memcpy(&row[x*3],src.palette[0],3);
 			}
 		}
 	}
-
-	free (line);
 }
 
-void PcxTextureFilter::load_4(DataSource &src, int	m_width, int m_height,uint8_t *buffer, int	bytes)
+void PcxTextureFilter::load_4(Reader &src, int	m_width, int m_height,uint8_t *buffer, int	bytes)
 {
 	// TODO implement this if I ever want it to work
 	/*
@@ -284,35 +293,52 @@ void PcxTextureFilter::load_4(DataSource &src, int	m_width, int m_height,uint8_t
 	*/
 }
 
-void PcxTextureFilter::readline(DataSource &src,uint8_t *buffer, int bytes)
+void PcxTextureFilter::readline(Reader &src,uint8_t *buffer, int bytes)
 {
-	static uint8_t count = 0,value = 0;
+	//NOTE: Runs may cross lines, so count/value are carried over.
+	//Past the end of the data lines are filled with 0.
 
-	if(pcx_header.compression)
+	if(!src.header.compression)
 	{
-		while(bytes--)
+		int n = (int)std::min<size_t>(bytes,src.end-src.p);
+		memcpy(buffer,src.p,n); src.p+=n;
+		memset(buffer+n,0,bytes-n); return;
+	}
+
+	//Locals so the writes to buffer don't make these reload.
+	const uint8_t *p = src.p, *end = src.end;
+	uint8_t count = src.count, value = src.value;
+
+	while(bytes>0)
+	{
+		if(count==0)
 		{
-			if(count==0)
+			//Copy literal bytes up to the next run.
+			const uint8_t *q = p, *e = p+std::min<size_t>(bytes,end-p);
+			while(q<e&&*q<0xc0) q++;
+			if(int n=(int)(q-p))
 			{
-				src.read(value);
-				if(value<0xc0)
-				{
-					count = 1;
-				} 
-				else 
-				{
-					count = value-0xc0;
-					src.read(value);
-				}
+				memcpy(buffer,p,n); p = q;
+				buffer+=n; bytes-=n; continue;
 			}
-			count--;
-			*(buffer++)= value;
+
+			if(p+2>end)
+			{
+				memset(buffer,0,bytes); break;
+			}
+			count = p[0]-0xc0; value = p[1]; p+=2;
 		}
+
+		int n = std::min<int>(count,bytes);
+		if(n<16) for(int i=n;i-->0;) *buffer++ = value;
+		else
+		{
+			memset(buffer,value,n); buffer+=n;
+		}
+		count-=n; bytes-=n;
 	}
-	else
-	{
-		src.readBytes(buffer,bytes);
-	}
+
+	src.p = p; src.count = count; src.value = value;
 }
 
 /*
@@ -23,6 +23,7 @@
 #include "mm3dtypes.h" //PCH
 
 #include "modelfilter.h"
+#include "textdest.h"
 
 //#include "smdfilter.h"
 class SmdFilter : public ModelFilter
@@ -40,7 +41,7 @@ protected:
 
 	SmdOptions  *m_options;
 
-	bool writeLine(DataDest *dst, const char *line,...);
+	bool writeLine(TextDest *dst, const char *line,...);
 };
 
 #include "texture.h"
@@ -133,12 +134,14 @@ Model::ModelErrorE SmdFilter::writeFile(Model *model, const char *const filename
 	}
 
 	Model::ModelErrorE err = Model::ERROR_NONE;
-	DataDest *dst = openOutput(filename,err);
-	DestCloser fc(dst);
+	DataDest *out = openOutput(filename,err);
+	DestCloser fc(out);
 
 	if(err!=Model::ERROR_NONE)
 		return err;
 
+	TextDest text(out), *dst = &text;
+
 	// Use the load matrix and then invert it
 	Matrix saveMatrix;
 	saveMatrix.setRotationInDegrees(-90,0,0);
@@ -523,7 +526,7 @@ Model::ModelErrorE SmdFilter::writeFile(Model *model, const char *const filename
 						}
 					}
 
-					dst->writePrintf("\r\n");
+					dst->writeBytes("\r\n",2);
 				}
 			}
 		}
@@ -554,13 +557,13 @@ Model::ModelErrorE SmdFilter::writeFile(Model *model, const char *const filename
 	return Model::ERROR_NONE;
 }
 
-bool SmdFilter::writeLine(DataDest *dst, const char *line,...)
+bool SmdFilter::writeLine(TextDest *dst, const char *line,...)
 {
 	va_list ap;
 	va_start(ap,line);
 	dst->writeVPrintf(line,ap);
 	va_end(ap);
-	dst->writePrintf("\r\n");
+	dst->writeBytes("\r\n",2);
 	return true;
 }
 
@@ -0,0 +1,224 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2007 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+
+#include "mm3dtypes.h" //PCH
+
+#include "texatlas.h"
+#include "log.h"
+
+namespace
+{
+	struct texatlas_rect{ int w,h,i; };
+
+	struct texatlas_skyline
+	{
+		struct Segment{ int x,y,w; };
+
+		int width,height; std::vector<Segment> segs;
+
+		texatlas_skyline(int w, int h):width(w),height(h)
+		{
+			segs.push_back({0,0,w});
+		}
+
+		// Bottom-left: the lowest top edge, then the leftmost.
+		bool find(int w, int h, int &bx, int &by, size_t &bi)
+		{
+			int best = INT_MAX; bx = INT_MAX;
+			for(size_t i=0;i<segs.size();i++)
+			{
+				int x = segs[i].x; if(x+w>width) break;
+				int y = 0;
+				for(size_t j=i;j<segs.size()&&segs[j].x<x+w;j++)
+				y = std::max(y,segs[j].y);
+				if(y+h>height) continue;
+				if(y+h<best||y+h==best&&x<bx)
+				{
+					best = y+h; bx = x; by = y; bi = i;
+				}
+			}
+			return best!=INT_MAX;
+		}
+		void insert(int x, int y, int w, int h, size_t i)
+		{
+			segs.insert(segs.begin()+i,{x,y+h,w});
+			for(size_t j=i+1;j<segs.size();)
+			{
+				Segment &s = segs[j];
+				int cut = x+w-s.x; if(cut<=0) break;
+				if(cut<s.w)
+				{
+					s.x+=cut; s.w-=cut; break;
+				}
+				segs.erase(segs.begin()+j);
+			}
+			for(size_t j=0;j+1<segs.size();)
+			if(segs[j].y==segs[j+1].y)
+			{
+				segs[j].w+=segs[j+1].w; segs.erase(segs.begin()+j+1);
+			}
+			else j++;
+		}
+	};
+}
+
+static bool texatlas_try(const std::vector<texatlas_rect> &rects, int w, int h, std::vector<int> &xy)
+{
+	texatlas_skyline sky(w,h);
+
+	xy.resize(rects.size()*2);
+	for(auto&ea:rects)
+	{
+		int x,y; size_t i;
+		if(!sky.find(ea.w,ea.h,x,y,i)) return false;
+		sky.insert(x,y,ea.w,ea.h,i);
+		xy[ea.i*2+0] = x; xy[ea.i*2+1] = y;
+	}
+	return true;
+}
+
+bool texture_atlas_pack(std::vector<TextureAtlasItem> &items, int padding, int maxSize, int &width, int &height)
+{
+	if(items.empty()) return false;
+
+	std::vector<texatlas_rect> rects;
+	size_t area = 0; int minW = 1, minH = 1;
+	for(size_t i=0;i<items.size();i++)
+	{
+		auto &ea = items[i];
+		int w = ea.tex->m_width*ea.tilesS+padding*2;
+		int h = ea.tex->m_height*ea.tilesT+padding*2;
+		rects.push_back({w,h,(int)i});
+		area+=(size_t)w*h;
+		minW = std::max(minW,w); minH = std::max(minH,h);
+	}
+	std::sort(rects.begin(),rects.end(),[](const texatlas_rect &a, const texatlas_rect &b)
+	{
+		return a.h!=b.h?a.h>b.h:a.w>b.w;
+	});
+
+	//The candidates are every power-of-two size that could hold the area.
+	struct Candidate{ int w,h; bool fit; std::vector<int> xy; };
+	std::vector<Candidate> cands;
+	for(int w=1;w<=maxSize;w*=2) if(w>=minW)
+	for(int h=1;h<=maxSize;h*=2) if(h>=minH)
+	if((size_t)w*h>=area&&w<=h*2&&h<=w*2)
+	{
+		cands.push_back({w,h,false});
+	}
+	std::sort(cands.begin(),cands.end(),[](const Candidate &a, const Candidate &b)
+	{
+		return (size_t)a.w*a.h<(size_t)b.w*b.h||(size_t)a.w*a.h==(size_t)b.w*b.h&&a.w>b.w;
+	});
+	if(cands.empty()) return false;
+
+	int nt = std::thread::hardware_concurrency();
+	nt = std::max(1,std::min<int>(std::min(8,nt),cands.size()));
+	std::atomic<size_t> next(0);
+	auto work = [&]()
+	{
+		for(size_t i;(i=next++)<cands.size();)
+		cands[i].fit = texatlas_try(rects,cands[i].w,cands[i].h,cands[i].xy);
+	};
+	std::vector<std::thread> threads;
+	for(int i=1;i<nt;i++) threads.emplace_back(work);
+	work();
+	for(auto&ea:threads) ea.join();
+
+	for(auto&ea:cands) if(ea.fit)
+	{
+		width = ea.w; height = ea.h;
+		for(size_t i=0;i<items.size();i++)
+		{
+			items[i].x = ea.xy[i*2+0]+padding;
+			items[i].y = ea.xy[i*2+1]+padding;
+		}
+		log_debug("packed %d textures into %dx%d\n",(int)items.size(),width,height);
+		return true;
+	}
+	return false;
+}
+
+static int texatlas_wrap(int i, int n, int tiles, bool clamp)
+{
+	if(clamp) i = std::max(0,std::min(n*tiles-1,i));
+	i%=n; return i<0?i+n:i;
+}
+static void texatlas_blit(const TextureAtlasItem &it, int padding, uint8_t *dst, int width)
+{
+	Texture *tex = it.tex;
+	int tw = tex->m_width, th = tex->m_height;
+	int bpp = tex->m_format==Texture::FORMAT_RGBA?4:3;
+	const uint8_t *src = tex->m_data.data();
+
+	int w = tw*it.tilesS, h = th*it.tilesT;
+
+	std::vector<int> cols(w+padding*2);
+	for(int x=-padding;x<w+padding;x++)
+	cols[x+padding] = texatlas_wrap(x,tw,it.tilesS,it.clampS)*bpp;
+
+	for(int y=-padding;y<h+padding;y++)
+	{
+		const uint8_t *row = src+(size_t)texatlas_wrap(y,th,it.tilesT,it.clampT)*tw*bpp;
+		uint8_t *d = dst+((size_t)(it.y+y)*width+it.x-padding)*4;
+
+		if(bpp==4&&padding==0&&it.tilesS==1)
+		{
+			memcpy(d,row,tw*4); continue;
+		}
+		for(int c:cols)
+		{
+			const uint8_t *s = row+c;
+			d[0] = s[0]; d[1] = s[1]; d[2] = s[2];
+			d[3] = bpp==4?s[3]:0xff; d+=4;
+		}
+	}
+}
+
+Texture *texture_atlas_blit(const std::vector<TextureAtlasItem> &items, int padding, int width, int height)
+{
+	Texture *atlas = new Texture;
+	atlas->m_format = Texture::FORMAT_RGBA;
+	atlas->m_width = atlas->m_origWidth = width;
+	atlas->m_height = atlas->m_origHeight = height;
+	atlas->m_data.resize((size_t)width*height*4);
+	atlas->m_origFormat = "tga";
+	atlas->m_loadTime = 0;
+
+	//The padded rectangles don't overlap so they're filled in parallel.
+	uint8_t *dst = atlas->m_data.data();
+	int nt = std::thread::hardware_concurrency();
+	nt = std::max(1,std::min<int>(std::min(8,nt),items.size()));
+	std::atomic<size_t> next(0);
+	auto work = [&]()
+	{
+		for(size_t i;(i=next++)<items.size();)
+		texatlas_blit(items[i],padding,dst,width);
+	};
+	std::vector<std::thread> threads;
+	for(int i=1;i<nt;i++) threads.emplace_back(work);
+	work();
+	for(auto&ea:threads) ea.join();
+
+	return atlas;
+}
@@ -0,0 +1,50 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2007 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+
+#ifndef __TEXATLAS_H
+#define __TEXATLAS_H
+
+#include "texture.h"
+
+// One image of an atlas. tilesS/tilesT repeat the image for texture
+// coordinates that wrap past 0 or 1. The padding around it continues
+// the image the way clampS/clampT say the GPU would have sampled it.
+struct TextureAtlasItem
+{
+	Texture *tex;
+	int tilesS,tilesT;
+	bool clampS,clampT;
+
+	int x,y; //texture_atlas_pack (of the unpadded corner)
+};
+
+// Skyline packs the items into the smallest power-of-two image no larger
+// than maxSize on a side. The candidate sizes are tried on several
+// threads at once. Returns false if they don't fit.
+bool texture_atlas_pack(std::vector<TextureAtlasItem> &items, int padding, int maxSize, int &width, int &height);
+
+// Returns a new RGBA texture of the packed items, filling the items in
+// parallel. The caller owns it.
+Texture *texture_atlas_blit(const std::vector<TextureAtlasItem> &items, int padding, int width, int height);
+
+#endif // __TEXATLAS_H
@@ -30,9 +30,15 @@
 #include "translate.h"
 #include "filedatadest.h" //NEW
 #include "filedatasource.h" //NEW
+#include "memdatasource.h"
 
 #include "modelstatus.h"
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
 typedef const char *utf8; //REMOVE ME
 
 static bool txmgr_doWarning = false;
@@ -67,12 +73,301 @@ Texture::ErrorE TextureFilter::errnoToTextureError(int err, Texture::ErrorE defa
 	return defaultError;
 }
 
+static size_t texmgr_bytes(Texture *tex)
+{
+	size_t n = tex->m_data.size();
+	for(auto&ea:tex->m_mipmaps) n+=ea.data.size(); return n;
+}
+
 TextureManager *TextureManager::s_instance = nullptr; //???
 
+struct TextureManager::Async //loadTextureAsync
+{
+	struct Job
+	{
+		std::string filename;
+
+		Blob blob; const uint8_t *data; size_t size; //Embedded?
+
+		//If a filter that isn't reentrant has to decode the file,
+		//the worker only reads it into buf. The main thread picks
+		//it up in finish.
+		std::vector<uint8_t> buf; bool deferred;
+
+		Texture *texture; Texture::ErrorE error; bool done;
+	};
+
+	std::mutex mutex;
+	std::condition_variable cv,done;
+	std::list<Job*> queue; bool quit;
+	std::vector<std::thread> threads;
+
+	std::map<std::string,Job*> jobs; //Main thread.
+
+	void work(TextureManager*);
+
+	static void finish(TextureManager*,Job*); //Main thread.
+};
+void TextureManager::Async::work(TextureManager *tm)
+{
+	for(;;)
+	{
+		Job *job;
+		{
+			std::unique_lock<std::mutex> lk(mutex);
+			cv.wait(lk,[&]{ return quit||!queue.empty(); });
+			if(quit) return;
+			job = queue.front(); queue.pop_front();
+		}
+
+		Texture::ErrorE error = Texture::ERROR_NONE;
+		Texture *tex = nullptr;
+		if(!job->blob)
+		{
+			FileDataSource file(job->filename.c_str());
+			job->buf.resize(file.getFileSize());
+			if(file.errorOccurred()||!file.readBytes(job->buf.data(),job->buf.size()))
+			{
+				error = TextureFilter::errnoToTextureError(file.getErrno(),Texture::ERROR_FILE_OPEN);
+				if(!error) error = Texture::ERROR_FILE_READ;
+			}
+			job->data = job->buf.data(); job->size = job->buf.size();
+		}
+		bool deferred = !error&&!tm->_canDecodeAsync(job->filename.c_str());
+		if(!error&&!deferred)
+		{
+			MemDataSource mem(job->data,job->size);
+			tex = tm->_decode(job->filename.c_str(),mem,true,error);
+			std::vector<uint8_t>().swap(job->buf);
+		}
+		if(tex) texture_scale_mipmaps(tex,false); //Already in parallel.
+
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+			job->texture = tex; job->error = error;
+			job->deferred = deferred; job->done = true;
+		}
+		done.notify_all();
+	}
+}
+bool TextureManager::_canDecodeAsync(const char *filename)
+{
+	//NOTE: The UI's filter (StdTexFilter) decodes through the
+	//same image list table that the toolbars draw from so it's
+	//not safe off the main thread.
+	const char *ext = strrchr(filename,'.');
+	ext = ext?ext+1:filename;
+	for(auto ea:m_filters) if(ea->canRead(ext))
+	{
+		if(!ea->isReentrant()) return false;
+	}
+	return true;
+}
+void TextureManager::Async::finish(TextureManager *tm, Job *job)
+{
+	if(!job->deferred) return; job->deferred = false;
+
+	MemDataSource mem(job->data,job->size);
+	Texture::ErrorE error;
+	Texture *tex = tm->_decode(job->filename.c_str(),mem,true,error);
+	std::vector<uint8_t>().swap(job->buf);
+	if(tex) texture_scale_mipmaps(tex);
+
+	job->texture = tex; job->error = error;
+}
+
+struct TextureManager::Writer //writeAsync
+{
+	typedef std::packaged_task<Texture::ErrorE()> Job;
+
+	std::mutex mutex;
+	std::condition_variable cv,room;
+	std::list<Job> queue; int pending; bool quit;
+	std::vector<std::thread> threads;
+
+	std::map<TextureFilter*,std::mutex> filterLocks;
+
+	std::mutex &filterLock(TextureFilter *f)
+	{
+		std::lock_guard<std::mutex> lk(mutex); return filterLocks[f];
+	}
+
+	void work();
+};
+void TextureManager::Writer::work()
+{
+	for(;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lk(mutex);
+			cv.wait(lk,[&]{ return quit||!queue.empty(); });
+			if(queue.empty()) return; //Drain the queue before quitting.
+			job = std::move(queue.front()); queue.pop_front();
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lk(mutex); pending--;
+		}
+		room.notify_all();
+	}
+}
+
+struct TextureManager::Watch //watchTextures
+{
+	std::mutex mutex;
+	std::map<std::string,time_t> files; //normalizePath
+	std::set<std::string> changed;
+
+	int fd; //inotify
+	std::map<int,std::string> dirs;
+
+	std::atomic<bool> quit; std::thread thread;
+
+	void add(const std::string &key, time_t mtime);
+
+	void work();
+};
+void TextureManager::Watch::add(const std::string &key, time_t mtime)
+{
+	std::lock_guard<std::mutex> lk(mutex);
+
+	if(!files.insert({key,mtime}).second) return;
+
+	#ifdef __linux__
+	if(fd!=-1) //Watch the directory so that renames are seen.
+	{
+		std::string dir = key.substr(0,key.rfind('/'));
+		for(auto&ea:dirs) if(ea.second==dir) return;
+
+		int wd = inotify_add_watch(fd,dir.c_str(),IN_CLOSE_WRITE|IN_MOVED_TO|IN_ATTRIB);
+		if(wd!=-1) dirs[wd] = dir;
+		else log_error("inotify_add_watch failed on %s (%d)\n",dir.c_str(),errno);
+	}
+	#endif
+}
+void TextureManager::Watch::work()
+{
+	#ifdef __linux__
+	if(fd!=-1)
+	{
+		alignas(inotify_event) char buf[4096];
+		while(!quit)
+		{
+			pollfd pfd = {fd,POLLIN,0};
+			if(poll(&pfd,1,250)<=0) continue;
+			ssize_t n = read(fd,buf,sizeof(buf));
+			if(n<=0) continue;
+
+			std::lock_guard<std::mutex> lk(mutex);
+			for(char *p=buf;p<buf+n;)
+			{
+				auto *ev = (inotify_event*)p;
+				p+=sizeof(inotify_event)+ev->len;
+
+				auto it = dirs.find(ev->wd);
+				if(it==dirs.end()||!ev->len) continue;
+
+				std::string path = it->second+'/'+ev->name;
+				if(files.count(path)) changed.insert(path);
+			}
+		}
+		return;
+	}
+	#endif
+
+	std::vector<std::pair<std::string,time_t>> stats;
+	while(!quit)
+	{
+		for(int i=8;i-->0&&!quit;) 
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		{
+			std::lock_guard<std::mutex> lk(mutex);
+			stats.assign(files.begin(),files.end());
+		}
+		for(auto&ea:stats) //stat without holding the lock.
+		{
+			if(!file_modifiedtime(ea.first.c_str(),&ea.second))
+			ea.second = 0;
+		}
+		std::lock_guard<std::mutex> lk(mutex);
+		for(auto&ea:stats)
+		{
+			auto it = files.find(ea.first);
+			if(it!=files.end()&&ea.second>it->second)
+			{
+				it->second = ea.second; changed.insert(ea.first);
+			}
+		}
+	}
+}
+
+void TextureManager::watchTextures(bool watch)
+{
+	if(watch==(m_watch!=nullptr)) return;
+
+	if(!watch)
+	{
+		m_watch->quit = true;
+		m_watch->thread.join();
+		#ifdef __linux__
+		if(m_watch->fd!=-1) close(m_watch->fd);
+		#endif
+		delete m_watch; m_watch = nullptr; return;
+	}
+
+	m_watch = new Watch;
+	m_watch->quit = false;
+	m_watch->fd = -1;
+	#ifdef __linux__
+	m_watch->fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+	if(m_watch->fd==-1)
+	log_error("inotify_init1 failed (%d), polling textures instead\n",errno);
+	#endif
+	for(auto&ea:m_cache) if(!m_embedded.count(ea.first))
+	m_watch->add(ea.first,ea.second.texture->m_loadTime);
+
+	m_watch->thread = std::thread(&Watch::work,m_watch);
+}
+
 TextureManager::~TextureManager()
 {
 	log_debug("TextureManager releasing %d textures and %d filters\n",
 	m_textures.size(),m_filters.size());
+	log_debug("TextureManager cache: %d hits, %d misses, %d evictions, %d bytes\n",
+	m_stats.hits,m_stats.misses,m_stats.evictions,m_stats.bytes);
+
+	watchTextures(false);
+
+	if(m_writer)
+	{
+		{
+			std::lock_guard<std::mutex> lk(m_writer->mutex);
+			m_writer->quit = true;
+		}
+		m_writer->cv.notify_all();
+		for(auto&ea:m_writer->threads) ea.join();
+
+		delete m_writer;
+	}
+
+	if(m_async)
+	{
+		{
+			std::lock_guard<std::mutex> lk(m_async->mutex);
+			m_async->quit = true;
+		}
+		m_async->cv.notify_all();
+		for(auto&ea:m_async->threads) ea.join();
+
+		for(auto&ea:m_async->jobs)
+		{
+			delete ea.second->texture; delete ea.second;
+		}
+		delete m_async;
+	}
 
 	for(auto*ea:m_textures) delete ea;
 
@@ -101,30 +396,98 @@ Texture *TextureManager::getTexture(const char *filename, bool noCache, bool war
 {
 	if(!filename) return nullptr; //???
 
-	if(!noCache)	
-	for(auto*ea:m_textures)
-	if(!strcmp(filename,ea->m_filename.c_str()))
+	if(!*filename)
 	{
-		log_debug("cached image %s\n",filename);
-		return ea;
+		return getBlankTexture("blank");
 	}
 
-	if(!*filename)
+	std::string key = normalizePath(filename);
+
+	if(!noCache)
 	{
-		return getBlankTexture("blank");
+		if(Entry*e=_find(key))
+		{
+			log_debug("cached image %s\n",filename);
+			return e->texture;
+		}
+		if(m_lastError) return nullptr; //_find failed to reload.
+	}
+
+	if(!noCache&&m_async) //loadTextureAsync?
+	{
+		auto it = m_async->jobs.find(key);
+		if(it!=m_async->jobs.end())
+		{
+			auto *job = it->second;
+			{
+				std::unique_lock<std::mutex> lk(m_async->mutex);
+				m_async->done.wait(lk,[&]{ return job->done; });
+			}
+			m_async->jobs.erase(it);
+
+			Async::finish(this,job);
+			Texture *ret = _cache(key.c_str(),job->texture,job->error,warning);
+			delete job; return ret;
+		}
+	}
+
+	Texture::ErrorE error;
+	Texture *tex = _decodeFile(filename,error);
+	return _cache(noCache?nullptr:key.c_str(),tex,error,warning);
+}
+Texture *TextureManager::cacheTexture(const char *filename, Texture *tex)
+{
+	if(!filename||!*filename||!tex) return nullptr;
+
+	tex->m_filename = filename;
+	const char *name = strrchr(filename,'/');
+	tex->m_name = name?name+1:filename;
+	if(auto ext=tex->m_name.rfind('.'))
+	{
+		if(~ext) tex->m_name.erase(ext);
+	}
+	time_t mtime;
+	if(file_modifiedtime(filename,&mtime)) tex->m_loadTime = mtime;
+
+	std::string key = normalizePath(filename);
+	return _cache(key.c_str(),tex,Texture::ERROR_NONE,false);
+}
+Texture *TextureManager::_decodeFile(const char *filename, Texture::ErrorE &error)
+{
+	auto it = m_embedded.find(normalizePath(filename));
+	if(it!=m_embedded.end())
+	if(Blob blob=it->second.blob.lock())
+	{
+		auto &e = it->second;
+		MemDataSource mem(blob->data()+e.offset,e.size);
+		return _decode(filename,mem,true,error);
 	}
 
 	FileDataSource lvalue(filename);
-	Texture *ret = getTexture(filename,lvalue,warning);
 
-	if(noCache&&ret) m_textures.pop_back(); return ret; //HACK
+	return _decode(filename,lvalue,true,error);
 }
 Texture *TextureManager::getTexture(const char *name_and_format, DataSource &src, bool warning)
 {
 	if(!name_and_format) return nullptr;
-	Texture *newTexture = new Texture();
 
 	void *is_file = dynamic_cast<FileDataSource*>(&src); //HACK
+
+	Texture::ErrorE error;
+	Texture *tex = _decode(name_and_format,src,is_file!=nullptr,error);
+	tex = _cache(nullptr,tex,error,warning);
+	if(tex) m_textures.push_back(tex); return tex;
+}
+Texture *TextureManager::_decode(const char *name_and_format, DataSource &src, bool is_file, Texture::ErrorE &error)
+{
+	//NOTE: This runs on loadTextureAsync's worker threads if all of
+	//the filters are reentrant. It mustn't touch the TextureManager's
+	//state.
+
+	error = Texture::ERROR_NONE; //No filter?
+
+	Texture *newTexture = new Texture();
+
 	if(is_file) newTexture->m_filename = name_and_format;
 
 	const char *name = strrchr(name_and_format,'/');
@@ -140,14 +503,13 @@ Texture *TextureManager::getTexture(const char *name_and_format, DataSource &src
 	newTexture->m_origFormat = name; //NEW
 
 	for(auto ea:m_filters) if(ea->canRead(name))	
-	if(Texture::ErrorE error=ea->readData(*newTexture,src,name))
 	{
-		m_lastError = error;
-		log_error("filter failed to read texture: %d\n",error);
-	}
-	else
-	{
-		m_lastError = Texture::ERROR_NONE;
+		if(error=ea->readData(*newTexture,src,name))
+		{
+			log_error("filter failed to read texture: %d\n",error);
+			continue;
+		}
+
 		log_debug("read from image source %s\n",name_and_format);
 		newTexture->removeOpaqueAlphaChannel(); //???
 		if(is_file)
@@ -157,68 +519,375 @@ Texture *TextureManager::getTexture(const char *name_and_format, DataSource &src
 			newTexture->m_loadTime = mtime;
 		}
 		newTexture->m_origWidth = newTexture->m_width;
-		newTexture->m_origHeight = newTexture->m_height;	
-		if(texture_scale_need_scale(newTexture->m_width,newTexture->m_height))
+		newTexture->m_origHeight = newTexture->m_height;
+
+		return newTexture;
+	}		
+
+	delete newTexture; return nullptr;
+}
+Texture *TextureManager::_cache(const char *key, Texture *newTexture, Texture::ErrorE error, bool warning)
+{
+	if(!newTexture)
+	{
+		if(error) m_lastError = error; return nullptr;
+	}
+
+	m_lastError = Texture::ERROR_NONE;
+
+	if(texture_scale_need_scale(newTexture->m_width,newTexture->m_height))
+	{
+		if(warning) txmgr_doWarning = true;
+
+		/*2019: Disabling this NPOT (non-power-of-two) hack.
+		//I'm uncomfortable upscaling. End-users can adjust.
+		//NOTE: Won't work as-is with std::vector.
+		uint8_t *oldData = newTexture->m_data;
+		newTexture->m_data = texture_scale_auto
+		(newTexture->m_data,newTexture->m_format,
+		newTexture->m_width,newTexture->m_height);
+		delete[] oldData;
+		*/
+	}
+
+	if(!key) return newTexture; //noCache
+
+	m_stats.misses++;
+
+	auto ins = m_cache.insert({key,Entry()});
+	Entry &e = ins.first->second;
+	if(!ins.second) //Refilling an evicted entry?
+	{
+		if(!e.evicted) m_reloaded = true; //watchTextures?
+
+		_assign(e,newTexture); return e.texture;
+	}
+
+	e.texture = newTexture; e.refs = 0;
+	e.bytes = texmgr_bytes(newTexture);
+	e.evicted = e.unused = false;
+	m_entries[newTexture] = &e;
+	m_textures.push_back(newTexture);
+
+	if(m_watch&&!m_embedded.count(key))
+	m_watch->add(key,newTexture->m_loadTime);
+
+	m_stats.textures++;
+	m_stats.bytes+=e.bytes; return newTexture;
+}
+TextureManager::Entry *TextureManager::_find(const std::string &key)
+{
+	m_lastError = Texture::ERROR_NONE;
+
+	auto it = m_cache.find(key);
+	if(it==m_cache.end()) return nullptr;
+
+	Entry &e = it->second;
+	if(e.evicted)
+	{
+		m_stats.misses++;
+
+		if(!_reload(e)) return nullptr;
+	}
+	else m_stats.hits++;
+
+	if(e.unused) m_lru.splice(m_lru.begin(),m_lru,e.lru); return &e;
+}
+bool TextureManager::_reload(Entry &e, bool warning)
+{
+	Texture *t = e.texture;
+
+	Texture::ErrorE error;
+	Texture *tex = _decodeFile(t->m_filename.c_str(),error);
+	if(!_cache(nullptr,tex,error,warning)) return false;
+
+	_assign(e,tex); return true;
+}
+void TextureManager::_assign(Entry &e, Texture *tex)
+{
+	Texture *t = e.texture;
+
+	t->m_isBad = false;
+	t->m_width = tex->m_width;
+	t->m_height = tex->m_height;
+	t->m_origWidth = tex->m_origWidth;
+	t->m_origHeight = tex->m_origHeight;
+	t->m_format = tex->m_format;
+	t->m_data.swap(tex->m_data);
+	t->m_mipmaps.swap(tex->m_mipmaps);
+	t->m_loadTime = tex->m_loadTime;
+	t->m_revision = tex->m_revision;
+	delete tex;
+
+	size_t bytes = texmgr_bytes(t);
+	if(e.evicted)
+	{
+		e.evicted = false; m_stats.textures++;
+	}
+	else m_stats.bytes-=e.bytes;
+	m_stats.bytes+=bytes;
+	if(e.unused)
+	{
+		m_stats.unusedBytes+=bytes-e.bytes;
+	}
+	e.bytes = bytes; 
+	
+	if(e.unused) _trim();
+}
+void TextureManager::_trim()
+{
+	while(m_stats.unusedBytes>m_cacheBudget&&!m_lru.empty())
+	{
+		Entry *e = m_lru.back(); m_lru.pop_back();
+
+		log_debug("evicting texture %s\n",e->texture->m_filename.c_str());
+
+		m_stats.evictions++;
+		m_stats.textures--;
+		m_stats.bytes-=e->bytes;
+		m_stats.unusedBytes-=e->bytes;
+
+		std::vector<uint8_t>().swap(e->texture->m_data);
+		std::vector<Texture::Mipmap>().swap(e->texture->m_mipmaps);
+		e->bytes = 0;
+		e->evicted = true; e->unused = false;
+	}
+}
+void TextureManager::setCacheBudget(size_t unusedBytes)
+{
+	m_cacheBudget = unusedBytes; _trim();
+}
+
+void TextureManager::addTextureRef(Texture *tex)
+{
+	TextureManager *tm = s_instance; if(!tm) return;
+
+	auto it = tm->m_entries.find(tex);
+	if(it==tm->m_entries.end()) return; //Default or blank?
+
+	Entry &e = *it->second;
+	if(e.refs++) return;
+	
+	if(e.unused)
+	{
+		tm->m_lru.erase(e.lru); e.unused = false;
+		tm->m_stats.unusedBytes-=e.bytes;
+	}
+	if(e.evicted) //Held by an undo record?
+	{
+		tm->m_stats.misses++;
+
+		if(!tm->_reload(e))
 		{
-			if(warning) txmgr_doWarning = true;
-
-			/*2019: Disabling this NPOT (non-power-of-two) hack.
-			//I'm uncomfortable upscaling. End-users can adjust.
-			//NOTE: Won't work as-is with std::vector.
-			uint8_t *oldData = newTexture->m_data;
-			newTexture->m_data = texture_scale_auto
-			(newTexture->m_data,newTexture->m_format,
-			newTexture->m_width,newTexture->m_height);
-			delete[] oldData;
-			*/
+			//The material mustn't see an empty image.
+			Texture *bad = tm->getDefaultTexture(tex->m_filename.c_str());
+			Texture *cp = new Texture(*bad);
+			cp->m_loadTime = 0; //Let reloadTextures retry it.
+			tm->_assign(e,cp); tex->m_isBad = true;
 		}
+	}
+}
+void TextureManager::removeTextureRef(Texture *tex)
+{
+	TextureManager *tm = s_instance; if(!tm) return;
+
+	auto it = tm->m_entries.find(tex);
+	if(it==tm->m_entries.end()) return; //Default or blank?
+
+	Entry &e = *it->second; assert(e.refs>0);
+	if(--e.refs||e.evicted) return;
+
+	//Count mipmaps made since it was cached.
+	size_t bytes = texmgr_bytes(tex);
+	tm->m_stats.bytes+=bytes-e.bytes; e.bytes = bytes;
+
+	tm->m_lru.push_front(&e); 
+	e.lru = tm->m_lru.begin(); e.unused = true;
+	tm->m_stats.unusedBytes+=e.bytes;
+	tm->_trim();
+}
+
+bool TextureManager::loadTextureAsync(const char *filename)
+{
+	if(!filename||!*filename) return false;
+
+	std::string key = normalizePath(filename);
+
+	auto it = m_cache.find(key);
+	if(it!=m_cache.end()&&!it->second.evicted) return false;
+
+	_queue(key,it==m_cache.end()?filename:it->second.texture->m_filename.c_str());
+	
+	return true;
+}
+void TextureManager::_queue(const std::string &key, const char *filename)
+{
+	if(!m_async)
+	{
+		m_async = new Async; m_async->quit = false;
+
+		int n = std::thread::hardware_concurrency();
+		n = std::max(1,std::min(8,n));
+		for(int i=n;i-->0;) m_async->threads.emplace_back
+		(&Async::work,m_async,this);
+	}
+
+	std::lock_guard<std::mutex> lk(m_async->mutex);
+
+	auto *&job = m_async->jobs[key];
+	if(job)
+	{
+		if(!job->done||job->texture||job->deferred) return;
+
+		delete job; //Try again if it failed before.
+	}
+	job = new Async::Job;
+	job->filename = filename;
+	auto it = m_embedded.find(key);
+	if(it!=m_embedded.end())
+	if(job->blob=it->second.blob.lock())
+	{
+		auto &e = it->second;
+		job->data = job->blob->data()+e.offset; job->size = e.size;
+	}
+	job->texture = nullptr; job->error = Texture::ERROR_NONE;
+	job->deferred = job->done = false;
+
+	m_async->queue.push_back(job);
+	m_async->cv.notify_one();
+}
+bool TextureManager::isTexturePending(const char *filename)
+{
+	if(!m_async) return false;
+
+	std::string key = normalizePath(filename);
+
+	std::lock_guard<std::mutex> lk(m_async->mutex);
 
-		//if(!noCache)
+	auto it = m_async->jobs.find(key);
+	return it!=m_async->jobs.end()&&!it->second->done;
+}
+bool TextureManager::finishTextures()
+{
+	if(!m_async) return false;
+
+	//NOTE: Failures are left for getTexture to report.
+	bool ret = false;
+	for(auto it=m_async->jobs.begin();it!=m_async->jobs.end();)	
+	{
+		auto *job = it->second;
+		{
+			std::lock_guard<std::mutex> lk(m_async->mutex);
+			if(!job->done){ it++; continue; }
+		}
+		//The workers are done with job, so the lock isn't held while
+		//decoding it here.
+		Async::finish(this,job);
+		if(job->texture)
+		{
+			_cache(it->first.c_str(),job->texture,job->error,true);
+			delete job;
+			it = m_async->jobs.erase(it);
+			ret = true;
+		}
+		else if(m_cache.count(it->first)) //watchTextures?
 		{
-			m_textures.push_back(newTexture);
+			msg_warning("%s %s",transll
+			(TRANSLATE_NOOP("LowLevel","Could not load")),job->filename.c_str());
+			delete job;
+			it = m_async->jobs.erase(it);
 		}
+		else it++;
+	}
+	return ret;
+}
 
-		return newTexture;
-	}		
+void TextureManager::addEmbeddedTexture(const char *filename, Blob blob, size_t offset, size_t size)
+{
+	assert(blob&&offset+size<=blob->size());
 
-	delete newTexture; return nullptr;
+	//Forget the closed models' textures.
+	for(auto it=m_embedded.begin();it!=m_embedded.end();)
+	{
+		if(it->second.blob.expired()) it = m_embedded.erase(it); else it++;
+	}
+
+	std::string key = normalizePath(filename);
+
+	Embedded &e = m_embedded[key];
+	Blob old = e.blob.lock(); //If not, it can't be compared.
+	bool changed = !old||e.size!=size
+	||memcmp(old->data()+e.offset,blob->data()+offset,size);
+	e.blob = blob; e.offset = offset; e.size = size;
+
+	//The same model was opened again after it was saved?
+	auto it = m_cache.find(key);
+	if(changed&&it!=m_cache.end()&&!it->second.evicted)
+	{
+		if(!_reload(it->second,true))
+		msg_warning("%s %s",transll
+		(TRANSLATE_NOOP("LowLevel","Could not load")),filename);
+	}
+}
+bool TextureManager::getEmbeddedTexture(const char *filename, const uint8_t **data, size_t *size)
+{
+	if(!filename||!*filename) return false;
+
+	auto it = m_embedded.find(normalizePath(filename));
+	if(it==m_embedded.end()) return false;
+
+	//The caller's model keeps the blob alive if it's using it.
+	auto &e = it->second; Blob blob = e.blob.lock();
+	if(!blob) return false;
+	if(data) *data = blob->data()+e.offset;
+	if(size) *size = e.size; return true;
 }
 
 bool TextureManager::reloadTextures()
 {
+	if(m_watch) //Only changed files.
+	{
+		std::set<std::string> changed;
+		{
+			std::lock_guard<std::mutex> lk(m_watch->mutex);
+			changed.swap(m_watch->changed);
+		}
+		for(auto&ea:changed)
+		{
+			auto it = m_cache.find(ea);
+			if(it!=m_cache.end()&&!it->second.evicted)
+			{
+				log_debug("texture changed %s\n",ea.c_str());
+				_queue(ea,it->second.texture->m_filename.c_str());
+			}
+		}
+		finishTextures();
+
+		bool ret = m_reloaded; m_reloaded = false; return ret;
+	}
+
 	bool anyTextureChanged = false;
 	
-	//TODO: Make getTexture not push/pop m_textures.
-	//for(auto*ea:m_textures)
-	for(size_t i=m_textures.size();i-->0;)
+	for(auto&ea:m_cache)
 	{
-		Texture *ea = m_textures[i];
+		Entry &e = ea.second; 
+		
+		if(e.evicted) continue; //It'll be current when it's reloaded.
+
+		Texture *t = e.texture;
 
 		time_t mtime;		
-		if(!file_modifiedtime(ea->m_filename.c_str(),&mtime)||mtime<=ea->m_loadTime)
+		if(!file_modifiedtime(t->m_filename.c_str(),&mtime)||mtime<=t->m_loadTime)
 		continue;
 		
-		Texture *refreshedTexture = getTexture(ea->m_filename.c_str(),true);
-		if(refreshedTexture)
+		if(_reload(e,true))
 		{
-			log_debug("reloaded texture %s\n",ea->m_filename.c_str());
-
-			refreshedTexture->removeOpaqueAlphaChannel(); //???
-							
-			ea->m_width = refreshedTexture->m_width;
-			ea->m_height = refreshedTexture->m_height;
-			ea->m_origWidth = refreshedTexture->m_origWidth;
-			ea->m_origHeight = refreshedTexture->m_origHeight;
-			ea->m_format = refreshedTexture->m_format;
-			ea->m_data.swap(refreshedTexture->m_data);
-			ea->m_loadTime = mtime;
-
-			delete refreshedTexture;
+			log_debug("reloaded texture %s\n",t->m_filename.c_str());
 
 			anyTextureChanged = true;
 		}
 		else msg_warning("%s %s",transll
-		(TRANSLATE_NOOP("LowLevel","Could not load")),ea->m_filename.c_str());
+		(TRANSLATE_NOOP("LowLevel","Could not load")),t->m_filename.c_str());
 	}
 	
 	return anyTextureChanged;
@@ -226,15 +895,10 @@ bool TextureManager::reloadTextures()
 
 Texture *TextureManager::getBlankTexture(const char *name)
 {
-	for(auto*ea:m_textures)
+	if(m_blank)
 	{
-		//2019: Assuming this is erroneous.
-		//if(!strcmp(name,""))
-		if(ea->m_name.empty())
-		{
-			log_debug("cached image (blank)\n");
-			return ea;
-		}
+		log_debug("cached image (blank)\n");
+		return m_blank;
 	}
 
 	Texture *tex = new Texture();
@@ -254,12 +918,16 @@ Texture *TextureManager::getBlankTexture(const char *name)
 
 	tex->removeOpaqueAlphaChannel(); //??? //??? //??? //??? //???
 
-	m_textures.push_back(tex); return tex;
+	m_textures.push_back(tex); return m_blank = tex;
 }
 
 Texture *TextureManager::getDefaultTexture(const char *filename)
 {
-	Texture *tex = new Texture();
+	//NOTE: These had been made anew every time.
+	Texture *&tex = m_defaults[filename];
+	if(tex) return tex;
+
+	tex = new Texture();
 	tex->m_isBad = true;
 	
 	//string str = string("bad: ")+filename;
@@ -275,7 +943,17 @@ Texture *TextureManager::getDefaultTexture(const char *filename)
 	tex->m_data.resize(4*size*size);
 	uint8_t *data = tex->m_data.data();
 
-	char pattern[] = "					  x	x	 x x		x		x x	 x	x			  ";
+	//NOTE: This had been mangled by a spaces-to-tabs conversion so
+	//that it was too short.
+	static const char pattern[64+1] = 
+	"        "
+	" x    x "
+	"  x  x  "
+	"   xx   "
+	"   xx   "
+	"  x  x  "
+	" x    x "
+	"        ";
 	for(int y=tex->m_height;y-->0;)	
 	for(int x=tex->m_width;x-->0;) switch(pattern[y*8+x])
 	{
@@ -330,6 +1008,100 @@ Texture::ErrorE TextureManager::write(Texture *tex, DataDest &dest, utf8 format)
 	return Texture::ERROR_UNSUPPORTED_OPERATION;
 }
 
+static TextureManager::WriteFuture texmgr_write_error(Texture::ErrorE e)
+{
+	std::promise<Texture::ErrorE> p; p.set_value(e); return p.get_future();
+}
+TextureManager::WriteFuture TextureManager::writeAsync(Texture *tex, utf8 filename)
+{
+	if(!filename||!*filename||!tex)
+	{
+		delete tex; return texmgr_write_error(Texture::ERROR_BAD_ARGUMENT);
+	}
+
+	utf8 format = strrchr(filename,'.');
+	format = format?format+1:filename;
+
+	//m_filters isn't safe to walk on the workers.
+	std::vector<TextureFilter*> filters;
+	for(auto ea:m_filters) if(ea->canWrite(format)) 
+	filters.push_back(ea);
+	if(filters.empty())
+	{
+		delete tex; return texmgr_write_error(Texture::ERROR_UNSUPPORTED_OPERATION);
+	}
+
+	std::shared_ptr<Texture> keep(tex); //std::function must be copyable.
+	std::string fn = filename, fmt = format;
+	return writeAsync([=]()->Texture::ErrorE
+	{
+		Texture::ErrorE error = Texture::ERROR_UNSUPPORTED_OPERATION;
+		for(auto ea:filters)
+		{
+			std::unique_lock<std::mutex> lk;
+			if(!ea->isReentrant())
+			lk = std::unique_lock<std::mutex>(m_writer->filterLock(ea));
+
+			FileDataDest dest(fn.c_str());
+			if(!(error=ea->writeData(*keep,dest,fmt.c_str()))) break;
+
+			log_error("filter could not write texture: %d\n",error);
+		}
+		return error;
+	});
+}
+TextureManager::WriteFuture TextureManager::writeAsync
+(const void *pixels, int w, int h, bool alpha, utf8 filename)
+{
+	if(!pixels||w<=0||h<=0) return texmgr_write_error(Texture::ERROR_BAD_ARGUMENT);
+
+	auto *tex = new Texture;
+	tex->m_width = w; tex->m_height = h;
+	tex->m_format = alpha?Texture::FORMAT_RGBA:Texture::FORMAT_RGB;
+	auto *p = (const uint8_t*)pixels;
+	tex->m_data.assign(p,p+(size_t)w*h*(alpha?4:3));
+	return writeAsync(tex,filename);
+}
+TextureManager::WriteFuture TextureManager::writeAsync(std::function<Texture::ErrorE()> job)
+{
+	if(!m_writer)
+	{
+		m_writer = new Writer; 
+		m_writer->pending = 0; m_writer->quit = false;
+
+		//Leave a core to the thread that's making the images.
+		int n = std::thread::hardware_concurrency()-1;
+		n = std::max(1,std::min(4,n));
+		for(int i=n;i-->0;) m_writer->threads.emplace_back
+		(&Writer::work,m_writer);
+	}
+
+	Writer::Job task(std::move(job));
+	auto f = task.get_future();
+	{
+		std::unique_lock<std::mutex> lk(m_writer->mutex);
+		m_writer->room.wait(lk,[&]{ return m_writer->pending<m_writeLimit; });
+		m_writer->pending++;
+		m_writer->queue.push_back(std::move(task));
+	}
+	m_writer->cv.notify_one(); return f;
+}
+void TextureManager::setWriteQueueLimit(int n)
+{
+	n = std::max(1,n); if(!m_writer){ m_writeLimit = n; return; }
+	{
+		std::lock_guard<std::mutex> lk(m_writer->mutex); m_writeLimit = n;
+	}
+	m_writer->room.notify_all();
+}
+void TextureManager::finishWrites()
+{
+	if(!m_writer) return;
+
+	std::unique_lock<std::mutex> lk(m_writer->mutex);
+	m_writer->room.wait(lk,[&]{ return m_writer->pending==0; });
+}
+
 static utf8 texmgr_all_types //DUPLICATES filtermgr.cc
 (std::vector<TextureFilter*> &f, std::string &g, utf8(TextureFilter::*mf)())
 {
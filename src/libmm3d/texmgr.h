@@ -73,6 +73,11 @@ public:
 	// If the load succeeds,return TextureError::ERROR_NONE.
 	virtual Texture::ErrorE readData(Texture &texture, DataSource &source, utf8 format)= 0;
 
+	// Return true if readData can run on several threads at once. If not
+	// loadTextureAsync's workers only read the file and readData is called
+	// on the main thread when the texture is finished.
+	virtual bool isReentrant(){ return false; }
+
 
 		//UNUSED//UNUSED//UNUSED//UNUSED//
 		//REMOVE//REMOVE//REMOVE//REMOVE//
@@ -133,6 +138,14 @@ public:
 	// returns true if any textures have been reloaded.
 	bool reloadTextures();
 
+	// Starts (or stops) a thread that watches the files of cached textures,
+	// with inotify on Linux or else by polling them every couple seconds.
+	// reloadTextures then only rereads the files that have changed and it
+	// decodes them on loadTextureAsync's workers, so it must be called on
+	// a timer to pick them up. It must be called from the main thread.
+	void watchTextures(bool);
+	bool isWatchingTextures(){ return m_watch!=nullptr; }
+
 	bool canRead(utf8 filename_or_extension)
 	{
 		return texmgr_can_read_or_write
@@ -146,11 +159,73 @@ public:
 	Texture *getTexture(const char *name_and_format, DataSource &ds, bool warn=true);
 	Texture *getTexture(const char *filename, bool noCache=false, bool warning=true);
 	Texture *getBlankTexture(const char *filename);
+
+	// Caches tex as filename's image, e.g. after writing it out. If the
+	// file is already cached, its texture takes tex's pixels and is what
+	// is returned. Either way the TextureManager owns tex now.
+	Texture *cacheTexture(const char *filename, Texture *tex);
+
+	// Starts reading and decoding filename on a worker thread unless it's
+	// cached or underway. Returns true if getTexture would have to wait on
+	// it. finishTextures moves the textures that are done into the cache,
+	// returning true if there are any. getTexture waits on and finishes
+	// the one it's asked for. These must be called from the main thread.
+	bool loadTextureAsync(const char *filename);
+	bool isTexturePending(const char *filename);
+	bool finishTextures();
+
+	// MM3D files can embed the image files of their textures. The model
+	// registers them under the paths it gives their materials, and they
+	// are decoded from memory when getTexture or loadTextureAsync asks
+	// for them. The blob is only weakly held. The models that use it hold
+	// it (Model::keepEmbeddedTextures) so it's freed after they're closed,
+	// after which the texture can't be reloaded if its pixels are evicted.
+	typedef std::shared_ptr<const std::vector<uint8_t>> Blob;
+	void addEmbeddedTexture(const char *filename, Blob, size_t offset, size_t size);
+	bool getEmbeddedTexture(const char *filename, const uint8_t **data, size_t *size);
+	bool isEmbeddedTexture(const char *filename)
+	{
+		return getEmbeddedTexture(filename,nullptr,nullptr);
+	}
+
+	// Materials hold references on the textures they display. Textures
+	// that are loaded from files and that are no longer referenced are
+	// kept until they exceed the cache budget, and then the least recent
+	// have their pixels freed. They're reloaded when used again so that
+	// pointers to them are never left dangling. Textures that are never
+	// referenced (e.g. backgrounds) are never evicted.
+	static void addTextureRef(Texture*);
+	static void removeTextureRef(Texture*);
+
+	struct CacheStats
+	{
+		size_t hits,misses,evictions;
+		size_t textures,bytes,unusedBytes; //Resident.
+	};
+	void setCacheBudget(size_t unusedBytes);
+	size_t getCacheBudget(){ return m_cacheBudget; }
+	const CacheStats &getCacheStats(){ return m_stats; }
+
 	Texture *getDefaultTexture(const char *filename);
 	Texture::ErrorE getLastError(){ return m_lastError; };
 	
 	Texture::ErrorE write(Texture *tex, utf8 filename);
 	Texture::ErrorE write(Texture *tex, DataDest &data, utf8 format);
+
+	// writeAsync encodes and writes on a worker thread and returns right
+	// away. If getWriteQueueLimit writes are already pending it waits for
+	// one to finish, so that a caller that makes images faster than they
+	// can be saved (e.g. exporting frames) doesn't pile them up in memory.
+	// tex is deleted after it's written. The pixels overload copies them.
+	// The job overload is for images encoded by something besides filters
+	// (e.g. the UI's PNG writer) that still want to overlap the file I/O.
+	typedef std::future<Texture::ErrorE> WriteFuture;
+	WriteFuture writeAsync(Texture *tex, utf8 filename);
+	WriteFuture writeAsync(const void *pixels, int w, int h, bool alpha, utf8 filename);
+	WriteFuture writeAsync(std::function<Texture::ErrorE()> job);
+	void setWriteQueueLimit(int);
+	int getWriteQueueLimit(){ return m_writeLimit; }
+	void finishWrites(); //Waits on all of them.
 				
 	//UNUSED
 	bool canWrite(utf8 filename_or_extension)
@@ -162,18 +237,53 @@ public:
 
 protected:
 		
-	TextureManager():m_lastError(){} //NEW //m_defaultTexture()
+	TextureManager():m_lastError(),m_async(),m_watch(),m_reloaded()
+	,m_blank(),m_cacheBudget(256*1024*1024),m_stats()
+	,m_writer(),m_writeLimit(4){} //NEW //m_defaultTexture()
 	~TextureManager();
 
 	static TextureManager *s_instance; //???
 
 	std::vector<TextureFilter*> m_filters;		
-	std::vector<Texture*> m_textures;
+	std::vector<Texture*> m_textures; //Owns all.
 	Texture::ErrorE	m_lastError;
 
+	struct Entry //NEW
+	{
+		Texture *texture; int refs;
+
+		size_t bytes; bool evicted,unused;
+
+		std::list<Entry*>::iterator lru;
+	};
+	std::unordered_map<std::string,Entry> m_cache; //normalizePath
+	std::unordered_map<const Texture*,Entry*> m_entries;
+	std::unordered_map<std::string,Texture*> m_defaults;
+	std::list<Entry*> m_lru; //Most recent first.
+	Texture *m_blank;
+	size_t m_cacheBudget;
+
+	struct Embedded{ std::weak_ptr<Blob::element_type> blob; size_t offset,size; }; //NEW
+	std::unordered_map<std::string,Embedded> m_embedded; //normalizePath
+	CacheStats m_stats;
+
 	//Texture *m_defaultTexture; //UNUSED?
 
 	std::string _read,_write; //NEW
+
+	struct Async; Async *m_async; //NEW
+	struct Watch; Watch *m_watch; bool m_reloaded; //NEW
+	struct Writer; Writer *m_writer; int m_writeLimit; //NEW
+
+	Texture *_decode(const char*,DataSource&,bool,Texture::ErrorE&);
+	bool _canDecodeAsync(const char*);
+	Texture *_decodeFile(const char*,Texture::ErrorE&);
+	Texture *_cache(const char*,Texture*,Texture::ErrorE,bool);
+	Entry *_find(const std::string&);
+	void _queue(const std::string&,const char*);
+	bool _reload(Entry&,bool warning=false);
+	void _assign(Entry&,Texture*);
+	void _trim();
 };
 
 #endif // __TEXMGR_H
@@ -25,6 +25,11 @@
 #include "texscale.h"
 
 #include "log.h"
+#include "glheaders.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 static unsigned MAX_SCALE_SIZE = 2048;
 
@@ -140,3 +145,105 @@ uint8_t *texture_scale_size(uint8_t *data,Texture::FormatE format, int oldx, int
 	return dest;
 }
 
+
+static void texscale_halve_rows(const uint8_t *src, int w, int h, unsigned bpp,
+uint8_t *dst, int nw, int y0, int y1)
+{
+	//A 1 pixel wide/tall level reuses its edge (x1==x0 or y1==y0.)
+	int dx = w>1?bpp:0;
+
+	for(int y=y0;y<y1;y++)
+	{
+		const uint8_t *r0 = src+2*y*w*bpp;
+		const uint8_t *r1 = h>1?r0+w*bpp:r0;
+		uint8_t *d = dst+y*nw*bpp;
+
+		int x = 0;
+
+#ifdef __SSE2__
+		if(bpp==4&&dx) //2 RGBA pixels from 4x2.
+		{
+			__m128i z = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+			for(;x+2<=nw;x+=2)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(r0+x*8));
+				__m128i b = _mm_loadu_si128((const __m128i*)(r1+x*8));
+				__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a,z),_mm_unpacklo_epi8(b,z));
+				__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a,z),_mm_unpackhi_epi8(b,z));
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo,hi),_mm_unpackhi_epi64(lo,hi));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum,two),2);
+				_mm_storel_epi64((__m128i*)(d+x*4),_mm_packus_epi16(sum,z));
+			}
+		}
+#endif
+		for(;x<nw;x++)
+		{
+			const uint8_t *p = r0+2*x*bpp, *q = r1+2*x*bpp;
+			for(unsigned b=0;b<bpp;b++)
+			d[x*bpp+b] = (uint8_t)((p[b]+p[b+dx]+q[b]+q[b+dx]+2)>>2);
+		}
+	}
+}
+
+void texture_scale_mipmaps(Texture *tex, bool parallel)
+{
+	int w = tex->m_width, h = tex->m_height;
+
+	if(!tex->m_mipmaps.empty()||w<=1&&h<=1) return;
+
+	unsigned bpp = tex->m_format==Texture::FORMAT_RGB?3:4;
+
+	if(tex->m_data.size()<(size_t)w*h*bpp) return; //Evicted?
+
+	int nt = 1;
+	if(parallel)
+	{
+		nt = std::thread::hardware_concurrency();
+		nt = std::max(1,std::min(8,nt));
+	}
+
+	const uint8_t *src = tex->m_data.data();
+	while(w>1||h>1)
+	{
+		int nw = std::max(1,w/2), nh = std::max(1,h/2);
+
+		tex->m_mipmaps.push_back(Texture::Mipmap());
+		auto &mip = tex->m_mipmaps.back();
+		mip.width = nw; mip.height = nh;
+		mip.data.resize((size_t)nw*nh*bpp);
+		uint8_t *dst = mip.data.data();
+
+		//Don't bother with threads on small levels.
+		int n = std::min(nt,std::max(1,nw*nh>>16));
+		if(n>1)
+		{
+			std::vector<std::thread> threads;
+			for(int i=1;i<n;i++) threads.emplace_back
+			(texscale_halve_rows,src,w,h,bpp,dst,nw,nh*i/n,nh*(i+1)/n);
+			texscale_halve_rows(src,w,h,bpp,dst,nw,0,nh/n);
+			for(auto&ea:threads) ea.join();
+		}
+		else texscale_halve_rows(src,w,h,bpp,dst,nw,0,nh);
+
+		src = dst; w = nw; h = nh;
+	}
+}
+
+void texture_scale_upload(Texture *tex)
+{
+	texture_scale_mipmaps(tex);
+
+	GLuint format = tex->m_format==Texture::FORMAT_RGBA?GL_RGBA:GL_RGB;
+
+	//https://github.com/zturtleman/mm3d/issues/85
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+
+	glTexImage2D(GL_TEXTURE_2D,0,format,tex->m_width,tex->m_height,0,
+	format,GL_UNSIGNED_BYTE,tex->m_data.data());
+
+	int level = 1; for(auto&ea:tex->m_mipmaps)
+	{
+		glTexImage2D(GL_TEXTURE_2D,level++,format,ea.width,ea.height,0,
+		format,GL_UNSIGNED_BYTE,ea.data.data());
+	}
+}
@@ -36,4 +36,14 @@ bool texture_scale_need_scale(unsigned x, unsigned y);
 uint8_t *texture_scale_auto(uint8_t *data,Texture::FormatE format, int &oldx, int &oldy);
 uint8_t *texture_scale_size(uint8_t *data,Texture::FormatE format, int oldx, int oldy, int newx, int newy);
 
+// Fills tex->m_mipmaps if it's empty, halving the image down to 1x1 with
+// a 2x2 box filter. If parallel is true large levels are split by rows
+// across threads (the TextureManager's workers pass false.)
+void texture_scale_mipmaps(Texture *tex, bool parallel=true);
+
+// Uploads tex and its mipmaps to the bound GL_TEXTURE_2D with glTexImage2D,
+// calling texture_scale_mipmaps first. This replaces gluBuild2DMipmaps, so
+// non-power-of-two images are no longer resampled (this requires OpenGL 2.)
+void texture_scale_upload(Texture *tex);
+
 #endif // __TEXSCALE_H
@@ -0,0 +1,394 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2008 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+
+#include "mm3dtypes.h" //PCH
+
+#include "textdest.h"
+
+TextDest::TextDest(DataDest *dst)
+	: m_dst(dst),
+	  m_buf(BUF_SIZE),
+	  m_len(0),
+	  m_flushed(0)
+{
+}
+
+bool TextDest::flush()
+{
+	if(!m_len) return true;
+
+	bool rval = m_dst->writeBytes(m_buf.data(),m_len);
+
+	m_flushed+=m_len; m_len = 0; return rval;
+}
+
+char *TextDest::text(size_t mark)
+{
+	if(mark<m_flushed) return nullptr;
+
+	return m_buf.data()+(mark-m_flushed);
+}
+
+void TextDest::rewrite(size_t mark, size_t len)
+{
+	if(mark>=m_flushed&&mark+len<=m_flushed+m_len)
+	{
+		m_len = mark+len-m_flushed;
+	}
+	else assert(0);
+}
+
+void TextDest::writeBytes(const char *buf, size_t bufLen)
+{
+	if(m_len+bufLen>BUF_SIZE)
+	{
+		flush();
+
+		if(bufLen>BUF_SIZE)
+		{
+			m_dst->writeBytes(buf,bufLen);
+			m_flushed+=bufLen; return;
+		}
+	}
+	memcpy(m_buf.data()+m_len,buf,bufLen); m_len+=bufLen;
+}
+
+/*ssize_t*/intptr_t TextDest::writeString(const char *str)
+{
+	size_t len = strlen(str); writeBytes(str,len); return len;
+}
+
+static char *textdest_utoa(char *end, uint64_t u)
+{
+	do *--end = '0'+u%10; while(u/=10); return end;
+}
+
+void TextDest::writeInt(int i)
+{
+	char buf[16], *end = buf+sizeof(buf);
+	char *p = textdest_utoa(end,i<0?0u-(unsigned)i:(unsigned)i);
+	if(i<0) *--p = '-';
+	writeBytes(p,end-p);
+}
+void TextDest::writeUnsigned(unsigned u)
+{
+	char buf[16], *end = buf+sizeof(buf);
+	char *p = textdest_utoa(end,u);
+	writeBytes(p,end-p);
+}
+
+// 64x64 to 128 bit multiply (without relying on __int128)
+static void textdest_mul(uint64_t a, uint64_t b, uint64_t &hi, uint64_t &lo)
+{
+	uint64_t a0 = (uint32_t)a, a1 = a>>32, b0 = (uint32_t)b, b1 = b>>32;
+	uint64_t p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+	uint64_t mid = (p00>>32)+(uint32_t)p01+(uint32_t)p10;
+	lo = mid<<32|(uint32_t)p00;
+	hi = p11+(p01>>32)+(p10>>32)+(mid>>32);
+}
+
+// Rounds d*10^places to an integer exactly the way printf does, i.e.
+// from the exact binary value with ties to even. Returns false if the
+// result doesn't fit in 64 bits.
+static bool textdest_fixed(double d, int places, uint64_t &q)
+{
+	static const uint64_t pow10[] = 
+	{
+		1,10,100,1000,10000,100000,1000000,10000000,100000000,1000000000
+	};
+
+	uint64_t bits; memcpy(&bits,&d,sizeof(bits));
+
+	int e = (int)(bits>>52&0x7FF); if(e==0x7FF) return false; //inf/nan
+
+	uint64_t m = bits&0xFFFFFFFFFFFFFull;
+	if(e) m|=1ull<<52; else e = 1; e-=1075;
+
+	uint64_t hi,lo; textdest_mul(m,pow10[places],hi,lo); //< 2^83
+
+	if(e>=0)
+	{
+		if(hi||e>=64||e&&lo>>(64-e)) return false;
+
+		q = lo<<e; return true;
+	}
+
+	int k = -e; if(k>=84) //< 0.5
+	{
+		q = 0; return true;
+	}
+
+	uint64_t qhi,rhi,rlo,hhi,hlo;
+	if(k>=64)
+	{
+		q = hi>>(k-64); qhi = 0;
+		rhi = k==64?0:hi&((1ull<<(k-64))-1); rlo = lo;
+	}
+	else
+	{
+		q = lo>>k|hi<<(64-k); qhi = hi>>k;
+		rhi = 0; rlo = lo&((1ull<<k)-1);
+	}
+	if(k-1>=64)
+	{
+		hhi = 1ull<<(k-65); hlo = 0;
+	}
+	else
+	{
+		hhi = 0; hlo = 1ull<<(k-1);
+	}
+	if(qhi||q==~0ull) return false;
+
+	if(rhi>hhi||rhi==hhi&&(rlo>hlo||rlo==hlo&&q&1)) q++;
+
+	return true;
+}
+
+void TextDest::writeFixed(double d, int places)
+{
+	uint64_t q;
+	if(places<0||places>9||!textdest_fixed(d,places,q))
+	{
+		char *p = need(MAX_NUMBER);
+		int len = snprintf(p,MAX_NUMBER,"%.*f",places,d);
+		if(len>=0&&len<MAX_NUMBER) m_len+=len; return;
+	}
+
+	char buf[32], *end = buf+sizeof(buf);
+	char *p = textdest_utoa(end,q);
+	while(end-p<=places) *--p = '0';
+	if(places)
+	{
+		p--; memmove(p,p+1,end-p-places-1); end[-places-1] = '.';
+	}
+	if(d<0||d==0&&copysign(1.0,d)<0) *--p = '-';
+
+	writeBytes(p,end-p);
+}
+
+/*ssize_t*/intptr_t TextDest::writePrintf(const char *fmt,...)
+{
+	va_list ap;
+	va_start(ap,fmt);
+	intptr_t rval = writeVPrintf(fmt,ap);
+	va_end(ap);
+	return rval;
+}
+
+/*ssize_t*/intptr_t TextDest::writeVPrintf(const char *fmt, va_list ap)
+{
+	size_t start = mark();
+
+	// Only take the fast path if every conversion is supported.
+	for(const char *p=fmt;*p;p++) if(*p=='%')
+	{
+		switch(*++p)
+		{
+		case '%': case 'd': case 'u': case 's': case 'f': continue;
+
+		case '.':
+
+			if(isdigit(p[1])&&!isdigit(p[2])&&p[2]=='f')
+			{
+				p+=2; continue;
+			}
+		}
+		
+		int rval; for(size_t sz=1024;;sz*=2)
+		{
+			if(sz>BUF_SIZE) //Probably never happens.
+			{
+				std::vector<char> tmp(rval+1);
+				rval = vsnprintf(tmp.data(),tmp.size(),fmt,ap);
+				if(rval>=0) writeBytes(tmp.data(),rval);
+				return rval;
+			}
+
+			char *buf = need(sz);
+
+			va_list va; va_copy(va,ap);
+			rval = vsnprintf(buf,sz,fmt,va);
+			va_end(va);
+
+			if(rval<0) return rval;
+			
+			if(rval<(int)sz)
+			{
+				m_len+=rval; return rval;
+			}
+		}
+	}
+
+	for(const char *p=fmt;*p;)
+	{
+		const char *q = p; while(*q&&*q!='%') q++;
+
+		if(q!=p) writeBytes(p,q-p);
+
+		if(!*q) break;
+
+		switch(*++q)
+		{
+		case '%': writeBytes(q,1); break;
+		case 'd': writeInt(va_arg(ap,int)); break;
+		case 'u': writeUnsigned(va_arg(ap,unsigned)); break;
+		case 'f': writeFixed(va_arg(ap,double),6); break;
+		case 's':
+
+			if(const char *s=va_arg(ap,const char*))
+			{
+				writeString(s);
+			}
+			else writeBytes("(null)",6); break;
+
+		case '.': writeFixed(va_arg(ap,double),q[1]-'0'); q+=2; break;
+		}
+
+		p = q+1;
+	}
+
+	return mark()-start;
+}
+
+void TextDest::stripZeros(size_t mark)
+{
+	//NOTE: This was ObjFilter::writeStripped's state machine.
+
+	char *line = text(mark); if(!line) return;
+
+	enum
+	{
+		Whitespace,Token,Number,Decimal,AfterDecimal
+	}state = Whitespace;
+
+	size_t s = 0;
+	size_t d = 0;
+	size_t len = this->mark()-mark;
+
+	while(s<len) switch(state)
+	{
+	case Token:
+
+		line[d] = line[s];
+		if(isspace(line[d]))
+		{
+			state = Whitespace;
+		}
+		s++; d++; break;
+
+	case Whitespace:
+
+		line[d] = line[s];
+		if(!isspace(line[d]))
+		{
+			if(isdigit(line[d])||line[d]=='-')
+			{
+				state = Number;
+			}
+			else
+			{
+				state = Token;
+			}
+		}
+		s++; d++; break;
+
+	case Number:
+
+		line[d] = line[s];
+		if(!isdigit(line[d]))
+		{
+			if(line[d]=='.')
+			{
+				state = Decimal;
+			}
+			else if(isspace(line[d]))
+			{
+				state = Whitespace;
+			}
+			else
+			{
+				state = Token;
+			}
+		}
+		s++; d++; break;
+
+	case Decimal:
+
+		line[d] = line[s];
+		if(isdigit(line[d]))
+		{
+			state = AfterDecimal;
+		}
+		else if(isspace(line[d]))
+		{
+			state = Whitespace;
+		}
+		else
+		{
+			state = Token;
+		}
+		s++; d++; break;
+
+	case AfterDecimal:
+
+		if(isdigit(line[s]))
+		{
+			if(line[s]=='0')
+			{
+				size_t bak = s;
+
+				while(s<len&&line[s]=='0')
+				{
+					s++;
+				}
+
+				if(s==len) goto end; //Trailing zeros.
+
+				if(isspace(line[s]))
+				{
+					state = Whitespace;
+				}
+				else
+				{
+					s = bak;
+				}
+			}
+			line[d] = line[s];
+		}
+		else
+		{
+			line[d] = line[s];
+			if(isspace(line[d]))
+			{
+				state = Whitespace;
+			}
+			else
+			{
+				state = Token;
+			}
+		}
+		s++; d++; break;
+	}
+
+end: rewrite(mark,d);
+}
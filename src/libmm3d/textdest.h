@@ -0,0 +1,103 @@
+/*  MM3D Misfit/Maverick Model 3D
+ *
+ * Copyright (c)2004-2008 Kevin Worcester
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place-Suite 330, Boston, MA 02111-1307,
+ * USA.
+ *
+ * See the COPYING file for full license text.
+ */
+
+
+
+#ifndef TEXTDEST_INC_H__
+#define TEXTDEST_INC_H__
+
+#include "datadest.h"
+
+// A TextDest buffers text output for a DataDest. It's used by the text
+// export filters (OBJ, SMD, IQE) that write every number with printf.
+//
+// writePrintf/writeVPrintf mirror the DataDest methods, but %d, %u, %s,
+// %f, %.Nf and %% are formatted without going through vsnprintf, and the
+// output is collected in a large buffer that is only handed to the
+// DataDest when it fills up or on flush. The output is the same as what
+// printf writes in the "C" locale. Any other conversion sends the whole
+// format through vsnprintf.
+//
+// The DataDest must not be written to directly while a TextDest has
+// unflushed text for it. The destructor flushes.
+
+class TextDest
+{
+	public:
+		TextDest(DataDest *dst);
+		~TextDest(){ flush(); }
+
+		DataDest *getDest(){ return m_dst; }
+
+		// Hands the buffered text to the DataDest.
+		// Returns false if a write error occurred.
+		bool flush();
+
+		// Returns the size written in bytes (or -1 on error)
+		/*ssize_t*/intptr_t writePrintf(const char *format,...);
+		/*ssize_t*/intptr_t writeVPrintf(const char *format, va_list ap);
+
+		// Writes a null-terminated string to output (not including null)
+		/*ssize_t*/intptr_t writeString(const char *str);
+
+		void writeBytes(const char *buf, size_t bufLen);
+		void writeInt(int i);
+		void writeUnsigned(unsigned u);
+		// Same as printf("%.*f",places,d).
+		void writeFixed(double d, int places);
+
+		// Guarantees that len bytes can be written before the buffer
+		// is flushed, i.e. that they can be revisited with mark/rewrite.
+		void reserve(size_t len){ if(m_len+len>BUF_SIZE) flush(); }
+
+		// These can be used to post-process text that has not yet been
+		// flushed. mark returns the current position. text returns the
+		// text from mark, or nullptr if some of it was flushed already.
+		// rewrite truncates it to a (no longer) length.
+		size_t mark()const{ return m_flushed+m_len; }
+		char *text(size_t mark);
+		void rewrite(size_t mark, size_t len);
+
+		// Removes trailing 0s from the fractional parts of numbers since
+		// mark, leaving one digit after the decimal point. (OBJ)
+		void stripZeros(size_t mark);
+
+	private:
+
+		enum
+		{
+			BUF_SIZE = 256*1024, // Arbitrary
+			MAX_NUMBER = 512 // Enough for %.Nf of DBL_MAX
+		};
+
+		char *need(size_t len)
+		{
+			if(m_len+len>BUF_SIZE) flush(); return m_buf.data()+m_len;
+		}
+
+		DataDest *m_dst;
+		std::vector<char> m_buf;
+		size_t m_len;
+		size_t m_flushed;
+};
+
+#endif // TEXTDEST_INC_H__
@@ -25,14 +25,20 @@
 #include "texture.h"
 #include "translate.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 int Texture::s_allocated = 0;
+std::atomic<unsigned> Texture::s_revisions(0);
 
 Texture::Texture()
 	:
 	  m_isBad(false),
 	  m_height(0),
 	  m_width(0),
-	  m_format(FORMAT_RGBA)
+	  m_format(FORMAT_RGBA),
+	  m_revision(++s_revisions)
 {
 	s_allocated++;
 }
@@ -48,6 +54,98 @@ bool Texture::compare(Texture *t1,Texture *t2,CompareResultT *res, unsigned fuzz
 }
 
 bool Texture::compare(Texture *tex,CompareResultT *res, unsigned fuzzyValue)
+{
+	return compare(tex,res,fuzzyValue,nullptr);
+}
+
+namespace
+{
+	struct texture_compare_t
+	{
+		std::vector<unsigned> histogram; uint64_t sse;
+
+		void rows(const Texture *t1, const Texture *t2, Texture *diff, int y0, int y1);
+	};
+}
+void texture_compare_t::rows(const Texture *t1, const Texture *t2, Texture *diff, int y0, int y1)
+{
+	histogram.assign(Texture::COMPARE_MAX_DIFF+1,0); sse = 0;
+
+	bool hasAlpha = t1->m_format==Texture::FORMAT_RGBA;
+	int bytespp = hasAlpha?4:3;
+	int w = t1->m_width;
+
+	for(int y=y0;y<y1;y++)
+	{
+		size_t row = (size_t)y*w;
+		const uint8_t *a = t1->m_data.data()+row*bytespp;
+		const uint8_t *b = t2->m_data.data()+row*bytespp;
+		uint8_t *d = diff?diff->m_data.data()+row*3:nullptr;
+
+		int x = 0;
+#ifdef __SSE2__
+		if(hasAlpha)
+		{
+			//4 pixels at a time: per-channel absolute differences are
+			//widened to 16 bits and then summed per pixel with madd.
+			__m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi16(1);
+			__m128i amask = _mm_set1_epi32(0xff000000);
+			__m128i sq = zero;
+			alignas(16) uint32_t sums[4];
+			for(;x+4<=w;x+=4)
+			{
+				__m128i va = _mm_loadu_si128((const __m128i*)(a+x*4));
+				__m128i vb = _mm_loadu_si128((const __m128i*)(b+x*4));
+				__m128i ad = _mm_or_si128(_mm_subs_epu8(va,vb),_mm_subs_epu8(vb,va));
+
+				//Both transparent?
+				__m128i clear = _mm_cmpeq_epi32(_mm_and_si128(_mm_or_si128(va,vb),amask),zero);
+				ad = _mm_andnot_si128(clear,ad);
+
+				__m128i lo = _mm_unpacklo_epi8(ad,zero), hi = _mm_unpackhi_epi8(ad,zero);
+				sq = _mm_add_epi32(sq,_mm_add_epi32(_mm_madd_epi16(lo,lo),_mm_madd_epi16(hi,hi)));
+				__m128 l2 = _mm_castsi128_ps(_mm_madd_epi16(lo,ones));
+				__m128 h2 = _mm_castsi128_ps(_mm_madd_epi16(hi,ones));
+				__m128i ev = _mm_castps_si128(_mm_shuffle_ps(l2,h2,_MM_SHUFFLE(2,0,2,0)));
+				__m128i od = _mm_castps_si128(_mm_shuffle_ps(l2,h2,_MM_SHUFFLE(3,1,3,1)));
+				_mm_store_si128((__m128i*)sums,_mm_add_epi32(ev,od));
+
+				histogram[sums[0]]++; histogram[sums[1]]++;
+				histogram[sums[2]]++; histogram[sums[3]]++;
+
+				if(d) for(int i=0;i<4;i++,d+=3)
+				{
+					const uint8_t *p = (const uint8_t*)&ad+i*4;
+					d[0] = p[0]; d[1] = p[1]; d[2] = p[2];
+				}
+			}
+			alignas(16) uint32_t s4[4];
+			_mm_store_si128((__m128i*)s4,sq);
+			sse+=(uint64_t)s4[0]+s4[1]+s4[2]+s4[3];
+		}
+#endif
+		for(;x<w;x++)
+		{
+			const uint8_t *p = a+x*bytespp, *q = b+x*bytespp;
+			if(hasAlpha&&p[3]==0&&q[3]==0)
+			{
+				histogram[0]++;
+				if(d){ d[0] = d[1] = d[2] = 0; d+=3; }
+				continue;
+			}
+			unsigned fuzzy = 0;
+			for(int c=0;c<bytespp;c++)
+			{
+				int ad = abs(p[c]-q[c]);
+				fuzzy+=ad; sse+=ad*ad;
+				if(d&&c<3) d[c] = (uint8_t)ad;
+			}
+			histogram[fuzzy]++; if(d) d+=3;
+		}
+	}
+}
+
+bool Texture::compare(Texture *tex,CompareResultT *res, unsigned fuzzyValue, CompareStatsT *stats, Texture *diffImage)
 {
 	Texture *t1 = this;
 	Texture *t2 = tex;
@@ -66,38 +164,52 @@ bool Texture::compare(Texture *tex,CompareResultT *res, unsigned fuzzyValue)
 	bool hasAlpha = (t1->m_format==Texture::FORMAT_RGBA)? true : false;
 	unsigned count = t1->m_width *t1->m_height;
 
-	res->pixelCount = count;
-	res->matchCount = 0;
-	res->fuzzyCount = 0;
-
-	unsigned bytespp = hasAlpha ? 4 : 3;
-	unsigned off = 0;
-	unsigned fuzzy = 0;
-
-	for(unsigned p = 0; p<count; p++)
+	if(diffImage)
 	{
-		off = p *bytespp;
-		fuzzy = 0;
+		diffImage->m_isBad = false;
+		diffImage->m_format = FORMAT_RGB;
+		diffImage->m_width = diffImage->m_origWidth = t1->m_width;
+		diffImage->m_height = diffImage->m_origHeight = t1->m_height;
+		diffImage->m_data.resize((size_t)count*3);
+		diffImage->m_mipmaps.clear();
+	}
 
-		fuzzy += abs(t1->m_data[off+0]-t2->m_data[off+0]);
-		fuzzy += abs(t1->m_data[off+1]-t2->m_data[off+1]);
-		fuzzy += abs(t1->m_data[off+2]-t2->m_data[off+2]);
-		if(hasAlpha)
-		{
-			fuzzy += abs(t1->m_data[off+3]-t2->m_data[off+3]);
-		}
+	//NEW: Blocks of rows are compared in parallel. Each thread counts
+	//its own histogram and they're added up afterward.
+	int h = t1->m_height;
+	int nt = std::thread::hardware_concurrency();
+	nt = std::max(1,std::min(std::min(8,nt),(int)(count>>16)));
+	nt = std::min(nt,std::max(1,h));
+	std::vector<texture_compare_t> parts(nt);
+	{
+		std::vector<std::thread> threads;
+		for(int i=1;i<nt;i++) threads.emplace_back
+		(&texture_compare_t::rows,&parts[i],t1,t2,diffImage,h*i/nt,h*(i+1)/nt);
+		parts[0].rows(t1,t2,diffImage,0,h/nt);
+		for(auto&ea:threads) ea.join();
+	}
+	for(int i=1;i<nt;i++)
+	{
+		for(size_t j=0;j<=COMPARE_MAX_DIFF;j++)
+		parts[0].histogram[j]+=parts[i].histogram[j];
+		parts[0].sse+=parts[i].sse;
+	}
+	auto &hist = parts[0].histogram;
 
-		if(hasAlpha 
-			  &&t1->m_data[off+3]==0
-			  &&t2->m_data[off+3]==0)
-		{
-			fuzzy = 0;
-		}
+	res->pixelCount = count;
+	res->matchCount = hist[0];
+	res->fuzzyCount = 0;
+	for(unsigned i=0;i<=fuzzyValue&&i<=COMPARE_MAX_DIFF;i++)
+	{
+		res->fuzzyCount+=hist[i];
+	}
 
-		if(fuzzy==0)
-			res->matchCount++;
-		if(fuzzy<=fuzzyValue)
-			res->fuzzyCount++;
+	if(stats)
+	{
+		double n = (double)count*(hasAlpha?4:3);
+		stats->mse = n?parts[0].sse/n:0;
+		stats->psnr = stats->mse?10*log10(255*255/stats->mse):INFINITY;
+		stats->histogram.swap(hist);
 	}
 
 	return(res->pixelCount==res->matchCount);
@@ -62,11 +62,24 @@ class Texture
 			unsigned fuzzyCount;
 		};
 
+		// NEW: A pixel's difference is the sum of its channels' absolute
+		// differences (0 if both are transparent.) They're counted in the
+		// histogram so fuzzyCount for every fuzzyValue is a prefix sum of
+		// it. psnr is infinite if the images match. The difference image is
+		// RGB with each channel's absolute difference.
+		enum{ COMPARE_MAX_DIFF=255*4 };
+		struct CompareStatsT
+		{
+			std::vector<unsigned> histogram; //[COMPARE_MAX_DIFF+1]
+			double mse,psnr;
+		};
+
 		Texture(); ~Texture();
 
 		static bool compare(Texture *t1,Texture *t2,CompareResultT *res, unsigned fuzzyValue);
 
 		bool compare(Texture *tex,CompareResultT *res, unsigned fuzzyValue);
+		bool compare(Texture *tex,CompareResultT *res, unsigned fuzzyValue, CompareStatsT *stats, Texture *diffImage=nullptr);
 
 		static const char *errorToString(Texture::ErrorE);
 
@@ -82,12 +95,25 @@ class Texture
 		FormatE	m_format;
 		std::vector<uint8_t> m_data;
 
+		// Levels 1 and up, made by texture_scale_mipmaps. These are
+		// kept so that every GL context doesn't have to remake them.
+		struct Mipmap
+		{
+			int width,height; std::vector<uint8_t> data;
+		};
+		std::vector<Mipmap> m_mipmaps; //NEW
+
 		int		 m_origWidth;
 		int		 m_origHeight;
 
 		time_t	 m_loadTime;
 
+		// This changes whenever the pixels are replaced, so GL texture
+		// objects that are shared by several models know to reupload.
+		unsigned m_revision; //NEW
+
 		static int s_allocated;
+		static std::atomic<unsigned> s_revisions; //NEW
 };
 
 //errorobj.cc
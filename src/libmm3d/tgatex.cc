@@ -26,11 +26,11 @@
 #include "log.h"
 #include "texmgr.h"
 #include "filedatasource.h"
+#include "datadest.h" //NEW
 
-struct TGAHeaderT
-{
-	uint8_t Header[12];
-};
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 struct TGA
 {
@@ -40,9 +40,6 @@ struct TGA
 	uint8_t reserved;
 };
 
-static TGAHeaderT tgaheader;
-static TGA tga;
-
 static uint8_t uTGAcompare[12] = {0,0,2,0,0,0,0,0,0,0,0,0};	// Uncompressed TGA Header
 static uint8_t cTGAcompare[12] = {0,0,10,0,0,0,0,0,0,0,0,0};	// Compressed TGA Header
 
@@ -59,10 +56,40 @@ static Texture::ErrorE SourceGetError(DataSource &src)
 	return Texture::ERROR_NONE;
 }
 
-static Texture::ErrorE LoadUncompressedTGA(Texture &texture, DataSource &src)
+// Copies n BGR(A) pixels from src to dst as RGB(A). src may equal dst.
+static void SwizzleTGA(uint8_t *dst, const uint8_t *src, size_t n, int bytespp)
 {
-	log_debug("loading uncompressed TGA\n");
+	size_t i = 0;
+	if(bytespp==4)
+	{
+#ifdef __SSE2__
+		__m128i ga = _mm_set1_epi32(0xFF00FF00), lo = _mm_set1_epi32(0xFF);
+		for(;i+4<=n;i+=4)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(src+i*4));
+			__m128i r = _mm_and_si128(_mm_srli_epi32(v,16),lo);
+			__m128i b = _mm_slli_epi32(_mm_and_si128(v,lo),16);
+			v = _mm_or_si128(_mm_and_si128(v,ga),_mm_or_si128(r,b));
+			_mm_storeu_si128((__m128i*)(dst+i*4),v);
+		}
+#endif
+		for(;i<n;i++)
+		{
+			const uint8_t *s = src+i*4; uint8_t *d = dst+i*4;
+			uint8_t b = s[0];
+			d[0] = s[2]; d[1] = s[1]; d[2] = b; d[3] = s[3];
+		}
+	}
+	else for(;i<n;i++)
+	{
+		const uint8_t *s = src+i*3; uint8_t *d = dst+i*3;
+		uint8_t b = s[0];
+		d[0] = s[2]; d[1] = s[1]; d[2] = b;
+	}
+}
 
+static Texture::ErrorE ReadTGA(TGA &tga, Texture &texture, DataSource &src)
+{
 	src.read(tga.width);
 	src.read(tga.height);
 	src.read(tga.bpp);
@@ -74,27 +101,34 @@ static Texture::ErrorE LoadUncompressedTGA(Texture &texture, DataSource &src)
 	texture.m_width  = tga.width;
 	texture.m_height = tga.height;
 
-	uint32_t width  = texture.m_width;
-	uint32_t height = texture.m_height;
-	uint8_t bpp	  = tga.bpp;
-
-	if((width<=0)||(height<=0)||((bpp!=24)&&(bpp !=32)))
+	if((tga.width<=0)||(tga.height<=0)||((tga.bpp!=24)&&(tga.bpp !=32)))
 	{
 		fprintf(stderr,"Invalid texture information");
 		return Texture::ERROR_BAD_DATA;
 	}
 
-	log_debug("tga size: %d x %d,%d bbp\n",width,height,bpp);
+	log_debug("tga size: %d x %d,%d bbp\n",tga.width,tga.height,tga.bpp);
 
-	bool hasAlpha = (bpp==32);
+	bool hasAlpha = (tga.bpp==32);
 	log_debug("Alpha channel: %s\n",hasAlpha ? "present" : "not present");
 
-	uint8_t bytespp = (bpp/8);
-	uint32_t imageSize  = (bytespp *width *height);
-	texture.m_data.resize(imageSize);
-	uint8_t *data = texture.m_data.data();
+	texture.m_data.resize((tga.bpp/8)*tga.width*tga.height);
 	texture.m_format = hasAlpha ? Texture::FORMAT_RGBA : Texture::FORMAT_RGB;
 
+	return Texture::ERROR_NONE;
+}
+
+static Texture::ErrorE LoadUncompressedTGA(Texture &texture, DataSource &src)
+{
+	log_debug("loading uncompressed TGA\n");
+
+	TGA tga;
+	if(Texture::ErrorE e=ReadTGA(tga,texture,src)) return e;
+
+	uint8_t bytespp = (tga.bpp/8);
+	uint32_t imageSize = texture.m_data.size();
+	uint8_t *data = texture.m_data.data();
+
 	log_debug("image size = %d\n",imageSize);
 
 	if(!src.readBytes(data,imageSize))
@@ -102,12 +136,7 @@ static Texture::ErrorE LoadUncompressedTGA(Texture &texture, DataSource &src)
 		return SourceGetError(src);
 	}
 
-	for(uint32_t n = 0; n<imageSize; n += bytespp)
-	{
-		uint8_t temp = data[n+0];
-		data[n+0] = data[n+2];
-		data[n+2] = temp;
-	}
+	SwizzleTGA(data,data,imageSize/bytespp,bytespp);
 
 	return Texture::ERROR_NONE;
 }
@@ -116,94 +145,54 @@ static Texture::ErrorE LoadCompressedTGA(Texture &texture, DataSource &src)
 { 
 	log_debug("loading compressed TGA\n");
 
-	src.read(tga.width);
-	src.read(tga.height);
-	src.read(tga.bpp);
-	src.read(tga.reserved);
-
-	if(SourceHasError(src))
-		return SourceGetError(src);
-
-	texture.m_width  = tga.width;
-	texture.m_height = tga.height;
-
-	uint32_t width  = texture.m_width;
-	uint32_t height = texture.m_height;
-	uint8_t bpp	  = tga.bpp;
+	TGA tga;
+	if(Texture::ErrorE e=ReadTGA(tga,texture,src)) return e;
 
-	if((width<=0)||(height<=0)||((bpp!=24)&&(bpp !=32)))
+	//NOTE: This had read each header and pixel through the DataSource.
+	std::vector<uint8_t> buf(src.getRemaining());
+	if(!src.readBytes(buf.data(),buf.size()))
 	{
-		fprintf(stderr,"Invalid texture information");
-		return Texture::ERROR_BAD_DATA;
+		return SourceGetError(src);
 	}
+	const uint8_t *p = buf.data(), *end = p+buf.size();
 
-	bool hasAlpha = (bpp==32);
-	log_debug("Alpha channel: %s\n",hasAlpha ? "present" : "not present");
-
-	log_debug("tga size: %d x %d,%d bbp\n",width,height,bpp);
-
-	uint8_t bytespp = (bpp/8);
-	uint32_t imageSize  = (bytespp *width *height);
-	texture.m_data.resize(imageSize);
-	uint8_t *data = texture.m_data.data();
-
-	uint32_t pixelcount = height *width;
-	uint32_t currentpixel = 0;
-	uint32_t currentbyte = 0;
-	uint8_t colorbuffer[4];
+	uint8_t bytespp = (tga.bpp/8);
+	uint32_t imageSize = texture.m_data.size();
+	uint8_t *data = texture.m_data.data(), *stop = data+imageSize;
 
-	texture.m_format = hasAlpha ? Texture::FORMAT_RGBA : Texture::FORMAT_RGB;
-
-	do
+	while(data<stop)
 	{
-		uint8_t chunkheader = 0;
-		if(!src.read(chunkheader))
-			return SourceGetError(src);
+		if(p==end) return Texture::ERROR_UNEXPECTED_EOF;
 
+		unsigned chunkheader = *p++;
 		if(chunkheader<128)
 		{
-			chunkheader++;
-			for(short counter = 0; counter<chunkheader&&currentpixel<pixelcount; counter++)
-			{
-				if(!src.readBytes(colorbuffer,bytespp))
-					return SourceGetError(src);
-
-				data[currentbyte+0] = colorbuffer[2];		  
-				data[currentbyte+1] = colorbuffer[1];
-				data[currentbyte+2] = colorbuffer[0];
-				if(hasAlpha)
-				{
-					data[currentbyte+3] = colorbuffer[3];
-				}
-
-				currentbyte += bytespp;
-				currentpixel++;
-			}
+			size_t n = std::min<size_t>((chunkheader+1)*bytespp,stop-data);
+
+			if((size_t)(end-p)<n) return Texture::ERROR_UNEXPECTED_EOF;
+
+			SwizzleTGA(data,p,n/bytespp,bytespp);
+
+			p+=n; data+=n;
 		}
 		else
 		{
-			chunkheader -= 127;
-			if(!src.readBytes(colorbuffer,bytespp))
-				return SourceGetError(src);
+			size_t n = std::min<size_t>((chunkheader-127)*bytespp,stop-data);
+
+			if((size_t)(end-p)<bytespp) return Texture::ERROR_UNEXPECTED_EOF;
+
+			SwizzleTGA(data,p,1,bytespp);
 
-			for(short counter = 0; counter<chunkheader&&currentpixel<pixelcount; counter++)
+			//Repeat the pixel by doubling up what's been filled.
+			for(size_t i=bytespp;i<n;i*=2)
 			{
-				data[currentbyte+0] = colorbuffer[2];		  
-				data[currentbyte+1] = colorbuffer[1];
-				data[currentbyte+2] = colorbuffer[0];
-				if(hasAlpha)
-				{
-					data[currentbyte+3] = colorbuffer[3];
-				}
-
-				currentbyte += bytespp;
-				currentpixel++;
+				memcpy(data+i,data,std::min(i,n-i));
 			}
-		}
 
-	}while(currentpixel<pixelcount);
+			p+=bytespp; data+=n;
+		}
+	}
 
-	log_debug("pixel count = %d,current pixel = %d\n",pixelcount,currentpixel);
 	log_debug("image size = %d\n",imageSize);
 
 	return Texture::ERROR_NONE;
@@ -213,6 +202,8 @@ struct TgaTextureFilter : TextureFilter
 {
 	virtual const char *getReadTypes(){ return "TGA"; }
 
+	virtual bool isReentrant(){ return true; } //NEW
+
 	virtual Texture::ErrorE readData(Texture &texture, DataSource &src, const char*)
 	{
 		if(src.errorOccurred())
@@ -220,18 +211,19 @@ struct TgaTextureFilter : TextureFilter
 			return errnoToTextureError(src.getErrno(),Texture::ERROR_FILE_OPEN);
 		}
 
-		if(!src.readBytes(tgaheader.Header,sizeof(tgaheader.Header)))
+		uint8_t header[12];
+		if(!src.readBytes(header,sizeof(header)))
 		{
 			return Texture::ERROR_BAD_DATA;
 		}
 
 		Texture::ErrorE err = Texture::ERROR_NONE;
 
-		if(memcmp(uTGAcompare,&tgaheader.Header,sizeof(tgaheader.Header))==0)
+		if(memcmp(uTGAcompare,header,sizeof(header))==0)
 		{
 			err = LoadUncompressedTGA(texture,src);
 		}
-		else if(memcmp(cTGAcompare,&tgaheader.Header,sizeof(tgaheader.Header))==0)
+		else if(memcmp(cTGAcompare,header,sizeof(header))==0)
 		{
 			err = LoadCompressedTGA(texture,src);
 		}
@@ -243,6 +235,47 @@ struct TgaTextureFilter : TextureFilter
 
 		return err;
 	}
+
+	//NEW: bakeTextureAtlas writes its image with this.
+	virtual const char *getWriteTypes(){ return "TGA"; }
+
+	virtual Texture::ErrorE writeData(Texture &texture, DataDest &dst, const char*)
+	{
+		if(dst.errorOccurred())
+		{
+			return errnoToTextureError(dst.getErrno(),Texture::ERROR_FILE_OPEN);
+		}
+
+		int bytespp = texture.m_format==Texture::FORMAT_RGBA?4:3;
+		size_t n = (size_t)texture.m_width*texture.m_height;
+		if(n==0||texture.m_data.size()<n*bytespp
+		||texture.m_width>0xffff||texture.m_height>0xffff)
+		{
+			return Texture::ERROR_BAD_ARGUMENT;
+		}
+
+		TGA tga;
+		tga.width = (uint16_t)texture.m_width;
+		tga.height = (uint16_t)texture.m_height;
+		tga.bpp = (uint8_t)(bytespp*8);
+		tga.reserved = bytespp==4?8:0; //Alpha bits (bottom-up)
+
+		dst.writeBytes(uTGAcompare,sizeof(uTGAcompare));
+		dst.write(tga.width);
+		dst.write(tga.height);
+		dst.write(tga.bpp);
+		dst.write(tga.reserved);
+
+		std::vector<uint8_t> bgr(n*bytespp);
+		SwizzleTGA(bgr.data(),texture.m_data.data(),n,bytespp);
+		dst.writeBytes(bgr.data(),bgr.size());
+
+		if(dst.errorOccurred())
+		{
+			return errnoToTextureError(dst.getErrno(),Texture::ERROR_FILE_WRITE);
+		}
+		return Texture::ERROR_NONE;
+	}
 };
 
 extern TextureFilter *tgatex(){ return new TgaTextureFilter; }
@@ -37,9 +37,16 @@
 //#include "mlocale.h"
 //#include "texturetest.h"
 #include "texmgr.h"
+#include "textdest.h"
+#include "memdatadest.h"
+#include "sysconf.h"
+#include "offscreen.h"
+#include "modelviewport.h"
+#include "toolbox.h"
 
 bool cmdline_runcommand = false;
 bool cmdline_runui = true;
+bool cmdline_runheadless = false;
 
 static bool cmdline_doConvert = false;
 static std::string cmdline_convertFormat = "";
@@ -48,6 +55,20 @@ static bool cmdline_doBatch = false;
 
 static bool cmdline_doScripts = false;
 static bool cmdline_doTextureTest = false;
+static bool cmdline_doTextureDiff = false; //NEW
+static bool cmdline_doTextDestTest = false; //NEW
+
+//NEW: --render-frames draws models with ModelViewport into an offscreen
+//OpenGL context and saves the frames with TextureManager.
+static bool cmdline_doRender = false;
+static std::string cmdline_renderPattern;
+static std::string cmdline_renderAnimation;
+static std::string cmdline_renderView = "perspective";
+static int cmdline_renderSize[2] = {256,256};
+static double cmdline_renderFPS = 0; //The animation's if 0.
+static int cmdline_renderCount = 0; //Automatic if 0.
+static int cmdline_renderFrame = 0; //Continues across models.
+static OffscreenContext *cmdline_offscreen = nullptr;
 
 typedef std::list<std::string> StringList;
 static StringList cmdline_scripts;
@@ -76,8 +97,24 @@ static void cmdline_print_help(const char *progname)
 #endif // HAVE_LUALIB
 	printf("		--convert [format] Save models to format [format]\n");
 	printf("								 \n");
+	printf("		--render-frames [file] Render models to images without a display, where\n");
+	printf("								 [file] is like frame%%04d.tga (%%d is the frame number)\n");
+	printf("		--render-animation [name] Animate [name] (or number, from 0)\n");
+	printf("		--render-view [view] perspective (default), turntable, front, back,\n");
+	printf("								 left, right, top, or bottom\n");
+	printf("		--render-size [WxH] Image size (default 256x256)\n");
+	printf("		--render-fps [N]	 Frames per second (default the animation's)\n");
+	printf("		--render-count [N] Number of frames (default the animation's or 36\n");
+	printf("								 for turntable or else 1)\n");
+	printf("								 Only TGA and PCX textures are drawn when rendering\n");
+	printf("								 \n");
 	printf("		--language [code]  Use language [code] instead of system default\n");
 	printf("								 \n");
+	printf("		--model-cache[=MB] Cache imported models as MM3D snapshots\n");
+	printf("								 (default 512 MB)\n");
+	printf("		--no-model-cache	Bypass the model cache\n");
+	printf("		--texture-cache [MB] Keep up to [MB] of unused textures\n");
+	printf("								 \n");
 	printf("		--no-plugins		 Disable all plugins\n");
 	printf("		--no-plugin [foo]  Disable plugin [foo]\n");
 	printf("								 \n");
@@ -155,6 +192,17 @@ enum cmdline_Mm3dOptionsE
 	OptNoWarnings,
 	OptNoErrors,
 	OptTestTextureCompare,
+	OptTestTextureDiff, //NEW
+	OptTestTextDest, //NEW
+	OptModelCache, //NEW
+	OptNoModelCache, //NEW
+	OptTextureCache, //NEW
+	OptRenderFrames, //NEW
+	OptRenderAnimation, //NEW
+	OptRenderView, //NEW
+	OptRenderSize, //NEW
+	OptRenderFPS, //NEW
+	OptRenderCount, //NEW
 
 	OptVerbose, //NEW
 	OptMAX
@@ -184,6 +232,19 @@ int init_cmdline(int &argc,char *argv[])
 	clm.addOption(OptNoErrors,0,"no-errors");
 
 	clm.addOption(OptTestTextureCompare,0,"testtexcompare");
+	clm.addOption(OptTestTextureDiff,0,"testtexdiff");
+	clm.addOption(OptTestTextDest,0,"testtextdest");
+
+	clm.addOption(OptModelCache,0,"model-cache"); //Optional =MB
+	clm.addOption(OptNoModelCache,0,"no-model-cache");
+	clm.addOption(OptTextureCache,0,"texture-cache",nullptr,true);
+
+	clm.addOption(OptRenderFrames,0,"render-frames",nullptr,true);
+	clm.addOption(OptRenderAnimation,0,"render-animation",nullptr,true);
+	clm.addOption(OptRenderView,0,"render-view",nullptr,true);
+	clm.addOption(OptRenderSize,0,"render-size",nullptr,true);
+	clm.addOption(OptRenderFPS,0,"render-fps",nullptr,true);
+	clm.addOption(OptRenderCount,0,"render-count",nullptr,true);
 
 	if(!clm.parse(argc,(const char **)argv))
 	{
@@ -281,9 +342,64 @@ int init_cmdline(int &argc,char *argv[])
 	if(clm.isSpecified(OptTestTextureCompare))
 	{
 		cmdline_doTextureTest = true;
+		cmdline_doTextureDiff = clm.isSpecified(OptTestTextureDiff);
+
+		cmdline_runcommand = true;
+		cmdline_runui = false;
+	}
+	if(clm.isSpecified(OptTestTextDest)) //NEW
+	{
+		cmdline_doTextDestTest = true;
+
+		cmdline_runcommand = true;
+		cmdline_runui = false;
+	}
+
+	//NOTE: --no-model-cache wins so it can be appended to a command
+	//line (or alias) that enables the cache.
+	if(clm.isSpecified(OptModelCache)&&!clm.isSpecified(OptNoModelCache))
+	{
+		int mb = clm.intValue(OptModelCache);
+		if(mb<=0) mb = 512;
+
+		std::string dir = getMm3dHomeDirectory();
+		dir+="/modelcache";
+		FilterManager::getInstance()->setCacheDirectory(dir.c_str(),(size_t)mb<<20);
+	}
+	if(clm.isSpecified(OptTextureCache))
+	{
+		int mb = std::max(0,clm.intValue(OptTextureCache));
+		TextureManager::getInstance()->setCacheBudget((size_t)mb<<20);
+	}
+
+	if(clm.isSpecified(OptRenderFrames))
+	{
+		cmdline_renderPattern = clm.stringValue(OptRenderFrames);
+
+		if(clm.isSpecified(OptRenderAnimation))
+		cmdline_renderAnimation = clm.stringValue(OptRenderAnimation);
+		if(clm.isSpecified(OptRenderView))
+		cmdline_renderView = clm.stringValue(OptRenderView);
+		if(clm.isSpecified(OptRenderSize))
+		{
+			int *wh = cmdline_renderSize;
+			if(2!=sscanf(clm.stringValue(OptRenderSize),"%dx%d",wh,wh+1)
+			||wh[0]<=0||wh[1]<=0)
+			{
+				fprintf(stderr,"--render-size must be like 256x256.\n");
+				exit(-1);
+			}
+		}
+		if(clm.isSpecified(OptRenderFPS))
+		cmdline_renderFPS = std::max(0.0,strtod(clm.stringValue(OptRenderFPS),nullptr));
+		if(clm.isSpecified(OptRenderCount))
+		cmdline_renderCount = std::max(0,clm.intValue(OptRenderCount));
+
+		cmdline_doRender = true;
 
 		cmdline_runcommand = true;
 		cmdline_runui = false;
+		cmdline_runheadless = true;
 	}
 
 	int opts_done = clm.firstArgument();
@@ -304,27 +420,270 @@ int init_cmdline(int &argc,char *argv[])
 void shutdown_cmdline()
 {
 	cmdline_deleteOpenModels();
+
+	//The models' textures are released first.
+	delete cmdline_offscreen; cmdline_offscreen = nullptr;
+}
+
+//NEW: This stands in for the UI's ViewPanel. It only renders.
+class cmdline_RenderViews : public ModelViewport::Parent
+{
+public:
+
+	cmdline_RenderViews(Model *m):Parent(false),model(m)
+	{
+		viewsN = 1;
+
+		setCurrentTool(toolbox.getCurrentTool(),0); //NullTool
+
+		initializeGL(model);
+	}
+	~cmdline_RenderViews(){ setCurrentTool(nullptr,0); }
+
+	Model *model; Toolbox toolbox;
+
+	virtual Model *getModel(){ return model; }
+	virtual void updateView(){}
+	virtual void updateAllViews(){}
+	virtual void getXY(int &x, int &y){ x = y = 0; }
+	virtual void viewChangeEvent(ModelViewport&){}
+	virtual void zoomLevelChangedEvent(ModelViewport&){}
+	virtual void addBool(bool,bool*,const char*){}
+	virtual void addInt(bool,int*,const char*,int,int){}
+	virtual void addDouble(bool,double*,const char*,double,double){}
+	virtual void addEnum(bool,int*,const char*,const char**){}
+	virtual void updateParams(){}
+	virtual void removeParams(){}
+	virtual void hideParam(void*,int){}
+};
+
+//Allows one %d (with flags and width) for the frame number.
+static bool cmdline_render_pattern(const char *p, bool &numbered)
+{
+	numbered = false;
+	for(;*p;p++) if(*p=='%')
+	{
+		if(p[1]=='%'){ p++; continue; }
+
+		p+=1+strspn(p+1,"0123456789-+ #");
+		if(*p!='d'||numbered) return false;
+		numbered = true;
+	}
+	return true;
+}
+
+static int cmdline_render(Model *m)
+{
+	const char *pattern = cmdline_renderPattern.c_str();
+	bool numbered;
+	if(!cmdline_render_pattern(pattern,numbered))
+	{
+		msg_error("--render-frames: %s may only have one %%d",pattern);
+		return 1;
+	}
+
+	auto *tm = TextureManager::getInstance();
+	if(!tm->canWrite(pattern))
+	{
+		msg_error("--render-frames: can't write %s (try TGA)",pattern);
+		return 1;
+	}
+
+	static const char *const views[] = 
+	{
+		"perspective","front","back","left","right","top","bottom"
+	};
+	int view = -1;
+	bool spin = cmdline_renderView=="turntable";
+	if(spin) view = Tool::ViewPerspective;
+	else for(int i=0;i<7;i++)
+	if(cmdline_renderView==views[i]) view = i;
+	if(view==-1)
+	{
+		msg_error("--render-view: unknown view %s",cmdline_renderView.c_str());
+		return 1;
+	}
+
+	int a = -1;
+	if(!cmdline_renderAnimation.empty())
+	{
+		const char *name = cmdline_renderAnimation.c_str();
+		for(unsigned i=m->getAnimationCount();i-->0;)
+		if(!strcmp(m->getAnimName(i),name)) a = (int)i;
+
+		char *e; long i = strtol(name,&e,10);
+		if(a==-1&&!*e&&i>=0&&i<(long)m->getAnimationCount()) a = (int)i;
+
+		if(a==-1)
+		{
+			msg_error("%s: no animation %s",m->getFilename(),name);
+			return 1;
+		}
+	}
+
+	double fps = cmdline_renderFPS;
+	if(!fps) fps = a!=-1?m->getAnimFPS(a):25;
+	if(fps<=0) fps = 25;
+
+	int n = cmdline_renderCount; if(!n)
+	{
+		if(a!=-1) //Same as animexportwin.cc.
+		{
+			double dur = m->getAnimTimeFrame(a)/m->getAnimFPS(a);
+			n = std::max(1,(int)(dur*fps+0.5));
+		}
+		else n = spin?36:1;
+	}
+	if(n>1&&!numbered)
+	{
+		msg_error("--render-frames: %s needs %%d for %d frames",pattern,n);
+		return 1;
+	}
+
+	m->setUndoEnabled(false);
+
+	//Don't draw placeholders.
+	while(m->hasPendingTextures()) if(!m->loadPendingTextures())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	//Only TGA and PCX can be decoded without the UI.
+	for(int i=0;i<m->getTextureCount();i++)
+	if(m->getMaterialType(i)==Model::Material::MATTYPE_TEXTURE)
+	{
+		Texture *tex = m->getTextureData(i);
+		if(tex&&tex->m_isBad)
+		msg_warning("%s: could not load texture %s (--render-frames only reads TGA and PCX)",
+		m->getFilename(),m->getTextureFilename(i));
+	}
+
+	//The editor's orthographic views are wireframes by default.
+	m->setCanvasDrawMode(m->getPerspectiveDrawMode());
+
+	if(a!=-1) m->setCurrentAnimation(a);
+
+	cmdline_RenderViews rv(m);
+	ModelViewport &mvp = rv.ports[0];
+	int w = cmdline_offscreen->getWidth(); 
+	int h = cmdline_offscreen->getHeight();
+	mvp.m_viewportX = mvp.m_viewportY = 0;
+	mvp.m_viewportWidth = w; mvp.m_viewportHeight = h;
+	mvp.viewChangeEvent((Tool::ViewE)view);
+
+	double x1,y1,z1,x2,y2,z2;
+	if(!m->getBoundingRegion(&x1,&y1,&z1,&x2,&y2,&z2))
+	{
+		auto &vu = m->getViewportUnits();
+		x1 = y1 = z1 = -vu.lines3d*vu.inc3d; x2 = y2 = z2 = -x1;
+	}
+	if(spin) //Fit the model at every angle.
+	{
+		double c[3] = {(x1+x2)/2,(y1+y2)/2,(z1+z2)/2};
+		double r = distance(x1,y1,z1,x2,y2,z2)/2;
+		x1 = c[0]-r; y1 = c[1]-r; z1 = c[2]-r;
+		x2 = c[0]+r; y2 = c[1]+r; z2 = c[2]+r;
+	}
+	mvp.frameArea(false,x1,y1,z1,x2,y2,z2);
+	double zoom = mvp.getZoomLevel();
+
+	std::vector<char> file(cmdline_renderPattern.size()+32);
+	std::list<std::pair<std::string,TextureManager::WriteFuture>> writes;
+
+	//NEW: The frames are read back a frame late so that reading one
+	//overlaps rendering the next. writeAsync encodes them on worker
+	//threads, copying the pixels, and blocks when too far behind.
+	FrameReader reader(0,0,w,h,true);
+	auto save = [&](const void *pixels)
+	{
+		if(pixels) writes.emplace_back(file.data(),
+		tm->writeAsync(pixels,w,h,true,file.data()));
+	};
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	unsigned errors = 0; for(int i=0;i<n;i++)
+	{
+		if(a!=-1) m->setCurrentAnimationTime(i/fps);
+
+		if(spin&&i)
+		{
+			ModelViewport::ViewStateT vs; mvp.getViewState(vs);
+			vs.rotation[1] = 360.0*i/n;
+			mvp.setViewState(vs);
+			mvp.frameArea(false,x1,y1,z1,x2,y2,z2); //Rotates the center.
+			mvp.setZoomLevel(zoom);
+		}
+
+		mvp.render();
+
+		save(reader.read()); //Previous frame.
+
+		snprintf(file.data(),file.size(),pattern,cmdline_renderFrame++);
+	}
+	save(reader.finish());
+
+	for(auto &ea:writes) if(ea.second.get())
+	{
+		errors++; msg_error("%s: could not write file",ea.first.c_str());
+	}
+
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+	printf("%s: %d frames in %.2f seconds (%.1f fps)\n",m->getFilename(),n,sec,n/std::max(sec,0.001));
+
+	if(a!=-1) m->setNoAnimation(); return errors;
 }
 
 int cmdline_command()
 {
 	unsigned errors = 0;
 
+	if(cmdline_doTextDestTest) //NEW
+	{
+		return textdest_test_compare()?1:0;
+	}
+
 	if(cmdline_doTextureTest)
 	{
 		std::string master = cmdline_argList.front();
 
+		//NEW: Decode a few candidates ahead on the TextureManager's
+		//worker threads while each one is compared.
+		auto *tm = TextureManager::getInstance();
+		int ahead = std::max(2,(int)std::thread::hardware_concurrency());
+		auto prefetch = ++cmdline_argList.begin();
+
 		StringList::iterator it = cmdline_argList.begin();
 		it++;
 		for(; it!=cmdline_argList.end(); it++)
 		{
-			texture_test_compare(master.c_str(),it->c_str(),10);
+			for(;prefetch!=cmdline_argList.end();prefetch++)
+			{
+				if(std::distance(it,prefetch)>=ahead) break;
+
+				tm->loadTextureAsync(prefetch->c_str());
+			}
+
+			std::string diff;
+			if(cmdline_doTextureDiff) diff = *it+".diff.tga";
+			texture_test_compare(master.c_str(),it->c_str(),10,diff.c_str());
 		}
 		return 0;
 	}
 
 	FilterManager *mgr = FilterManager::getInstance();
 
+	//NEW: Models upload their textures as they're loaded, so the context
+	//is made current first.
+	if(cmdline_doRender)
+	{
+		cmdline_offscreen = new OffscreenContext;
+		if(!cmdline_offscreen->create(cmdline_renderSize[0],cmdline_renderSize[1]))
+		{
+			msg_error("--render-frames: could not make an offscreen OpenGL context");
+			return 1;
+		}
+	}
+
 	StringList::iterator it = cmdline_argList.begin();
 	for(; it!=cmdline_argList.end(); it++)
 	{
@@ -386,6 +745,11 @@ int cmdline_command()
 			}
 		}
 
+		if(cmdline_doRender)
+		{
+			errors+=cmdline_render(m);
+		}
+
 		if(cmdline_doBatch)
 		{
 			cmdline_runui = false;
@@ -439,7 +803,7 @@ void mlocale_set(const char *l){ s_locale = l; }
 const char *mlocale_get(){ return s_locale.c_str(); }
 
 //TRANSPLANTED FROM (mm3dcore) texturetest.h/cc
-extern void texture_test_compare(const char *f1, const char *f2, unsigned fuzzyValue)
+extern void texture_test_compare(const char *f1, const char *f2, unsigned fuzzyValue, const char *diffFile)
 {
 	TextureManager *texmgr = TextureManager::getInstance();
 
@@ -457,32 +821,121 @@ extern void texture_test_compare(const char *f1, const char *f2, unsigned fuzzyV
 	}
 
 	Texture::CompareResultT res;
-	bool match = false;
+	Texture::CompareStatsT stats;
+	Texture diff;
+	bool wantDiff = diffFile&&*diffFile;
+	bool match = t1->compare(t2,&res,fuzzyValue,&stats,wantDiff?&diff:nullptr);
 
+	//NEW: The images are compared once. The histogram gives the fuzzy
+	//count at every threshold that this used to compare them again for.
 	float fuzzyImage = 0.90f;
-	bool pixelPerfect  = false;
 	float fuzzyMatch	= 0.0f;
 	int steps = 256 *3;
-	for(int t = 0; t<=steps; t++)
+	if(res.comparable)
 	{
-		float fuzzyValue = 1-(float)t/steps;
-		match = Texture::compare(t1,t2,&res,t);
-		if(res.comparable)
+		unsigned fuzzyCount = 0;
+		for(int t = 0; t<=steps; t++)
 		{
-			if(res.pixelCount==res.matchCount)
-			{
-				pixelPerfect = true;
-			}
-
-			if((float)res.fuzzyCount/res.pixelCount>=fuzzyImage)
+			fuzzyCount+=stats.histogram[t];
+			if((float)fuzzyCount/res.pixelCount>=fuzzyImage)
 			{
-				fuzzyMatch = fuzzyValue;
+				fuzzyMatch = 1-(float)t/steps;
 				break;
 			}
 		}
-		else break;
+	}
+	else
+	{
+		res.matchCount = 0; res.pixelCount = 1; stats.psnr = 0; //Sizes differ.
 	}
 
 	printf("%s and %s\n",t1->m_name.c_str(),t2->m_name.c_str());
-	printf("  %c %.2f %.2f\n",match?'Y':'N',(float)res.matchCount/res.pixelCount,fuzzyMatch);
+	printf("  %c %.2f %.2f %.2f\n",match?'Y':'N',(float)res.matchCount/res.pixelCount,fuzzyMatch,stats.psnr);
+
+	if(wantDiff&&res.comparable)
+	{
+		diff.m_name = t2->m_name;
+		if(texmgr->write(&diff,diffFile))
+		printf("could not write %s\n",diffFile);
+	}
+}
+
+//NEW: The text export filters must write the same files they did with
+//vsnprintf, so this formats a table of numbers both ways and compares
+//them. It's enough text that TextDest has to flush several times.
+extern int textdest_test_compare()
+{
+	std::vector<double> values = 
+	{
+		0.0,-0.0,1.0,-1.0,0.5,1.5,2.5,-2.5,0.125,0.375,-0.625,0.05,0.15,
+		0.0005,0.00049999999,0.1,0.2,0.3,1/3.0,-2/3.0,9.9999995,99.5,
+		0.999999999,1e-7,-1e-7,1e-300,4.9e-324,123456.789,1e15,1e17,
+		1.8e19,1e20,-1e25,DBL_MAX,-DBL_MAX,DBL_MIN,FLT_MAX,FLT_MIN,
+		(double)INT_MAX,(double)INT_MIN,HUGE_VAL,-HUGE_VAL,NAN,
+	};
+	uint64_t x = 88172645463325252ull; //xorshift64
+	for(int i=0;i<20000;i++)
+	{
+		x^=x<<13; x^=x>>7; x^=x<<17;
+		double d = (x>>11)*(1.0/(1ull<<53))*pow(10.0,(int)(x%40)-20);
+		if(x&1) d = -d;
+		values.push_back(i&1?(double)(float)d:d);
+	}
+
+	auto fmt = [](int n, char (&f)[32])
+	{
+		if(n==10) snprintf(f,sizeof(f),"%%s %%f %%d\n");
+		else snprintf(f,sizeof(f),"%%s %%d %%u %%.%df%%%%\n",n);
+	};
+	auto args = [&](size_t i, int n, int &j, unsigned &u)
+	{
+		uint64_t h = (i*11+n+1)*6364136223846793005ull;
+		j = (int)(h>>32); u = (unsigned)h;
+	};
+
+	std::string expected; char line[1024], f[32];
+	for(size_t i=0;i<values.size();i++) for(int n=0;n<=10;n++)
+	{
+		int j; unsigned u; args(i,n,j,u); fmt(n,f);
+		const char *s = i%3?"v":"";
+		if(n==10) snprintf(line,sizeof(line),f,s,values[i],j);
+		else snprintf(line,sizeof(line),f,s,j,u,values[i]);
+		expected+=line;
+	}
+
+	std::vector<uint8_t> buf(expected.size()*2);
+	MemDataDest mem(buf.data(),buf.size());
+	{
+		TextDest td(&mem);
+		for(size_t i=0;i<values.size();i++) for(int n=0;n<=10;n++)
+		{
+			int j; unsigned u; args(i,n,j,u); fmt(n,f);
+			const char *s = i%3?"v":"";
+			if(n==10) td.writePrintf(f,s,values[i],j);
+			else td.writePrintf(f,s,j,u,values[i]);
+		}
+		if(!td.flush())
+		{
+			printf("TextDest: could not write\n"); return 1;
+		}
+	}
+	size_t len = mem.getDataLength();
+	const char *got = (const char*)buf.data();
+
+	int lines = 0, errors = 0;
+	for(size_t i=0,j=0;i<expected.size();lines++)
+	{
+		size_t ie = expected.find('\n',i)+1;
+		size_t je = j; while(je<len&&got[je++]!='\n');
+		if(ie-i!=je-j||memcmp(&expected[i],got+j,ie-i))
+		{
+			if(errors++<10) printf("TextDest:  %.*svsnprintf: %.*s",
+			(int)(je-j),got+j,(int)(ie-i),&expected[i]);
+		}
+		i = ie; j = je;
+	}
+	if(len!=expected.size()&&!errors) errors++;
+
+	printf("TextDest: %d lines, %d differ (%d bytes)\n",lines,errors,(int)len);
+	return errors;
 }
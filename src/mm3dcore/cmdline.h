@@ -33,6 +33,7 @@ void shutdown_cmdline();
 
 extern bool cmdline_runcommand;
 extern bool cmdline_runui;
+extern bool cmdline_runheadless; //NEW: --render-frames needs no display
 extern int cmdline_command();
 
 extern int cmdline_getOpenModelCount();
@@ -41,6 +42,13 @@ extern void cmdline_clearOpenModelList();  // Clear list without freeing
 extern void cmdline_deleteOpenModels();	 // Free models in list,then clear
 
 //TRANSPLANTED FROM (mm3dcore) texturetest.h/cc
-extern void texture_test_compare(const char *f1, const char *f2, unsigned fuzzyValue);
+//NEW: Prints the PSNR after the fuzzy match and writes an image of the
+//differences to diffFile (TGA) if it's not empty.
+extern void texture_test_compare(const char *f1, const char *f2, unsigned fuzzyValue, const char *diffFile=nullptr);
+
+//NEW: --testtextdest checks that TextDest::writePrintf writes the same
+//as vsnprintf for the conversions it formats itself. It prints the ones
+//that differ and returns how many.
+extern int textdest_test_compare();
 
 #endif // __CMDLINE_H
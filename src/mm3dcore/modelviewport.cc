@@ -30,6 +30,7 @@
 #include "log.h"
 #include "modelstatus.h"
 #include "texmgr.h"
+#include "texscale.h"
 #include "modelviewport.h"
 #include "mm3dport.h"
 
@@ -414,7 +415,10 @@ void ModelViewport::draw(int x, int y, int w, int h)
 	{
 		drawMode = model->getCanvasDrawMode();
 
-		drawBackground(); // Draw background
+		{
+			Timing::Scope _(parent->timing,Timing::DP_Background);
+			drawBackground(); // Draw background
+		}
 		
 		//glClear(GL_DEPTH_BUFFER_BIT); //???
 	}
@@ -450,8 +454,11 @@ void ModelViewport::draw(int x, int y, int w, int h)
 			//ContextT was because every view was its own OpenGL context
 			//model->draw(opt,static_cast<ContextT>(this),_viewPoint);
 			//model->draw(modelviewport_opts(drawMode),nullptr,_viewPoint);
+			Timing::Scope _(parent->timing,Timing::DP_Model);
 			double *eye = m_viewInverse.getVector(3);
-			model->draw(modelviewport_opts(drawMode),nullptr,eye);
+			int opts = modelviewport_opts(drawMode);
+			if(!m_rendering&&parent->isDragging()) opts|=Model::DO_PROXY;
+			model->draw(opts,nullptr,eye);
 		}
 		glDepthRange(0,1);
 
@@ -481,8 +488,14 @@ void ModelViewport::draw(int x, int y, int w, int h)
 		//polygons. It doesn't make a lot of sense, so it 
 		//could be a driver thing.
 
-		model->drawLines(0.5f);
-		model->drawVertices(!parent->tool->isNullTool());
+		{
+			Timing::Scope _(parent->timing,Timing::DP_Lines);
+			model->drawLines(0.5f);
+		}
+		{
+			Timing::Scope _(parent->timing,Timing::DP_Vertices);
+			model->drawVertices(!parent->tool->isNullTool());
+		}
 
 		if(!poffset) glDisable(GL_POLYGON_OFFSET_FILL);
 		if(!poffset) glDisable(GL_POLYGON_OFFSET_LINE);
@@ -506,6 +519,7 @@ void ModelViewport::draw(int x, int y, int w, int h)
 			glDisable(GL_DEPTH_TEST);
 			glEnable(GL_BLEND);
 			{
+				Timing::Scope _(parent->timing,Timing::DP_Grid);
 				drawGridLines(0.15f);
 			}
 			glDisable(GL_BLEND);
@@ -532,6 +546,7 @@ void ModelViewport::draw(int x, int y, int w, int h)
 			//forward facing polygons! Note, Misfit
 			//(or Maverick) was using 0
 
+			Timing::Scope _(parent->timing,Timing::DP_Grid);
 			drawGridLines(1,!drawSelections);
 		}
 		glDepthRange(0,1);
@@ -558,13 +573,20 @@ void ModelViewport::draw(int x, int y, int w, int h)
 			
 	if(drawSelections)
 	{
+		Timing::Scope _(parent->timing,Timing::DP_Joints);
 		model->drawJoints(0.333333f,axis);
 	}
 
 	glDisable(GL_DEPTH_TEST);
 	
-	model->drawPoints();
-	model->drawProjections();	
+	{
+		Timing::Scope _(parent->timing,Timing::DP_Points);
+		model->drawPoints();
+	}
+	{
+		Timing::Scope _(parent->timing,Timing::DP_Projections);
+		model->drawProjections();	
+	}
 
 	if(!m_rendering) //animexportwin?
 	{
@@ -588,6 +610,7 @@ void ModelViewport::draw(int x, int y, int w, int h)
 	if(m_view>Tool::ViewPerspective
 	 ||model->getDrawSelection()) //TESTING
 	{
+		Timing::Scope _(parent->timing,Timing::DP_Tool);
 		parent->drawTool(this);
 	}
 	
@@ -633,6 +656,81 @@ void ModelViewport::draw(int x, int y, int w, int h)
 	//swapBuffers();
 }
 
+const char *ModelViewport::Timing::getPhaseName(int p)
+{
+	static const char *const names[DP_MAX] =
+	{
+		"Background","Grid","Model","Lines","Vertices",
+		"Joints","Points","Projections","Tool","Frame",
+	};
+	return p>=0&&p<DP_MAX?names[p]:"";
+}
+double ModelViewport::Timing::_now()
+{
+	if(sync) glFinish();
+
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double,std::milli>(t).count();
+}
+void ModelViewport::Timing::beginFrame()
+{
+	memset(m_acc,0x00,sizeof(m_acc)); m_frame = _now();
+}
+void ModelViewport::Timing::endFrame()
+{
+	m_acc[DP_Frame] = _now()-m_frame;
+	memcpy(m_ring[m_next],m_acc,sizeof(m_acc));
+	m_next = (m_next+1)%framesN;
+	m_frames = std::min<int>(m_frames+1,framesN);
+}
+double ModelViewport::Timing::getAverage(int p)
+{
+	double sum = 0;
+	for(int i=0;i<m_frames;i++) sum+=m_ring[i][p];
+	return m_frames?sum/m_frames:0;
+}
+double ModelViewport::Timing::getMaximum(int p)
+{
+	double mx = 0;
+	for(int i=0;i<m_frames;i++) mx = std::max(mx,m_ring[i][p]);
+	return mx;
+}
+void ModelViewport::Timing::format(std::string &out)
+{
+	//E.g. "16.7ms (Model 9.1, Lines 3.2, Grid 0.8)"
+	int top[3] = {-1,-1,-1};
+	for(int p=0;p<DP_Frame;p++)
+	{
+		double avg = getAverage(p); if(avg<0.05) continue;
+		for(int i=0;i<3;i++) if(top[i]==-1||avg>getAverage(top[i]))
+		{
+			for(int j=2;j>i;j--) top[j] = top[j-1];
+			top[i] = p; break;
+		}
+	}
+	char buf[64];
+	snprintf(buf,sizeof(buf),"%.1fms",getAverage(DP_Frame)); out = buf;
+	for(int i=0;i<3&&top[i]!=-1;i++)
+	{
+		snprintf(buf,sizeof(buf),"%s%s %.1f",i?", ":" (",
+		getPhaseName(top[i]),getAverage(top[i]));
+		out+=buf;
+	}
+	if(top[0]!=-1) out+=')';
+}
+bool ModelViewport::Timing::dump(const char *filename, const char *title)
+{
+	FILE *f = fopen(filename,"a"); if(!f) return false;
+
+	fprintf(f,"%s (%d frames%s)\n",title,m_frames,sync?", synchronized":"");
+	fprintf(f,"%-12s %10s %10s\n","Phase","Avg (ms)","Max (ms)");
+	for(int p=0;p<DP_MAX;p++)
+	{
+		fprintf(f,"%-12s %10.3f %10.3f\n",getPhaseName(p),getAverage(p),getMaximum(p));
+	}
+	fprintf(f,"\n"); return 0==fclose(f);
+}
+
 void ModelViewport::drawGridLines(float a, bool offset3d)
 {
 	glColor4f(0.55f,0.55f,0.55f,a);
@@ -1061,19 +1159,11 @@ bool ModelViewport::updateBackground()
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP); //NEW
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP); //NEW
 
-	GLuint format = m_background->m_format;
-	format = format==Texture::FORMAT_RGBA?GL_RGBA:GL_RGB;
-	
-	//https://github.com/zturtleman/mm3d/issues/85
-	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
-
 	/*FIX ME //Mipmaps option?
 	glTexImage2D(GL_TEXTURE_2D,0,format,
 	m_background->m_width,m_background->m_height,0,
 	format,GL_UNSIGNED_BYTE,m_background->m_data.data());*/
-	gluBuild2DMipmaps(GL_TEXTURE_2D,format, //GLU
-	m_background->m_width,m_background->m_height,							
-	format,GL_UNSIGNED_BYTE,m_background->m_data.data()); return true;
+	texture_scale_upload(m_background); return true; //gluBuild2DMipmaps
 }
 
 void ModelViewport::updateViewport(int how)
@@ -1264,8 +1354,13 @@ void ModelViewport::mouseReleaseEvent(int bt, int bs, int x, int y)
 		model_status(model,StatusNormal,STATUSTIME_SHORT,
 		TRANSLATE("LowLevel","Use the middle mouse button to drag/pan the viewport"));
 	}
+	bool proxy = parent->isDragging(); //NEW
+
 	m_activeButton = 0; //Qt::NoButton;
 	m_operation = MO_None;
+
+	//Restore the full model if DO_PROXY was drawn.
+	if(proxy) parent->updateAllViews();
 }
 
 bool ModelViewport::keyPressEvent(int bt, int bs, int x, int y)
@@ -1851,7 +1946,7 @@ void ModelViewport::frameArea(bool lock, double x1, double y1, double z1, double
 	updateViewport('z');
 }
 
-ModelViewport::Parent::Parent()
+ModelViewport::Parent::Parent(bool overlay)
 	:
 	background_grid(),
 	ports{this,this,this,this,this,this}, //C++11
@@ -1859,7 +1954,7 @@ ModelViewport::Parent::Parent()
 	m_scrollTextures(),
 	m_focus() 
 {	
-	ports[0].initOverlay(m_scrollTextures);
+	if(overlay) ports[0].initOverlay(m_scrollTextures);
 
 	//Let derived class call this in case timing is an issue.
 	//initializeGL(getModel());
@@ -33,6 +33,8 @@ public:
 
 	class Parent;
 
+	struct Timing; //NEW
+
 	Parent *const parent;
 
 	ModelViewport(Parent*);
@@ -185,6 +187,59 @@ protected:
 	std::array<int,2> m_scrollStartPosition; //QPoint
 };
 
+//NEW: Parent::timing collects how long each phase of draw takes,
+//summed over the views, and averages them over the last framesN
+//frames. Whatever draws the views marks where the frames are.
+struct ModelViewport::Timing
+{
+	enum PhaseE
+	{
+		DP_Background,DP_Grid,DP_Model,DP_Lines,DP_Vertices,
+		DP_Joints,DP_Points,DP_Projections,DP_Tool,
+		DP_Frame, //beginFrame to endFrame.
+		DP_MAX
+	};
+	static const char *getPhaseName(int);
+
+	// If set glFinish is called before reading the clock so that
+	// the phases are charged for the GPU's work too. This stalls
+	// the pipeline, so it's only for debugging.
+	bool sync;
+
+	// Adds the time it's in scope to a phase.
+	struct Scope
+	{
+		Scope(Timing &t, PhaseE p):t(t),p(p),t0(t._now()){}
+		~Scope(){ t.m_acc[p]+=t._now()-t0; }
+
+		Timing &t; PhaseE p; double t0;
+	};
+
+	void beginFrame(),endFrame();
+
+	enum{ framesN=60 };
+	int getFrameCount(){ return m_frames; } //framesN at most.
+
+	// Milliseconds per frame.
+	double getAverage(int phase), getMaximum(int phase);
+
+	// Prints the average frame time and its slowest phases.
+	void format(std::string&);
+
+	// Appends a table of the averages and maximums to a file.
+	bool dump(const char *filename, const char *title="");
+
+	Timing():sync(),m_frames(),m_next(),m_frame(),m_acc(),m_ring(){}
+
+protected:
+
+	double _now(); //Milliseconds.
+
+	int m_frames,m_next; double m_frame;
+
+	double m_acc[DP_MAX],m_ring[framesN][DP_MAX];
+};
+
 //WORK-IN-PROGRESS
 class ModelViewport::Parent : public Tool::Parent
 {
@@ -196,7 +251,9 @@ class ModelViewport::Parent : public Tool::Parent
 
 protected:
 
-	Parent();
+	//NOTE: overlay is false if the views are only rendered (see render)
+	//so that the UI's image loading code isn't needed to draw them.
+	Parent(bool overlay=true);
 
 	bool background_grid[2];
 
@@ -204,6 +261,8 @@ protected:
 
 public:
 
+	ModelViewport::Timing timing; //NEW
+
 	//NOTE: lock is new
 	void frameArea(bool lock, double x1, double y1, double z1, double x2, double y2, double z2)
 	{
@@ -246,6 +305,19 @@ public: //slots:
 	enum{ user_statesN='9'-'1'+1 };
 	ModelViewport::ViewStateT user_states[user_statesN];
 		
+	//NEW: True if a view is being rotated or a tool is dragging in one.
+	//Model::draw is passed DO_PROXY so huge models draw a stand-in.
+	bool isDragging()
+	{
+		for(int i=0;i<viewsN;i++) switch(ports[i].m_operation)
+		{
+		case ModelViewport::MO_Rotate: return true;
+		case ModelViewport::MO_Tool: if(!tool->isSelectTool()) return true;
+		default:;
+		}
+		return false;
+	}
+
 		/*ModelViewport imports*/
 
 	inline void drawTool(ModelViewport *p)
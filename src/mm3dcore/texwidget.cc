@@ -30,6 +30,7 @@
 #include "glmath.h" //distance
 
 #include "texture.h"
+#include "texscale.h"
 #include "model.h"
 #include "log.h"
 //#include "mm3dport.h"
@@ -394,18 +395,11 @@ void TextureWidget::initTexture()
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,m_sClamp?GL_CLAMP:GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,m_tClamp?GL_CLAMP:GL_REPEAT);
 
-	GLuint format = m_texture->m_format==Texture::FORMAT_RGBA?GL_RGBA:GL_RGB;
-
-	//https://github.com/zturtleman/mm3d/issues/85
-	glPixelStorei(GL_UNPACK_ALIGNMENT,1);
-
 	/*FIX ME //Mipmaps option?
 	glTexImage2D(GL_TEXTURE_2D,0,format,
 	m_texture->m_width,m_texture->m_height,0,
 	format,GL_UNSIGNED_BYTE,m_texture->m_data.data());*/
-	gluBuild2DMipmaps(GL_TEXTURE_2D,format, //GLU
-	m_texture->m_width,m_texture->m_height,							
-	format,GL_UNSIGNED_BYTE,m_texture->m_data.data());
+	texture_scale_upload(m_texture); //gluBuild2DMipmaps
 }
 
 void TextureWidget::uFlipCoordinates()